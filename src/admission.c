@@ -0,0 +1,602 @@
+
+/*
+ * admission.c
+ *
+ * See ``COPYRIGHT.mpd''
+ */
+
+#include "ppp.h"
+#include "admission.h"
+#include "event.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+ * DEFINITIONS
+ */
+
+/*
+ * Admission control for new sessions.
+ *
+ * Every new call or connection is checked here before a link is picked
+ * for it. Sessions that already have a link are never refused, so while
+ * the daemon is busy the work it has is finished before new work is taken.
+ *
+ * Load is measured as "pressure", in percent of the configured limit for
+ * the worst of: event loop lag, authentications in flight, RADIUS reply
+ * time, message queue length and memory budgets. At 100% a global rate
+ * limit is seeded from the recent admitted rate and cut by 30% each
+ * second until the pressure drops; below 80% it grows by 10% a second
+ * and is removed after ADM_CALM_SECS calm seconds. At 200% new sessions
+ * are refused, and from 100% of a memory budget as well.
+ *
+ * Independent token buckets may limit each protocol and each interface.
+ */
+
+  #define ADM_PROBE_INTERVAL	100	/* msec */
+  #define ADM_ADAPT_TICKS	10	/* probes per rate adjustment */
+  #define ADM_CALM_SECS		10
+  #define ADM_MAX_PRESSURE	1000	/* percent */
+  #define ADM_SIGNALS		5
+
+  /* Reasons to refuse */
+  enum {
+    ADM_R_OVERLOAD = 0,
+    ADM_R_ADAPTIVE,
+    ADM_R_PROTO,
+    ADM_R_IFACE,
+    ADM_R_MEMORY,
+    ADM_R_MAX
+  };
+
+  /* Token bucket, tokens are kept in 1/1000 units */
+  struct adm_bucket {
+    u_int	rate;		/* tokens per second, 0 = unlimited */
+    u_int	burst;
+    int64_t	tokens;
+    uint64_t	last;		/* msec */
+  };
+
+  struct adm_iface {
+    char		name[64];
+    struct adm_bucket	b;
+    u_int		admitted;
+    u_int		rejected;
+  };
+
+  struct adm_proto {
+    const char		*name;
+    struct adm_bucket	b;
+    u_int		admitted;
+    u_int		rejected[ADM_R_MAX];
+  };
+
+  /* Set menu options */
+  enum {
+    SET_LAG,
+    SET_AUTH,
+    SET_RADIUS,
+    SET_MIN_RATE,
+    SET_RATE,
+    SET_IFACE_RATE
+  };
+
+/*
+ * INTERNAL FUNCTIONS
+ */
+
+  static void		AdmissionProbe(int type, void *arg);
+  static void		AdmissionAdapt(uint64_t now);
+  static u_int		AdmissionPressure(u_int *parts);
+  static uint64_t	AdmissionNow(void);
+  static struct adm_iface	*AdmissionIface(const char *name);
+  static u_int32_t	AdmissionIfaceHash(struct ghash *g, const void *item);
+  static int		AdmissionIfaceEqual(struct ghash *g, const void *item1,
+			  const void *item2);
+  static void		BucketSet(struct adm_bucket *b, u_int rate, u_int burst,
+			  uint64_t now);
+  static int		BucketReady(struct adm_bucket *b, uint64_t now);
+  static void		BucketTake(struct adm_bucket *b);
+  static int		AdmissionSetCommand(Context ctx, int ac,
+			  const char *const av[], const void *arg);
+
+/*
+ * GLOBAL VARIABLES
+ */
+
+  const struct cmdtab AdmissionSetCmds[] = {
+    { "lag {ms}",			"Event loop lag limit",
+	AdmissionSetCommand, NULL, 2, (void *) SET_LAG },
+    { "auth {num}",			"Authentications in flight limit",
+	AdmissionSetCommand, NULL, 2, (void *) SET_AUTH },
+    { "radius {ms}",			"RADIUS reply time limit",
+	AdmissionSetCommand, NULL, 2, (void *) SET_RADIUS },
+    { "min-rate {num}",			"Adaptive rate floor, per second",
+	AdmissionSetCommand, NULL, 2, (void *) SET_MIN_RATE },
+    { "rate {proto} {num} [{burst}]",	"New sessions per second for protocol",
+	AdmissionSetCommand, NULL, 2, (void *) SET_RATE },
+    { "iface-rate {num} [{burst}]",	"New sessions per second for each interface",
+	AdmissionSetCommand, NULL, 2, (void *) SET_IFACE_RATE },
+    { NULL, NULL, NULL, NULL, 0, NULL },
+  };
+
+/*
+ * INTERNAL VARIABLES
+ */
+
+  static const char	*gAdmReasons[ADM_R_MAX] = {
+    "overload", "adaptive rate", "protocol rate", "interface rate",
+    "memory budget"
+  };
+
+  static struct adm_proto	gAdmProtos[ADM_PROTO_MAX] = {
+    { "pppoe" }, { "l2tp" }, { "pptp" }, { "tcp" }, { "udp" }
+  };
+
+  /* Limits, zero disables */
+  static u_int		gAdmLagLimit = 200;	/* msec */
+  static u_int		gAdmAuthLimit = 128;
+  static u_int		gAdmRadiusLimit = 3000;	/* msec */
+  static u_int		gAdmMinRate = 10;
+  static u_int		gAdmIfaceRate = 0;
+  static u_int		gAdmIfaceBurst = 0;
+
+  static EventRef	gAdmProbe;
+  static uint64_t	gAdmProbeLast;
+  static u_int		gAdmProbeTicks;
+  static u_int		gAdmLag;		/* msec, averaged */
+  static atomic_int	gAdmAuth;
+  static pthread_mutex_t	gAdmRadiusMutex;
+  static u_int		gAdmRadius;		/* msec, averaged */
+
+  static struct adm_bucket	gAdmAdaptive;	/* global rate, when limited */
+  static u_int		gAdmPeriodAdmitted;
+  static uint64_t	gAdmPeriodStart;
+  static u_int		gAdmRate;		/* admitted per second, averaged */
+  static u_int		gAdmCalm;
+  static struct ghash	*gAdmIfaces;		/* struct adm_iface by name */
+
+/*
+ * AdmissionInit()
+ */
+
+void
+AdmissionInit(void)
+{
+    int ret = pthread_mutex_init(&gAdmRadiusMutex, NULL);
+    if (ret != 0) {
+	Log(LG_ERR, ("Could not create admission mutex: %d", ret));
+	exit(EX_UNAVAILABLE);
+    }
+    gAdmProbeLast = gAdmPeriodStart = AdmissionNow();
+    if (EventRegister(&gAdmProbe, EVENT_TIMEOUT, ADM_PROBE_INTERVAL,
+      EVENT_RECURRING, AdmissionProbe, NULL) != 0)
+	exit(EX_UNAVAILABLE);
+}
+
+/*
+ * AdmissionCheck()
+ *
+ * Decide whether a new session may be started. Returns zero if so.
+ * Called by the device types with the giant mutex held.
+ */
+
+int
+AdmissionCheck(int proto, const char *iface)
+{
+    struct adm_proto	*p = &gAdmProtos[proto];
+    struct adm_iface	*ifp = NULL;
+    uint64_t		now = AdmissionNow();
+    int			reason = -1;
+
+    assert(proto >= 0 && proto < ADM_PROTO_MAX);
+    if (iface != NULL && gAdmIfaceRate)
+	ifp = AdmissionIface(iface);
+
+    /* Look at every limit before taking any tokens */
+    if (AdmissionPressure(NULL) >= 200)
+	reason = ADM_R_OVERLOAD;
+    else if (MemPressure() >= 100)
+	reason = ADM_R_MEMORY;
+    else if (gAdmAdaptive.rate && !BucketReady(&gAdmAdaptive, now))
+	reason = ADM_R_ADAPTIVE;
+    else if (!BucketReady(&p->b, now))
+	reason = ADM_R_PROTO;
+    else if (ifp && !BucketReady(&ifp->b, now))
+	reason = ADM_R_IFACE;
+
+    if (reason >= 0) {
+	p->rejected[reason]++;
+	if (ifp)
+	    ifp->rejected++;
+	Log(LG_PHYS2, ("Admission: %s request via %s refused: %s",
+	    p->name, iface ? iface : "-", gAdmReasons[reason]));
+	return (-1);
+    }
+
+    if (gAdmAdaptive.rate)
+	BucketTake(&gAdmAdaptive);
+    BucketTake(&p->b);
+    if (ifp) {
+	BucketTake(&ifp->b);
+	ifp->admitted++;
+    }
+    p->admitted++;
+    gAdmPeriodAdmitted++;
+    return (0);
+}
+
+/*
+ * AdmissionAuthStart()
+ * AdmissionAuthDone()
+ *
+ * Count authentications in flight. May be called from any thread.
+ */
+
+void
+AdmissionAuthStart(void)
+{
+    atomic_fetch_add_explicit(&gAdmAuth, 1, memory_order_relaxed);
+}
+
+void
+AdmissionAuthDone(void)
+{
+    atomic_fetch_sub_explicit(&gAdmAuth, 1, memory_order_relaxed);
+}
+
+/*
+ * AdmissionRadiusLatency()
+ *
+ * Account RADIUS request round trip time. Called from auth threads.
+ */
+
+void
+AdmissionRadiusLatency(u_int ms)
+{
+    MUTEX_LOCK(gAdmRadiusMutex);
+    gAdmRadius = (gAdmRadius * 7 + ms) / 8;
+    MUTEX_UNLOCK(gAdmRadiusMutex);
+}
+
+/*
+ * AdmissionStat()
+ */
+
+int
+AdmissionStat(Context ctx, int ac, const char *const av[], const void *arg)
+{
+    struct ghash_walk	walk;
+    struct adm_iface	*ifp;
+    struct adm_proto	*p;
+    u_int		parts[ADM_SIGNALS];
+    u_int		pressure;
+    int			k;
+
+    (void)ac;
+    (void)av;
+    (void)arg;
+
+    pressure = AdmissionPressure(parts);
+    Printf("Admission control:\r\n");
+    Printf("\tPressure	: %u%% (lag %u%%, auth %u%%, radius %u%%, queue %u%%, mem %u%%)\r\n",
+	pressure, parts[0], parts[1], parts[2], parts[3], parts[4]);
+    Printf("\tEvent lag	: %u ms (limit %u)\r\n", gAdmLag, gAdmLagLimit);
+    Printf("\tAuth in flight	: %d (limit %u)\r\n",
+	atomic_load_explicit(&gAdmAuth, memory_order_relaxed), gAdmAuthLimit);
+    Printf("\tRADIUS latency	: %u ms (limit %u)\r\n", gAdmRadius, gAdmRadiusLimit);
+    Printf("\tAdmitted rate	: %u/s\r\n", gAdmRate);
+    if (gAdmAdaptive.rate)
+	Printf("\tAdaptive rate	: %u/s (min %u)\r\n", gAdmAdaptive.rate, gAdmMinRate);
+    else
+	Printf("\tAdaptive rate	: off (min %u)\r\n", gAdmMinRate);
+    Printf("\tIface rate	: %u/s (burst %u)\r\n", gAdmIfaceRate, gAdmIfaceBurst);
+
+    Printf("Protocol  Rate/s  Burst  Admitted  Overload  Adaptive  Proto  Iface  Memory\r\n");
+    for (k = 0; k < ADM_PROTO_MAX; k++) {
+	p = &gAdmProtos[k];
+	Printf("%-8s  %6u  %5u  %8u  %8u  %8u  %5u  %5u  %6u\r\n", p->name,
+	    p->b.rate, p->b.burst, p->admitted,
+	    p->rejected[ADM_R_OVERLOAD], p->rejected[ADM_R_ADAPTIVE],
+	    p->rejected[ADM_R_PROTO], p->rejected[ADM_R_IFACE],
+	    p->rejected[ADM_R_MEMORY]);
+    }
+    if (gAdmIfaces != NULL && ghash_size(gAdmIfaces) > 0) {
+	Printf("Interface                         Admitted  Refused\r\n");
+	ghash_walk_init(gAdmIfaces, &walk);
+	while ((ifp = ghash_walk_next(gAdmIfaces, &walk)) != NULL)
+	    Printf("%-32s  %8u  %7u\r\n", ifp->name, ifp->admitted, ifp->rejected);
+    }
+    return (0);
+}
+
+/*
+ * AdmissionProbe()
+ *
+ * Measure how late the event loop runs this timer.
+ */
+
+static void
+AdmissionProbe(int type, void *arg)
+{
+    uint64_t	now = AdmissionNow();
+    u_int	lag = 0;
+
+    (void)type;
+    (void)arg;
+
+    if (now > gAdmProbeLast + ADM_PROBE_INTERVAL)
+	lag = now - gAdmProbeLast - ADM_PROBE_INTERVAL;
+    gAdmProbeLast = now;
+    gAdmLag = (gAdmLag * 3 + lag) / 4;
+    MemBudgetUpdate();
+
+    if (++gAdmProbeTicks >= ADM_ADAPT_TICKS) {
+	gAdmProbeTicks = 0;
+	AdmissionAdapt(now);
+    }
+}
+
+/*
+ * AdmissionAdapt()
+ *
+ * Adjust the global rate limit to the current pressure.
+ */
+
+static void
+AdmissionAdapt(uint64_t now)
+{
+    u_int	pressure, rate, limit;
+
+    pressure = AdmissionPressure(NULL);
+
+    if (now > gAdmPeriodStart) {
+	rate = (uint64_t)gAdmPeriodAdmitted * 1000 / (now - gAdmPeriodStart);
+	gAdmRate = (gAdmRate + rate) / 2;
+    }
+    gAdmPeriodAdmitted = 0;
+    gAdmPeriodStart = now;
+
+    limit = gAdmAdaptive.rate;
+    if (pressure >= 100) {
+	gAdmCalm = 0;
+	if (limit == 0)
+	    limit = gAdmRate;
+	limit = limit * 7 / 10;
+	if (limit < gAdmMinRate)
+	    limit = gAdmMinRate;
+	if (limit < 1)
+	    limit = 1;
+	if (gAdmAdaptive.rate == 0)
+	    Log(LG_PHYS, ("Admission: pressure %u%%, limiting new sessions to %u/s",
+		pressure, limit));
+    } else if (limit) {
+	if (pressure < 80)
+	    limit += limit / 10 + 1;
+	if (pressure >= 50)
+	    gAdmCalm = 0;
+	else if (++gAdmCalm >= ADM_CALM_SECS) {
+	    Log(LG_PHYS, ("Admission: pressure %u%%, rate limit removed",
+		pressure));
+	    limit = 0;
+	}
+    }
+    if (limit != gAdmAdaptive.rate)
+	BucketSet(&gAdmAdaptive, limit, limit / 4 + 1, now);
+}
+
+/*
+ * AdmissionPressure()
+ *
+ * Returns the load in percent of the worst configured limit.
+ * Optionally fills in the per signal values.
+ */
+
+static u_int
+AdmissionPressure(u_int *parts)
+{
+    u_int	v[ADM_SIGNALS] = { 0, 0, 0, 0, 0 };
+    u_int	pressure = 0;
+    int		q, k;
+
+    if (gAdmLagLimit)
+	v[0] = gAdmLag * 100 / gAdmLagLimit;
+    if (gAdmAuthLimit)
+	v[1] = atomic_load_explicit(&gAdmAuth, memory_order_relaxed)
+	    * 100 / gAdmAuthLimit;
+    if (gAdmRadiusLimit) {
+	MUTEX_LOCK(gAdmRadiusMutex);
+	v[2] = gAdmRadius * 100 / gAdmRadiusLimit;
+	MUTEX_UNLOCK(gAdmRadiusMutex);
+    }
+    q = MsgQueueLen();
+    if (q > gQThresMin)
+	v[3] = (q - gQThresMin) * 100 / gQThresDiff;
+    v[4] = MemPressure();
+    for (k = 0; k < ADM_SIGNALS; k++) {
+	if (v[k] > ADM_MAX_PRESSURE)
+	    v[k] = ADM_MAX_PRESSURE;
+	if (v[k] > pressure)
+	    pressure = v[k];
+	if (parts)
+	    parts[k] = v[k];
+    }
+    return (pressure);
+}
+
+static uint64_t
+AdmissionNow(void)
+{
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*
+ * AdmissionIface()
+ *
+ * Find or create the bucket of an interface.
+ */
+
+static struct adm_iface *
+AdmissionIface(const char *name)
+{
+    struct adm_iface	key, *ifp;
+
+    if (gAdmIfaces == NULL &&
+      (gAdmIfaces = ghash_create(NULL, 0, 0, MB_ADMIT, AdmissionIfaceHash,
+	AdmissionIfaceEqual, NULL, NULL)) == NULL)
+	return (NULL);
+
+    strlcpy(key.name, name, sizeof(key.name));
+    if ((ifp = ghash_get(gAdmIfaces, &key)) != NULL)
+	return (ifp);
+    ifp = Malloc(MB_ADMIT, sizeof(*ifp));
+    strlcpy(ifp->name, name, sizeof(ifp->name));
+    BucketSet(&ifp->b, gAdmIfaceRate, gAdmIfaceBurst, AdmissionNow());
+    if (ghash_put(gAdmIfaces, ifp) == -1) {
+	Freee(ifp);
+	return (NULL);
+    }
+    return (ifp);
+}
+
+static u_int32_t
+AdmissionIfaceHash(struct ghash *g, const void *item)
+{
+    const struct adm_iface	*ifp = item;
+    const u_char		*p;
+    u_int32_t			h = 0;
+
+    (void)g;
+    for (p = (const u_char *)ifp->name; *p; p++)
+	h = h * 31 + *p;
+    return (h);
+}
+
+static int
+AdmissionIfaceEqual(struct ghash *g, const void *item1, const void *item2)
+{
+    const struct adm_iface	*ifp1 = item1;
+    const struct adm_iface	*ifp2 = item2;
+
+    (void)g;
+    return (strcmp(ifp1->name, ifp2->name) == 0);
+}
+
+/*
+ * BucketSet()
+ *
+ * Change bucket rate. The bucket starts full.
+ */
+
+static void
+BucketSet(struct adm_bucket *b, u_int rate, u_int burst, uint64_t now)
+{
+    b->rate = rate;
+    b->burst = burst ? burst : (rate ? rate : 1);
+    b->tokens = (int64_t)b->burst * 1000;
+    b->last = now;
+}
+
+/*
+ * BucketReady()
+ *
+ * Refill the bucket and tell whether it has a whole token.
+ */
+
+static int
+BucketReady(struct adm_bucket *b, uint64_t now)
+{
+    if (b->rate == 0)
+	return (1);
+    if (now > b->last) {
+	/* rate tokens per second is rate/1000 tokens per msec */
+	b->tokens += (int64_t)(now - b->last) * b->rate;
+	if (b->tokens > (int64_t)b->burst * 1000)
+	    b->tokens = (int64_t)b->burst * 1000;
+	b->last = now;
+    }
+    return (b->tokens >= 1000);
+}
+
+static void
+BucketTake(struct adm_bucket *b)
+{
+    if (b->rate)
+	b->tokens -= 1000;
+}
+
+/*
+ * AdmissionSetCommand()
+ */
+
+static int
+AdmissionSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
+{
+    struct ghash_walk	walk;
+    struct adm_iface	*ifp;
+    uint64_t		now = AdmissionNow();
+    int			val, burst = 0, k;
+
+    switch ((intptr_t)arg) {
+    case SET_LAG:
+    case SET_AUTH:
+    case SET_RADIUS:
+    case SET_MIN_RATE:
+	if (ac != 1)
+	    return (-1);
+	if ((val = atoi(av[0])) < 0)
+	    Error("Incorrect value '%s'", av[0]);
+	switch ((intptr_t)arg) {
+	case SET_LAG:
+	    gAdmLagLimit = val;
+	    break;
+	case SET_AUTH:
+	    gAdmAuthLimit = val;
+	    break;
+	case SET_RADIUS:
+	    gAdmRadiusLimit = val;
+	    break;
+	case SET_MIN_RATE:
+	    gAdmMinRate = val;
+	    break;
+	}
+	break;
+
+    case SET_RATE:
+	if (ac < 2 || ac > 3)
+	    return (-1);
+	for (k = 0; k < ADM_PROTO_MAX; k++) {
+	    if (strcasecmp(av[0], gAdmProtos[k].name) == 0)
+		break;
+	}
+	if (k == ADM_PROTO_MAX)
+	    Error("Unknown protocol '%s'", av[0]);
+	if ((val = atoi(av[1])) < 0 || (ac == 3 && (burst = atoi(av[2])) < 0))
+	    Error("Incorrect rate");
+	BucketSet(&gAdmProtos[k].b, val, burst, now);
+	break;
+
+    case SET_IFACE_RATE:
+	if (ac < 1 || ac > 2)
+	    return (-1);
+	if ((val = atoi(av[0])) < 0 || (ac == 2 && (burst = atoi(av[1])) < 0))
+	    Error("Incorrect rate");
+	gAdmIfaceRate = val;
+	gAdmIfaceBurst = burst;
+	if (gAdmIfaces != NULL) {
+	    ghash_walk_init(gAdmIfaces, &walk);
+	    while ((ifp = ghash_walk_next(gAdmIfaces, &walk)) != NULL)
+		BucketSet(&ifp->b, val, burst, now);
+	}
+	break;
+
+    default:
+	assert(0);
+    }
+    return (0);
+}
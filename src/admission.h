@@ -0,0 +1,43 @@
+
+/*
+ * admission.h
+ *
+ * See ``COPYRIGHT.mpd''
+ */
+
+#ifndef _ADMISSION_H_
+#define _ADMISSION_H_
+
+/*
+ * DEFINITIONS
+ */
+
+  /* Protocols that accept new sessions */
+  enum {
+    ADM_PPPOE = 0,
+    ADM_L2TP,
+    ADM_PPTP,
+    ADM_TCP,
+    ADM_UDP,
+    ADM_PROTO_MAX
+  };
+
+/*
+ * VARIABLES
+ */
+
+  extern const struct cmdtab AdmissionSetCmds[];
+
+/*
+ * FUNCTIONS
+ */
+
+  extern void	AdmissionInit(void);
+  extern int	AdmissionCheck(int proto, const char *iface);
+  extern void	AdmissionAuthStart(void);
+  extern void	AdmissionAuthDone(void);
+  extern void	AdmissionRadiusLatency(u_int ms);
+  extern int	AdmissionStat(Context ctx, int ac, const char *const av[], const void *arg);
+
+#endif
+
@@ -16,6 +16,7 @@
 #include "ngfunc.h"
 #include "msoft.h"
 #include "util.h"
+#include "admission.h"
 
 #ifdef USE_PAM
 #include <security/pam_appl.h>
@@ -161,29 +162,60 @@ static const struct confinfo gConfList[] = {
 	{0, 0, NULL},
 };
 
+/*
+ * ACLCopy()
+ *
+ * Copy an ACL list, into "arena" if not NULL
+ */
+
 void
-ACLCopy(struct acl *src, struct acl **dst)
+ACLCopy(struct acl *src, struct acl **dst, Arena arena)
 {
+	size_t len;
+
 	while (src != NULL) {
-		*dst = Mdup(MB_AUTH, src, sizeof(struct acl) + strlen(src->rule));
+		len = sizeof(struct acl) + strlen(src->rule);
+		*dst = arena ? ArenaDup(arena, src, len) : Mdup(MB_AUTH, src, len);
 		src = src->next;
 		dst = &((*dst)->next);
 	};
 	*dst = NULL;
 }
 
+/*
+ * ACLDestroy()
+ *
+ * Free an ACL list, except the entries carved out of "arena"
+ */
+
 void
-ACLDestroy(struct acl *acl)
+ACLDestroy(struct acl *acl, Arena arena)
 {
 	struct acl *acl1;
 
 	while (acl != NULL) {
 		acl1 = acl->next;
-		Freee(acl);
+		ArenaFreee(arena, acl);
 		acl = acl1;
 	};
 }
 
+/*
+ * ACLSize()
+ *
+ * Room an ACL list takes in an arena
+ */
+
+static size_t
+ACLSize(struct acl *acl)
+{
+	size_t size = 0;
+
+	for (; acl != NULL; acl = acl->next)
+		size += ARENA_SIZE(sizeof(struct acl) + strlen(acl->rule));
+	return (size);
+}
+
 void 
 authparamsInit(struct authparams *ap)
 {
@@ -208,83 +240,123 @@ authparamsDestroy(struct authparams *ap)
 	int i;
 #endif
 
-	Freee(ap->eapmsg);
-	Freee(ap->state);
-	Freee(ap->class);
-	Freee(ap->filter_id);
+	/* Only what was set after the copy is freed one by one */
+	ArenaFreee(ap->arena, ap->eapmsg);
+	ArenaFreee(ap->arena, ap->state);
+	ArenaFreee(ap->arena, ap->class);
+	ArenaFreee(ap->arena, ap->filter_id);
 
 #ifdef USE_IPFW
-	ACLDestroy(ap->acl_rule);
-	ACLDestroy(ap->acl_pipe);
-	ACLDestroy(ap->acl_queue);
-	ACLDestroy(ap->acl_table);
+	ACLDestroy(ap->acl_rule, ap->arena);
+	ACLDestroy(ap->acl_pipe, ap->arena);
+	ACLDestroy(ap->acl_queue, ap->arena);
+	ACLDestroy(ap->acl_table, ap->arena);
 #endif					/* USE_IPFW */
 
 #ifdef USE_NG_BPF
 	for (i = 0; i < ACL_FILTERS; i++)
-		ACLDestroy(ap->acl_filters[i]);
+		ACLDestroy(ap->acl_filters[i], ap->arena);
 	for (i = 0; i < ACL_DIRS; i++)
-		ACLDestroy(ap->acl_limits[i]);
+		ACLDestroy(ap->acl_limits[i], ap->arena);
 #endif					/* USE_NG_BPF */
 
 	while ((r = SLIST_FIRST(&ap->routes)) != NULL) {
 		SLIST_REMOVE_HEAD(&ap->routes, next);
-		Freee(r);
+		ArenaFreee(ap->arena, r);
 	}
 
-	Freee(ap->msdomain);
+	ArenaFreee(ap->arena, ap->msdomain);
 #ifdef SIOCSIFDESCR
-	Freee(ap->ifdescr);
+	ArenaFreee(ap->arena, ap->ifdescr);
 #endif
+	ArenaFree(&ap->arena);
 
 	memset(ap, 0, sizeof(struct authparams));
 }
 
+/*
+ * authparamsCopy()
+ *
+ * Deep copy. Everything that "dst" points to is carved out of a single
+ * arena sized up front, so a copy costs one allocation.
+ */
+
 void 
 authparamsCopy(struct authparams *src, struct authparams *dst)
 {
 	IfaceRoute r, r1;
+	Arena arena;
+	size_t size = 0;
 
 #ifdef USE_NG_BPF
 	int i;
 
 #endif
 
+	if (src->eapmsg)
+		size += ARENA_SIZE(src->eapmsg_len);
+	if (src->state)
+		size += ARENA_SIZE(src->state_len);
+	if (src->class)
+		size += ARENA_SIZE(src->class_len);
+	if (src->filter_id)
+		size += ARENA_SIZE(strlen(src->filter_id) + 1);
+#ifdef USE_IPFW
+	size += ACLSize(src->acl_rule) + ACLSize(src->acl_pipe) +
+	    ACLSize(src->acl_queue) + ACLSize(src->acl_table);
+#endif
+#ifdef USE_NG_BPF
+	for (i = 0; i < ACL_FILTERS; i++)
+		size += ACLSize(src->acl_filters[i]);
+	for (i = 0; i < ACL_DIRS; i++)
+		size += ACLSize(src->acl_limits[i]);
+#endif
+	SLIST_FOREACH(r, &src->routes, next)
+		size += ARENA_SIZE(sizeof(*r));
+	if (src->msdomain)
+		size += ARENA_SIZE(strlen(src->msdomain) + 1);
+#ifdef SIOCSIFDESCR
+	if (src->ifdescr)
+		size += ARENA_SIZE(strlen(src->ifdescr) + 1);
+#endif
+	arena = size ? ArenaNew(MB_AUTH, size) : NULL;
+
 	memcpy(dst, src, sizeof(struct authparams));
+	dst->arena = arena;
 
 	if (src->eapmsg)
-		dst->eapmsg = Mdup(MB_AUTH, src->eapmsg, src->eapmsg_len);
+		dst->eapmsg = ArenaDup(arena, src->eapmsg, src->eapmsg_len);
 	if (src->state)
-		dst->state = Mdup(MB_AUTH, src->state, src->state_len);
+		dst->state = ArenaDup(arena, src->state, src->state_len);
 	if (src->class)
-		dst->class = Mdup(MB_AUTH, src->class, src->class_len);
+		dst->class = ArenaDup(arena, src->class, src->class_len);
 	if (src->filter_id)
-		dst->filter_id = Mstrdup(MB_AUTH, src->filter_id);
+		dst->filter_id = ArenaStrdup(arena, src->filter_id);
 
 #ifdef USE_IPFW
-	ACLCopy(src->acl_rule, &dst->acl_rule);
-	ACLCopy(src->acl_pipe, &dst->acl_pipe);
-	ACLCopy(src->acl_queue, &dst->acl_queue);
-	ACLCopy(src->acl_table, &dst->acl_table);
+	ACLCopy(src->acl_rule, &dst->acl_rule, arena);
+	ACLCopy(src->acl_pipe, &dst->acl_pipe, arena);
+	ACLCopy(src->acl_queue, &dst->acl_queue, arena);
+	ACLCopy(src->acl_table, &dst->acl_table, arena);
 #endif					/* USE_IPFW */
 #ifdef USE_NG_BPF
 	for (i = 0; i < ACL_FILTERS; i++)
-		ACLCopy(src->acl_filters[i], &dst->acl_filters[i]);
+		ACLCopy(src->acl_filters[i], &dst->acl_filters[i], arena);
 	for (i = 0; i < ACL_DIRS; i++)
-		ACLCopy(src->acl_limits[i], &dst->acl_limits[i]);
+		ACLCopy(src->acl_limits[i], &dst->acl_limits[i], arena);
 #endif
 
 	SLIST_INIT(&dst->routes);
 	SLIST_FOREACH(r, &src->routes, next) {
-		r1 = Mdup(MB_AUTH, r, sizeof(*r1));
+		r1 = ArenaDup(arena, r, sizeof(*r1));
 		SLIST_INSERT_HEAD(&dst->routes, r1, next);
 	}
 
 	if (src->msdomain)
-		dst->msdomain = Mstrdup(MB_AUTH, src->msdomain);
+		dst->msdomain = ArenaStrdup(arena, src->msdomain);
 #ifdef SIOCSIFDESCR
 	if (src->ifdescr)
-		dst->ifdescr = Mstrdup(MB_AUTH, src->ifdescr);
+		dst->ifdescr = ArenaStrdup(arena, src->ifdescr);
 #endif
 }
 
@@ -357,10 +429,12 @@ AuthStart(Link l)
 	Auth a = &l->lcp.auth;
 
 	/* generate a uniq session id */
+	LinkUnindexAuth(l);
 	snprintf(l->session_id, AUTH_MAX_SESSIONID, "%d-%s",
 	    (int)(time(NULL) % 10000000), l->name);
 
 	authparamsInit(&a->params);
+	LinkIndexAuth(l);
 
 	/* What auth protocols were negotiated by LCP? */
 	a->self_to_peer = l->lcp.peer_auth;
@@ -617,6 +691,7 @@ AuthCleanup(Link l)
 
 	Log(LG_AUTH2, ("[%s] AUTH: Cleanup", l->name));
 
+	LinkUnindexAuth(l);
 	authparamsDestroy(&a->params);
 
 	l->session_id[0] = 0;
@@ -894,6 +969,7 @@ AuthAccountStart(Link l, int type)
 			/* Start accounting update timer. */
 			TimerInit(&a->acct_timer, "AuthAccountTimer",
 			    updateInterval * SECONDS, AuthAccountTimeout, l);
+			TimerSetSlack(&a->acct_timer, gTimerSlack);
 			TimerStartRecurring(&a->acct_timer);
 		}
 	}
@@ -1151,9 +1227,11 @@ AuthAsyncStart(Link l, AuthData auth)
 		auth->finish(l, auth);
 		return;
 	}
+	AdmissionAuthStart();
 	if (paction_start(&a->thread, &gGiantMutex, AuthAsync,
 	    AuthAsyncFinish, auth) == -1) {
 		Perror("[%s] AUTH: Couldn't start thread", l->name);
+		AdmissionAuthDone();
 		auth->status = AUTH_STATUS_FAIL;
 		auth->why_fail = AUTH_FAIL_NOT_EXPECTED;
 		auth->finish(l, auth);
@@ -1271,6 +1349,7 @@ AuthAsyncFinish(void *arg, int was_canceled)
 	AuthData auth = (AuthData) arg;
 	Link l;
 
+	AdmissionAuthDone();
 	if (was_canceled)
 		Log(LG_AUTH2, ("[%s] AUTH: Thread was canceled", auth->info.lnkname));
 
@@ -1289,8 +1368,10 @@ AuthAsyncFinish(void *arg, int was_canceled)
 	Log(LG_AUTH2, ("[%s] AUTH: Thread finished normally", l->name));
 
 	/* Replace modified data */
+	LinkUnindexAuth(l);
 	authparamsDestroy(&l->lcp.auth.params);
 	authparamsMove(&auth->params, &l->lcp.auth.params);
+	LinkIndexAuth(l);
 
 	if (strcmp(l->lcp.auth.params.action, "drop") == 0) {
 		auth->status = AUTH_STATUS_FAIL;
@@ -1711,22 +1792,8 @@ AuthPreChecks(AuthData auth)
 	}
 	/* check max. number of logins */
 	if (gMaxLogins != 0) {
-		int ac;
-		u_long num = 0;
-
-		for (ac = 0; ac < gNumBundles; ac++) {
-			if (gBundles[ac] && gBundles[ac]->open) {
-				if (gMaxLoginsCI) {
-					if (!strcasecmp(gBundles[ac]->params.authname, auth->params.authname))
-						num++;
-				} else {
-					if (!strcmp(gBundles[ac]->params.authname, auth->params.authname))
-						num++;
-				}
-			}
-		}
-
-		if (num >= gMaxLogins) {
+		if (BundCountLogins(auth->params.authname,
+		    gMaxLoginsCI) >= gMaxLogins) {
 			Log(LG_ERR | LG_AUTH, ("[%s] AUTH: Name: \"%s\" max. number of logins exceeded",
 			    auth->info.lnkname, auth->params.authname));
 			auth->status = AUTH_STATUS_FAIL;
@@ -2319,7 +2386,7 @@ AuthExternal(AuthData auth)
 
 #ifdef SIOCSIFDESCR
 		} else if (strcmp(attr, "MPD_IFACE_DESCR") == 0) {
-			Freee(auth->params.ifdescr);
+			ArenaFreee(auth->params.arena, auth->params.ifdescr);
 			auth->params.ifdescr = Mstrdup(MB_AUTH, val);
 #endif					/* SIOCSIFDESCR */
 #ifdef SIOCAIFGROUP
@@ -12,6 +12,7 @@
 
 #include "timer.h"
 #include "ppp.h"
+#include "mbuf.h"
 #include "pap.h"
 #include "chap.h"
 #include "eap.h"
@@ -153,6 +154,10 @@ struct authparams {
 	SLIST_HEAD (, ifaceroute) routes;
 	u_short	mtu;			/* MTU */
 
+	Arena	arena;			/* holds the data copied by
+					 * authparamsCopy(), pointers above
+					 * may point into it */
+
 	u_char	authentic;		/* wich backend was used */
 
 	char	callingnum[128];	/* hr representation of the calling
@@ -337,8 +342,8 @@ extern const char *AuthMPPEPolicyname(int policy);
 extern const char *AuthMPPETypesname(int types, char *buf, size_t len);
 
 #if defined(USE_NG_BPF) || defined(USE_IPFW)
-extern void ACLCopy(struct acl *src, struct acl **dst);
-extern void ACLDestroy(struct acl *acl);
+extern void ACLCopy(struct acl *src, struct acl **dst, Arena arena);
+extern void ACLDestroy(struct acl *acl, Arena arena);
 
 #endif
 extern void authparamsInit(struct authparams *ap);
@@ -81,6 +81,17 @@
   static void	BundCloseLink(Link l);
 
   static void	BundMsg(int type, void *cookie);
+  static void	BundFreeState(Bund b);
+
+  static u_int32_t	BundPeerHash(struct ghash *g, const void *item);
+  static int		BundPeerEqual(struct ghash *g, const void *item1,
+			  const void *item2);
+  static struct bundmp	*BundFindMpEntry(Discrim discrim,
+			  const char *authname);
+  static Bund		BundFindMp(Discrim discrim, const char *authname);
+  static u_int32_t	BundMpHash(struct ghash *g, const void *item);
+  static int		BundMpEqual(struct ghash *g, const void *item1,
+			  const void *item2);
 
 /*
  * GLOBAL VARIABLES
@@ -133,6 +144,40 @@
     { 0,	0,			NULL		},
   };
 
+  /* Indexes of bundles by name, msession id, interface and peer address */
+  static struct keyindex	*gBundNames;
+  static struct keyindex	*gBundMSessions;
+  static struct keyindex	*gBundIfaces;
+  static struct keyindex	*gBundPeers;
+
+  /* Table of open bundles by auth name, for max-logins */
+  static struct keyindex	*gBundUsers;
+
+  /* Multilink bundles by peer discriminator and auth name, for joins */
+  static struct ghash	*gBundMps;
+
+  static struct slotalloc	gBundSlots = SLOTALLOC_INITIALIZER("bundles");
+
+/*
+ * BundsInit()
+ */
+
+int
+BundsInit(void)
+{
+    gBundNames = StrIndexCreate(MB_BUND, 0);
+    gBundMSessions = StrIndexCreate(MB_BUND, 0);
+    gBundIfaces = StrIndexCreate(MB_BUND, 0);
+    gBundUsers = StrIndexCreate(MB_BUND, 1);
+    gBundPeers = KeyIndexCreate(MB_BUND, BundPeerHash, BundPeerEqual);
+    if ((gBundMps = ghash_create(NULL, 0, 0, MB_BUND, BundMpHash,
+	BundMpEqual, NULL, NULL)) == NULL) {
+	Perror("BundsInit(): ghash_create");
+	return (-1);
+    }
+    return (0);
+}
+
 /*
  * BundOpen()
  */
@@ -212,18 +257,8 @@ BundJoin(Link l)
 
     if (!l->bund) {
 	b = NULL;
-	if (lcp->peer_mrru) {
-	    for (k = 0; k < gNumBundles; k++) {
-		if (gBundles[k] && !gBundles[k]->tmpl && gBundles[k]->peer_mrru &&
-		    MpDiscrimEqual(&lcp->peer_discrim, &gBundles[k]->peer_discrim) &&
-		    !strcmp(lcp->auth.params.authname, gBundles[k]->params.authname)) {
-		        break;
-		}
-	    }
-	    if (k != gNumBundles) {
-	        b = gBundles[k];
-	    }
-	}
+	if (lcp->peer_mrru)
+	    b = BundFindMp(&lcp->peer_discrim, lcp->auth.params.authname);
 	if (!b) {
 	    const char	*bundt;
 	    if (strncmp(l->lcp.auth.params.action, "bundle ", 7) == 0) {
@@ -318,10 +353,12 @@ BundJoin(Link l)
 	if ((b->peer_mrru = lcp->peer_mrru)) {
     	    b->peer_discrim = lcp->peer_discrim;
 	}
+	BundIndexMp(b);
 
 	/* Start bandwidth management */
 	BundBmStart(b);
     }
+    BundIndexUser(b);
 
     /* Reasses MTU, bandwidth, etc. */
     BundReasses(b);
@@ -350,8 +387,10 @@ BundJoin(Link l)
     	    Enabled(&b->conf.options, BUND_CONF_ROUNDROBIN);
 
 	/* generate a uniq msession_id */
+	StrIndexDel(gBundMSessions, b->msession_id);
 	snprintf(b->msession_id, AUTH_MAX_SESSIONID, "%d-%s",
     	    (int)(time(NULL) % 10000000), b->name);
+	StrIndexAdd(gBundMSessions, b->msession_id);
       
 	b->originate = l->originate;
     }
@@ -374,6 +413,7 @@ BundJoin(Link l)
 	/* starting bundle statistics timer */
 	TimerInit(&b->statsUpdateTimer, "BundUpdateStats", 
 	    BUND_STATS_UPDATE_INTERVAL, BundUpdateStatsTimer, b);
+	TimerSetSlack(&b->statsUpdateTimer, gTimerSlack);
 	TimerStartRecurring(&b->statsUpdateTimer);
 #endif
     }
@@ -439,13 +479,16 @@ BundLeave(Link l)
 #endif
 
 	authparamsDestroy(&b->params);
+	BundIndexUser(b);
+	BundIndexMp(b);
 
+	StrIndexDel(gBundMSessions, b->msession_id);
 	b->msession_id[0] = 0;
  
 	/* try to open again later */
 	if (b->open && Enabled(&b->conf.options, BUND_CONF_BWMANAGE) &&
 	  !Enabled(&b->iface.options, IFACE_CONF_ONDEMAND) && !gShutdownInProgress) {
-	    if (b->n_links != 0 || b->conf.linkst[0][0]) {
+	    if (b->n_links != 0 || BUND_LINKST(b, 0)[0]) {
 		/* wait BUND_REOPEN_DELAY to see if it comes back up */
     	        int delay = BUND_REOPEN_DELAY;
     		delay += ((random() ^ gPid ^ time(NULL)) & 1);
@@ -462,6 +505,7 @@ BundLeave(Link l)
 	    }
 	}
 	b->open = FALSE;
+	BundIndexUser(b);
 	if (!b->stay)
 	    BundShutdown(b);
     }
@@ -507,11 +551,13 @@ BundMsg(int type, void *arg)
     switch (type) {
     case MSG_OPEN:
         b->open = TRUE;
+	BundIndexUser(b);
 	BundOpenLinks(b);
         break;
 
     case MSG_CLOSE:
         b->open = FALSE;
+	BundIndexUser(b);
         BundCloseLinks(b);
         break;
 
@@ -541,7 +587,7 @@ BundOpenLinks(Bund b)
 	    if (b->links[k]) {
     		BundOpenLink(b->links[k]);
 		break;
-	    } else if (b->conf.linkst[k][0]) {
+	    } else if (BUND_LINKST(b, k)[0]) {
 		BundCreateOpenLink(b, k);
 		break;
 	    }
@@ -550,7 +596,7 @@ BundOpenLinks(Bund b)
 	for (k = 0; k < NG_PPP_MAX_LINKS; k++) {
 	    if (b->links[k])
     		BundOpenLink(b->links[k]);
-	    else if (b->conf.linkst[k][0])
+	    else if (BUND_LINKST(b, k)[0])
 		BundCreateOpenLink(b, k);
 	}
     }
@@ -564,15 +610,15 @@ int
 BundCreateOpenLink(Bund b, int n)
 {
     if (!b->links[n]) {
-	if (b->conf.linkst[n][0]) {
+	if (BUND_LINKST(b, n)[0]) {
 	    Link l;
-	    Link lt = LinkFind(b->conf.linkst[n]);
+	    Link lt = LinkFind(BUND_LINKST(b, n));
 	    if (!lt) {
-		Log(LG_BUND, ("[%s] Bund: Link \"%s\" not found", b->name, b->conf.linkst[n]));
+		Log(LG_BUND, ("[%s] Bund: Link \"%s\" not found", b->name, BUND_LINKST(b, n)));
 		return (-1);
 	    }
 	    if (PhysIsBusy(lt)) {
-		Log(LG_BUND, ("[%s] Bund: Link \"%s\" is busy", b->name, b->conf.linkst[n]));
+		Log(LG_BUND, ("[%s] Bund: Link \"%s\" is busy", b->name, BUND_LINKST(b, n)));
 		return (-1);
 	    }
 	    if (lt->tmpl) {
@@ -580,7 +626,7 @@ BundCreateOpenLink(Bund b, int n)
 	    } else
 		l = lt;
 	    if (!l) {
-		Log(LG_BUND, ("[%s] Bund: Link \"%s\" creation error", b->name, b->conf.linkst[n]));
+		Log(LG_BUND, ("[%s] Bund: Link \"%s\" creation error", b->name, BUND_LINKST(b, n)));
 		return (-1);
 	    }
 	    b->links[n] = l;
@@ -853,13 +899,11 @@ BundNcpsClose(Bund b)
 static void
 BundReasses(Bund b)
 {
-  BundBm	const bm = &b->bm;
-
   /* Update system interface parameters */
   BundUpdateParams(b);
 
   Log(LG_BUND, ("[%s] Bundle: Status update: up %d link%s, total bandwidth %d bps",
-    b->name, b->n_up, b->n_up == 1 ? "" : "s", bm->total_bw));
+    b->name, b->n_up, b->n_up == 1 ? "" : "s", b->total_bw));
 
 }
 
@@ -872,19 +916,18 @@ BundReasses(Bund b)
 void
 BundUpdateParams(Bund b)
 {
-  BundBm	const bm = &b->bm;
   int		k, mtu, the_link = 0;
 
     /* Recalculate how much bandwidth we have */
-    bm->total_bw = 0;
+    b->total_bw = 0;
     for (k = 0; k < NG_PPP_MAX_LINKS; k++) {
 	if (b->links[k] && b->links[k]->lcp.phase == PHASE_NETWORK) {
-    	    bm->total_bw += b->links[k]->bandwidth;
+    	    b->total_bw += b->links[k]->bandwidth;
     	    the_link = k;
 	}
     }
-    if (bm->total_bw < BUND_MIN_TOT_BW)
-	bm->total_bw = BUND_MIN_TOT_BW;
+    if (b->total_bw < BUND_MIN_TOT_BW)
+	b->total_bw = BUND_MIN_TOT_BW;
 
     /* Recalculate MTU corresponding to peer's MRU */
     if (b->n_up == 0) {
@@ -966,6 +1009,7 @@ BundCommand(Context ctx, int ac, const char *const av[], const void *arg)
 int
 MSessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
+    Bund	b;
     int		k;
 
     (void)arg;
@@ -983,11 +1027,7 @@ MSessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Find bundle */
-    for (k = 0;
-	k < gNumBundles && (gBundles[k] == NULL || 
-	    strcmp(gBundles[k]->msession_id, av[0]));
-	k++);
-    if (k == gNumBundles) {
+    if ((b = BundFindMSession(av[0], 0)) == NULL) {
 	/* Change default link and bundle */
 	RESETREF(ctx->lnk, NULL);
 	RESETREF(ctx->bund, NULL);
@@ -996,7 +1036,7 @@ MSessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Change default link and bundle */
-    RESETREF(ctx->bund, gBundles[k]);
+    RESETREF(ctx->bund, b);
     if (ctx->lnk == NULL || ctx->lnk->bund != ctx->bund) {
         RESETREF(ctx->lnk, ctx->bund->links[0]);
     }
@@ -1012,6 +1052,7 @@ MSessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
 int
 IfaceCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
+    Bund	b;
     int		k;
 
     (void)arg;
@@ -1029,11 +1070,7 @@ IfaceCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Find bundle */
-    for (k = 0;
-	k < gNumBundles && (gBundles[k] == NULL || 
-	    strcmp(gBundles[k]->iface.ifname, av[0]));
-	k++);
-    if (k == gNumBundles) {
+    if ((b = BundFindIface(av[0], 0)) == NULL) {
 	/* Change default link and bundle */
 	RESETREF(ctx->lnk, NULL);
 	RESETREF(ctx->bund, NULL);
@@ -1042,7 +1079,7 @@ IfaceCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Change default link and bundle */
-    RESETREF(ctx->bund, gBundles[k]);
+    RESETREF(ctx->bund, b);
     if (ctx->lnk == NULL || ctx->lnk->bund != ctx->bund) {
         RESETREF(ctx->lnk, ctx->bund->links[0]);
     }
@@ -1104,14 +1141,15 @@ BundCreate(Context ctx, int ac, const char *const av[], const void *arg)
 	strlcpy(b->name, av[0 + stay], sizeof(b->name));
 	b->tmpl = tmpl;
 	b->stay = stay;
+	b->parent = -1;
 
 	/* Add bundle to the list of bundles and make it the current active bundle */
-	for (k = 0; k < gNumBundles && gBundles[k] != NULL; k++);
-	if (k == gNumBundles)			/* add a new bundle pointer */
-	    LengthenArray(&gBundles, sizeof(*gBundles), &gNumBundles, MB_BUND);
+	k = SlotAlloc(&gBundSlots, &gBundles, sizeof(*gBundles), &gNumBundles,
+	    MB_BUND);
 
 	b->id = k;
 	gBundles[k] = b;
+	StrIndexAdd(gBundNames, b->name);
 	REF(b);
 
 	/* Get message channel */
@@ -1144,7 +1182,10 @@ BundCreate(Context ctx, int ac, const char *const av[], const void *arg)
 	    /* Setup netgraph stuff */
 	    if (BundNgInit(b) < 0) {
 		gBundles[b->id] = NULL;
+		SlotFree(&gBundSlots, b->id);
+		StrIndexDel(gBundNames, b->name);
 		IfaceDestroy(b);
+		BundFreeState(b);
 		Freee(b);
 		Error("Bundle netgraph initialization failed");
 	    }
@@ -1211,12 +1252,19 @@ BundInst(Bund bt, const char *name, int tmpl, int stay)
     b = Mdup(MB_BUND, bt, sizeof(*b));
     b->tmpl = tmpl;
     b->stay = stay;
+    b->parent = bt->id;
+    b->children = 0;
     b->refs = 0;
+    b->bm = NULL;
+    b->user = NULL;
+    b->mp = NULL;
+    if (bt->conf.linkst != NULL)
+	b->conf.linkst = Mdup(MB_BUND, bt->conf.linkst,
+	    NG_PPP_MAX_LINKS * sizeof(*bt->conf.linkst));
 
     /* Add bundle to the list of bundles and make it the current active bundle */
-    for (k = 0; k < gNumBundles && gBundles[k] != NULL; k++);
-    if (k == gNumBundles)			/* add a new bundle pointer */
-	LengthenArray(&gBundles, sizeof(*gBundles), &gNumBundles, MB_BUND);
+    k = SlotAlloc(&gBundSlots, &gBundles, sizeof(*gBundles), &gNumBundles,
+	MB_BUND);
 
     b->id = k;
     if (name)
@@ -1224,7 +1272,9 @@ BundInst(Bund bt, const char *name, int tmpl, int stay)
     else
 	snprintf(b->name, sizeof(b->name), "%s-%d", bt->name, k);
     gBundles[k] = b;
+    StrIndexAdd(gBundNames, b->name);
     REF(b);
+    bt->children++;
 
     /* Inst iface and NCP's */
     IfaceInst(b, bt);
@@ -1238,6 +1288,10 @@ BundInst(Bund bt, const char *name, int tmpl, int stay)
 	if (BundNgInit(b) < 0) {
 	    Log(LG_ERR, ("[%s] Bundle netgraph initialization failed", b->name));
 	    gBundles[b->id] = NULL;
+	    SlotFree(&gBundSlots, b->id);
+	    StrIndexDel(gBundNames, b->name);
+	    bt->children--;
+	    BundFreeState(b);
 	    Freee(b);
 	    return(0);
 	}
@@ -1273,12 +1327,48 @@ BundShutdown(Bund b)
     if (b->hook[0])
 	BundNgShutdown(b, 1, 1);
     gBundles[b->id] = NULL;
+    SlotFree(&gBundSlots, b->id);
+    StrIndexDel(gBundNames, b->name);
+    StrIndexDel(gBundMSessions, b->msession_id);
+    BundIndexIface(b, 0);
+    BundIndexPeer(b, 0);
+    /* Our parent lost one children */
+    if (b->parent >= 0)
+	gBundles[b->parent]->children--;
+    /* Our children are orphans */
+    if (b->children) {
+	for (k = 0; k < gNumBundles; k++) {
+	    if (gBundles[k] && gBundles[k]->parent == b->id)
+		gBundles[k]->parent = -1;
+	}
+    }
     MsgUnRegister(&b->msgs);
     b->dead = 1;
+    BundIndexUser(b);
+    BundIndexMp(b);
     IfaceDestroy(b);
+    BundFreeState(b);
     UNREF(b);
 }
 
+/*
+ * BundFreeState()
+ *
+ * Free the parts of a bundle that are allocated on demand
+ */
+
+static void
+BundFreeState(Bund b)
+{
+    BundBmStop(b);
+    Freee(b->bm);
+    b->bm = NULL;
+    Freee(b->conf.linkst);
+    b->conf.linkst = NULL;
+    CcpShutdown(b);
+    EcpShutdown(b);
+}
+
 /*
  * BundStat()
  *
@@ -1346,7 +1436,7 @@ BundStat(Context ctx, int ac, const char *const av[], const void *arg)
   Printf("\t  Min disc     : %d seconds\r\n", sb->conf.bm_Md);
   Printf("\t  Links        : ");
   for (k = 0; k < NG_PPP_MAX_LINKS; k++)
-    Printf("%s ", sb->conf.linkst[k]);
+    Printf("%s ", BUND_LINKST(sb, k));
   Printf("\r\n");
   Printf("Bundle level options:\r\n");
   OptStat(ctx, &sb->conf.options, gConfList);
@@ -1446,6 +1536,67 @@ BundResetStats(Bund b)
 #endif
 }
 
+/*
+ * BundMemStat()
+ *
+ * Memory taken by links and bundles, including the parts of bundles
+ * that are allocated on demand. Templates are not counted.
+ */
+
+int
+BundMemStat(Context ctx)
+{
+    Bund	b;
+    Link	l;
+    u_int	nlinks = 0, nbunds = 0, nbm = 0, nccp = 0, necp = 0, nlst = 0;
+    u_long	total;
+    int		k;
+
+    for (k = 0; k < gNumLinks; k++) {
+	if ((l = gLinks[k]) != NULL && !l->tmpl)
+	    nlinks++;
+    }
+    for (k = 0; k < gNumBundles; k++) {
+	if ((b = gBundles[k]) == NULL || b->tmpl)
+	    continue;
+	nbunds++;
+	if (b->bm)
+	    nbm++;
+	if (b->ccp)
+	    nccp++;
+	if (b->ecp)
+	    necp++;
+	if (b->conf.linkst)
+	    nlst++;
+    }
+    total = nlinks * sizeof(struct linkst) + nbunds * sizeof(struct bundle) +
+	nbm * sizeof(struct bundbm) + nccp * sizeof(struct ccpstate) +
+	necp * sizeof(struct ecpstate) +
+	nlst * NG_PPP_MAX_LINKS * LINK_MAX_NAME;
+
+    Printf("   %-28s %10s %10s %10s\r\n", "Per-session", "Count", "Size", "Total");
+    Printf("   %-28s %10s %10s %10s\r\n", "-----------", "-----", "----", "-----");
+    Printf("   %-28s %10u %10zu %10lu\r\n", "Link", nlinks,
+	sizeof(struct linkst), (u_long)(nlinks * sizeof(struct linkst)));
+    Printf("   %-28s %10u %10zu %10lu\r\n", "Bundle", nbunds,
+	sizeof(struct bundle), (u_long)(nbunds * sizeof(struct bundle)));
+    Printf("   %-28s %10u %10zu %10lu\r\n", "Bandwidth management", nbm,
+	sizeof(struct bundbm), (u_long)(nbm * sizeof(struct bundbm)));
+    Printf("   %-28s %10u %10zu %10lu\r\n", "CCP state", nccp,
+	sizeof(struct ccpstate), (u_long)(nccp * sizeof(struct ccpstate)));
+    Printf("   %-28s %10u %10zu %10lu\r\n", "ECP state", necp,
+	sizeof(struct ecpstate), (u_long)(necp * sizeof(struct ecpstate)));
+    Printf("   %-28s %10u %10zu %10lu\r\n", "Link names", nlst,
+	(size_t)(NG_PPP_MAX_LINKS * LINK_MAX_NAME),
+	(u_long)(nlst * NG_PPP_MAX_LINKS * LINK_MAX_NAME));
+    Printf("   %-28s %10s %10s %10s\r\n", "", "", "", "-----");
+    Printf("   %-28s %10s %10s %10lu\r\n", "Totals", "", "", total);
+    if (nbunds > 0)
+	Printf("   %-28s %10s %10s %10lu\r\n", "Per bundle", "", "",
+	    total / nbunds);
+    return (0);
+}
+
 /*
  * BundShowLinks()
  */
@@ -1474,12 +1625,310 @@ BundShowLinks(Context ctx, Bund sb)
 Bund
 BundFind(const char *name)
 {
-  int	k;
+  return (BundFindName(name, 0));
+}
+
+/*
+ * BundFindName()
+ * BundFindMSession()
+ * BundFindIface()
+ * BundFindPeer()
+ *
+ * The n-th bundle with a key, counting from zero in the order they
+ * got it, or NULL. Most keys have a single bundle.
+ */
+
+Bund
+BundFindName(const char *name, int n)
+{
+  char	*item;
+
+  if ((item = KeyIndexGet(gBundNames, name, n)) == NULL)
+    return (NULL);
+  return (INDEX_ITEM(item, struct bundle, name));
+}
+
+Bund
+BundFindMSession(const char *msession_id, int n)
+{
+  char	*item;
+
+  if ((item = KeyIndexGet(gBundMSessions, msession_id, n)) == NULL)
+    return (NULL);
+  return (INDEX_ITEM(item, struct bundle, msession_id));
+}
+
+Bund
+BundFindIface(const char *ifname, int n)
+{
+  char	*item;
+
+  if ((item = KeyIndexGet(gBundIfaces, ifname, n)) == NULL)
+    return (NULL);
+  return (INDEX_ITEM(item, struct bundle, iface.ifname));
+}
+
+Bund
+BundFindPeer(const struct u_addr *addr, int n)
+{
+  struct u_addr	*item;
+
+  if ((item = KeyIndexGet(gBundPeers, addr, n)) == NULL)
+    return (NULL);
+  return (INDEX_ITEM(item, struct bundle, iface.peer_addr));
+}
+
+/*
+ * BundIndexIface()
+ * BundIndexPeer()
+ *
+ * Add a bundle to, or remove it from, the index of interface names
+ * or peer addresses. Must be removed before the key changes.
+ */
+
+void
+BundIndexIface(Bund b, int on)
+{
+  if (on)
+    StrIndexAdd(gBundIfaces, b->iface.ifname);
+  else
+    StrIndexDel(gBundIfaces, b->iface.ifname);
+}
+
+void
+BundIndexPeer(Bund b, int on)
+{
+  struct u_addr	*const addr = &b->iface.peer_addr;
+
+  if (b->tmpl || u_addrempty(addr))
+    return;
+  if (on)
+    KeyIndexAdd(gBundPeers, addr);
+  else
+    KeyIndexDel(gBundPeers, addr);
+}
+
+/*
+ * BundIndexUser()
+ *
+ * Keep a bundle in the login table while it is open with an auth
+ * name. Call after either changes.
+ */
 
-  for (k = 0;
-    k < gNumBundles && (!gBundles[k] || strcmp(gBundles[k]->name, name));
-    k++);
-  return((k < gNumBundles) ? gBundles[k] : NULL);
+void
+BundIndexUser(Bund b)
+{
+  const char		*authname = b->params.authname;
+  struct bunduser	*u = b->user;
+  const int		want = b->open && !b->tmpl && !b->dead && authname[0];
+
+  if (u != NULL && (!want || strcasecmp(u->name, authname) != 0)) {
+    LIST_REMOVE(b, userlist);
+    b->user = NULL;
+    if (--u->n == 0) {
+      StrIndexDel(gBundUsers, u->name);
+      Freee(u);
+    }
+  }
+  if (!want || b->user != NULL)
+    return;
+  if ((u = StrIndexGet(gBundUsers, authname)) == NULL) {
+    u = Malloc(MB_BUND, sizeof(*u));
+    strlcpy(u->name, authname, sizeof(u->name));
+    LIST_INIT(&u->bunds);
+    StrIndexAdd(gBundUsers, u->name);
+  }
+  LIST_INSERT_HEAD(&u->bunds, b, userlist);
+  u->n++;
+  b->user = u;
+}
+
+/*
+ * BundIndexMp()
+ *
+ * Keep a multilink bundle in the table used to find the bundle a new
+ * link joins. Call after its MRRU, discriminator or auth name change.
+ */
+
+void
+BundIndexMp(Bund b)
+{
+  struct bundmp		*m = b->mp;
+  const int		want = b->peer_mrru && !b->tmpl && !b->dead;
+
+  if (m != NULL && (!want || strcmp(m->authname, b->params.authname) != 0
+      || m->discrim.len != b->peer_discrim.len
+      || memcmp(m->discrim.bytes, b->peer_discrim.bytes, m->discrim.len))) {
+    LIST_REMOVE(b, mplist);
+    b->mp = NULL;
+    if (LIST_EMPTY(&m->bunds)) {
+      ghash_remove(gBundMps, m);
+      Freee(m);
+    }
+  }
+  if (!want || b->mp != NULL)
+    return;
+  if ((m = BundFindMpEntry(&b->peer_discrim, b->params.authname)) == NULL) {
+    m = Malloc(MB_BUND, sizeof(*m));
+    strlcpy(m->authname, b->params.authname, sizeof(m->authname));
+    m->discrim = b->peer_discrim;
+    LIST_INIT(&m->bunds);
+    if (ghash_put(gBundMps, m) == -1) {
+      Perror("[%s] BundIndexMp: ghash_put", b->name);
+      DoExit(EX_ERRDEAD);
+    }
+  }
+  LIST_INSERT_HEAD(&m->bunds, b, mplist);
+  b->mp = m;
+}
+
+/*
+ * BundCountLogins()
+ *
+ * Number of open bundles authenticated with a name
+ */
+
+u_int
+BundCountLogins(const char *authname, int ci)
+{
+  struct bunduser	*u;
+  Bund			b;
+  u_int			n = 0;
+
+  if ((u = StrIndexGet(gBundUsers, authname)) == NULL)
+    return (0);
+  if (ci)
+    return (u->n);
+  LIST_FOREACH(b, &u->bunds, userlist) {
+    if (strcmp(b->params.authname, authname) == 0)
+      n++;
+  }
+  return (n);
+}
+
+/*
+ * BundLoginsStat()
+ * BundLoginsJSON()
+ *
+ * Show the login table, names compared ignoring case
+ */
+
+int
+BundLoginsStat(Context ctx, int ac, const char *const av[], const void *arg)
+{
+  struct ghash_walk	walk;
+  struct bunduser	*u;
+  Bund			b;
+
+  (void)ac;
+  (void)av;
+  (void)arg;
+
+  Printf("Logins\tUser\tBundles\r\n");
+  ghash_walk_init(gBundUsers->items, &walk);
+  while ((u = ghash_walk_next(gBundUsers->items, &walk)) != NULL) {
+    Printf("%u\t%s\t", u->n, u->name);
+    LIST_FOREACH(b, &u->bunds, userlist)
+      Printf(" %s", b->name);
+    Printf("\r\n");
+  }
+  Printf("Total: %u users\r\n", ghash_size(gBundUsers->items));
+  return (0);
+}
+
+void
+BundLoginsJSON(FILE *f)
+{
+  struct ghash_walk	walk;
+  struct bunduser	*u;
+  Bund			b;
+  int			first = 1, firstb;
+
+  fprintf(f, "{\"users\":[\n");
+  ghash_walk_init(gBundUsers->items, &walk);
+  while ((u = ghash_walk_next(gBundUsers->items, &walk)) != NULL) {
+    fprintf(f, "%s{\"user\": \"%s\", \"logins\": %u, \"bundles\": [",
+      first ? "" : ",\n", u->name, u->n);
+    firstb = 1;
+    LIST_FOREACH(b, &u->bunds, userlist) {
+      fprintf(f, "%s\"%s\"", firstb ? "" : ", ", b->name);
+      firstb = 0;
+    }
+    fprintf(f, "]}");
+    first = 0;
+  }
+  fprintf(f, "\n]}\n");
+}
+
+static u_int32_t
+BundPeerHash(struct ghash *g, const void *item)
+{
+  (void)g;
+  return (u_addrtoid(item));
+}
+
+static int
+BundPeerEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  (void)g;
+  return (u_addrcompare(item1, item2) == 0);
+}
+
+/*
+ * BundFindMpEntry()
+ * BundFindMp()
+ *
+ * Find a multilink bundle a link with this peer discriminator and
+ * auth name should join. Discriminators must have the same length.
+ */
+
+static struct bundmp *
+BundFindMpEntry(Discrim discrim, const char *authname)
+{
+  struct bundmp		key;
+
+  strlcpy(key.authname, authname, sizeof(key.authname));
+  key.discrim.len = discrim->len;
+  memcpy(key.discrim.bytes, discrim->bytes, discrim->len);
+  return (ghash_get(gBundMps, &key));
+}
+
+static Bund
+BundFindMp(Discrim discrim, const char *authname)
+{
+  struct bundmp		*m;
+
+  if ((m = BundFindMpEntry(discrim, authname)) == NULL)
+    return (NULL);
+  return (LIST_FIRST(&m->bunds));
+}
+
+static u_int32_t
+BundMpHash(struct ghash *g, const void *item)
+{
+  const struct bundmp	*const m = item;
+  const u_char		*p;
+  u_int32_t		h = 0;
+  int			k;
+
+  (void)g;
+  for (p = (const u_char *)m->authname; *p; p++)
+    h = h * 31 + *p;
+  for (k = 0; k < m->discrim.len; k++)
+    h = h * 31 + m->discrim.bytes[k];
+  return (h);
+}
+
+static int
+BundMpEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  const struct bundmp	*const m1 = item1;
+  const struct bundmp	*const m2 = item2;
+
+  (void)g;
+  return (m1->discrim.len == m2->discrim.len
+    && memcmp(m1->discrim.bytes, m2->discrim.bytes, m1->discrim.len) == 0
+    && strcmp(m1->authname, m2->authname) == 0);
 }
 
 /*
@@ -1493,10 +1942,20 @@ BundBmStart(Bund b)
 {
     int	k;
 
+    BundBmStop(b);
+    if (!Enabled(&b->conf.options, BUND_CONF_BWMANAGE))
+	return;
+
+    /* Only bundles doing bandwidth management need its state */
+    if (b->bm == NULL) {
+	b->bm = Malloc(MB_BUND, sizeof(*b->bm));
+	memset(b->bm, 0, sizeof(*b->bm));
+    }
+
     /* Reset bandwidth management stats */
-    memset(&b->bm.traffic, 0, sizeof(b->bm.traffic));
-    memset(&b->bm.avail, 0, sizeof(b->bm.avail));
-    memset(&b->bm.wasUp, 0, sizeof(b->bm.wasUp));
+    memset(&b->bm->traffic, 0, sizeof(b->bm->traffic));
+    memset(&b->bm->avail, 0, sizeof(b->bm->avail));
+    memset(&b->bm->wasUp, 0, sizeof(b->bm->wasUp));
     for (k = 0; k < NG_PPP_MAX_LINKS; k++) {
 	if (b->links[k]) {
 	    memset(&b->links[k]->bm.idleStats,
@@ -1505,13 +1964,11 @@ BundBmStart(Bund b)
     }
 
   /* Start bandwidth management timer */
-  TimerStop(&b->bm.bmTimer);
-  if (Enabled(&b->conf.options, BUND_CONF_BWMANAGE)) {
-    TimerInit(&b->bm.bmTimer, "BundBm",
+    TimerInit(&b->bm->bmTimer, "BundBm",
       (b->conf.bm_S * SECONDS) / BUND_BM_N,
       BundBmTimeout, b);
-    TimerStart(&b->bm.bmTimer);
-  }
+    TimerSetSlack(&b->bm->bmTimer, gTimerSlack);
+    TimerStart(&b->bm->bmTimer);
 }
 
 /*
@@ -1521,7 +1978,8 @@ BundBmStart(Bund b)
 static void
 BundBmStop(Bund b)
 {
-  TimerStop(&b->bm.bmTimer);
+  if (b->bm != NULL)
+    TimerStop(&b->bm->bmTimer);
 }
 
 /*
@@ -1544,20 +2002,20 @@ BundBmTimeout(void *arg)
     int			j, k;
 
     /* Shift and update stats */
-    memmove(&b->bm.wasUp[1], &b->bm.wasUp[0],
-	(BUND_BM_N - 1) * sizeof(b->bm.wasUp[0]));
-    b->bm.wasUp[0] = b->n_up;
-    memmove(&b->bm.avail[1], &b->bm.avail[0],
-	(BUND_BM_N - 1) * sizeof(b->bm.avail[0]));
-    b->bm.avail[0] = b->bm.total_bw;
+    memmove(&b->bm->wasUp[1], &b->bm->wasUp[0],
+	(BUND_BM_N - 1) * sizeof(b->bm->wasUp[0]));
+    b->bm->wasUp[0] = b->n_up;
+    memmove(&b->bm->avail[1], &b->bm->avail[0],
+	(BUND_BM_N - 1) * sizeof(b->bm->avail[0]));
+    b->bm->avail[0] = b->total_bw;
 
     /* Shift stats */
-    memmove(&b->bm.traffic[0][1], &b->bm.traffic[0][0],
-	(BUND_BM_N - 1) * sizeof(b->bm.traffic[0][0]));
-    memmove(&b->bm.traffic[1][1], &b->bm.traffic[1][0],
-	(BUND_BM_N - 1) * sizeof(b->bm.traffic[1][0]));
-    b->bm.traffic[0][0] = 0;
-    b->bm.traffic[1][0] = 0;
+    memmove(&b->bm->traffic[0][1], &b->bm->traffic[0][0],
+	(BUND_BM_N - 1) * sizeof(b->bm->traffic[0][0]));
+    memmove(&b->bm->traffic[1][1], &b->bm->traffic[1][0],
+	(BUND_BM_N - 1) * sizeof(b->bm->traffic[1][0]));
+    b->bm->traffic[0][0] = 0;
+    b->bm->traffic[1][0] = 0;
     for (k = 0; k < NG_PPP_MAX_LINKS; k++) {
 	if (b->links[k] && b->links[k]->joined_bund) {
 	    Link	const l = b->links[k];
@@ -1575,8 +2033,8 @@ BundBmTimeout(void *arg)
 #else
 	    NgFuncGetStats64(l->bund, l->bundleIndex, &l->bm.idleStats);
 #endif
-	    b->bm.traffic[0][0] += l->bm.idleStats.recvOctets - oldStats.recvOctets;
-	    b->bm.traffic[1][0] += l->bm.idleStats.xmitOctets - oldStats.xmitOctets;
+	    b->bm->traffic[0][0] += l->bm.idleStats.recvOctets - oldStats.recvOctets;
+	    b->bm->traffic[1][0] += l->bm.idleStats.xmitOctets - oldStats.xmitOctets;
 	}
     }
 
@@ -1587,9 +2045,9 @@ BundBmTimeout(void *arg)
     for (j = 0; j < BUND_BM_N; j++) {
 	u_int	avail, inBits, outBits;
 
-	avail = (b->bm.avail[j] * b->conf.bm_S) / BUND_BM_N;
-	inBits = b->bm.traffic[0][j] * 8;
-	outBits = b->bm.traffic[1][j] * 8;
+	avail = (b->bm->avail[j] * b->conf.bm_S) / BUND_BM_N;
+	inBits = b->bm->traffic[0][j] * 8;
+	outBits = b->bm->traffic[1][j] * 8;
 
 	availTotal += avail;
 	inBitsTotal += inBits;
@@ -1614,7 +2072,7 @@ BundBmTimeout(void *arg)
     ins[0] = 0;
     for (j = 0; j < BUND_BM_N; j++) {
 	snprintf(ins + strlen(ins), sizeof(ins) - strlen(ins),
-		" %3u ", b->bm.wasUp[BUND_BM_N - 1 - j]);
+		" %3u ", b->bm->wasUp[BUND_BM_N - 1 - j]);
     }
     Log(LG_BUND2, ("[%s]                       %s", b->name, ins));
 
@@ -1631,17 +2089,17 @@ BundBmTimeout(void *arg)
   }
 
   /* See if it's time to bring up another link */
-  if (now - b->bm.last_open >= b->conf.bm_Mc
+  if (now - b->bm->last_open >= b->conf.bm_Mc
       && (inUtilTotal >= b->conf.bm_Hi || outUtilTotal >= b->conf.bm_Hi)) {
     for (k = 0; k < NG_PPP_MAX_LINKS; k++) {
 cont:
-	if (!b->links[k] && b->conf.linkst[k][0])
+	if (!b->links[k] && BUND_LINKST(b, k)[0])
 		break;
     }
     if (k < NG_PPP_MAX_LINKS) {
 	Log(LG_BUND, ("[%s] opening link \"%s\" due to increased demand",
-    	    b->name, b->conf.linkst[k]));
-	b->bm.last_open = now;
+    	    b->name, BUND_LINKST(b, k)));
+	b->bm->last_open = now;
 	if (b->links[k]) {
 	    RecordLinkUpDownReason(NULL, b->links[k], 1, STR_PORT_NEEDED, NULL);
 	    BundOpenLink(b->links[k]);
@@ -1658,7 +2116,7 @@ cont:
   }
 
   /* See if it's time to bring down a link */
-  if (now - b->bm.last_close >= b->conf.bm_Md
+  if (now - b->bm->last_close >= b->conf.bm_Md
       && (inUtilTotal < b->conf.bm_Lo && outUtilTotal < b->conf.bm_Lo)
       && b->n_links > 1) {
     k = NG_PPP_MAX_LINKS - 1;
@@ -1667,13 +2125,13 @@ cont:
     assert(k >= 0);
     Log(LG_BUND, ("[%s] Bundle: closing link %s due to reduced demand",
       b->name, b->links[k]->name));
-    b->bm.last_close = now;
+    b->bm->last_close = now;
     RecordLinkUpDownReason(NULL, b->links[k], 0, STR_PORT_UNNEEDED, NULL);
     BundCloseLink(b->links[k]);
   }
 
   /* Restart timer */
-  TimerStart(&b->bm.bmTimer);
+  TimerStart(&b->bm->bmTimer);
 }
 
 /*
@@ -1706,6 +2164,7 @@ BundNgInit(Bund b)
     strlcpy(b->iface.ngname, b->iface.ifname, sizeof(b->iface.ngname));
     newIface = 1;
     b->iface.ifindex = if_nametoindex(b->iface.ifname);
+    BundIndexIface(b, 1);
     Log(LG_BUND|LG_IFACE, ("[%s] Bundle: Interface %s created",
 	b->name, b->iface.ifname));
 
@@ -1757,6 +2216,7 @@ BundNgShutdown(Bund b, int iface, int ppp)
     char	path[NG_PATHSIZ];
 
     if (iface) {
+	BundIndexIface(b, 0);
 	snprintf(path, sizeof(path), "%s:", b->iface.ngname);
 	NgFuncShutdownNode(gLinksCsock, b->name, path);
     }
@@ -1798,6 +2258,9 @@ BundSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
 	case SET_LINKS:
 	    if (ac > NG_PPP_MAX_LINKS)
 		return (-1);
+	    if (b->conf.linkst == NULL)
+		b->conf.linkst = Malloc(MB_BUND,
+		    NG_PPP_MAX_LINKS * sizeof(*b->conf.linkst));
     	    for (i = 0; i < ac; i++)
 		strlcpy(b->conf.linkst[i], av[i], LINK_MAX_NAME);
     	    for (; i < NG_PPP_MAX_LINKS; i++)
@@ -1839,6 +2302,12 @@ BundSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
 	default:
     	    assert(0);
     }
+
+    /* Instances may have been created without CCP or ECP state */
+    if (Enabled(&b->conf.options, BUND_CONF_COMPRESSION))
+	CcpGet(b);
+    if (Enabled(&b->conf.options, BUND_CONF_ENCRYPTION))
+	EcpGet(b);
     return(0);
 }
 
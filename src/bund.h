@@ -97,7 +97,6 @@
     time_t		last_open;	/* Time we last open any link */
     time_t		last_close;	/* Time we last closed any link */
     struct pppTimer	bmTimer;	/* Bandwidth mgmt timer */
-    u_int		total_bw;	/* Total bandwidth available */
   };
   typedef struct bundbm	*BundBm;
 
@@ -110,11 +109,33 @@
     u_short		bm_Mc;
     u_short		bm_Md;
     struct optinfo	options;		/* Configured options */
-    char		linkst[NG_PPP_MAX_LINKS][LINK_MAX_NAME]; /* Link names for DoD */
+    char		(*linkst)[LINK_MAX_NAME]; /* Link names for DoD, or NULL */
   };
 
+  /* Name of link "k" to open for a bundle, empty if none */
+  #define BUND_LINKST(b, k)	((b)->conf.linkst != NULL ? \
+				    (const char *)(b)->conf.linkst[k] : "")
+
   #define BUND_STATS_UPDATE_INTERVAL    65 * SECONDS
 
+  /* FSM state of NCPs whose state may not be allocated */
+  #define BUND_CCP_STATE(b)	((b)->ccp ? (b)->ccp->fsm.state : ST_INITIAL)
+  #define BUND_ECP_STATE(b)	((b)->ecp ? (b)->ecp->fsm.state : ST_INITIAL)
+
+  /* Open bundles authenticated with one name, ignoring case */
+  struct bunduser {
+    char		name[AUTH_MAX_AUTHNAME];	/* must be first */
+    u_int		n;			/* Number of bundles */
+    LIST_HEAD(, bundle)	bunds;
+  };
+
+  /* Multilink bundles with one peer discriminator and auth name */
+  struct bundmp {
+    char		authname[AUTH_MAX_AUTHNAME];
+    struct discrim	discrim;
+    LIST_HEAD(, bundle)	bunds;
+  };
+
   /* Total state of a bundle */
   struct bundle {
     char		name[LINK_MAX_NAME];	/* Name of this bundle */
@@ -122,12 +143,15 @@
     u_char		tmpl;			/* This is template, not an instance */
     u_char		stay;			/* Must not disappear */
     u_char		dead;			/* Dead flag */
+    /* Inline: instances go away with their last link, so it is always used */
     Link		links[NG_PPP_MAX_LINKS];	/* Real links in this bundle */
     u_short		n_links;		/* Number of links in bundle */
     u_short		n_up;			/* Number of links joined the bundle */
     ng_ID_t		nodeID;			/* ID of ppp node */
     char		hook[NG_HOOKSIZ];	/* session hook name */
     MsgHandler		msgs;			/* Bundle events */
+    int			parent;			/* Index of the parent in gBundles */
+    int			children;		/* Number of children */
     int			refs;			/* Number of references */
 
     /* PPP node config */
@@ -135,9 +159,13 @@
 
     /* Data chunks */
     char		msession_id[AUTH_MAX_SESSIONID]; /* a uniq session-id */    
+    struct bunduser	*user;		/* Login table entry while open */
+    LIST_ENTRY(bundle)	userlist;	/* Open bundles with the same name */
     u_int16_t		peer_mrru;	/* MRRU set by peer, or zero */
     struct discrim	peer_discrim;	/* Peer's discriminator */
-    struct bundbm	bm;		/* Bandwidth management state */
+    struct bundmp	*mp;		/* Multilink table entry */
+    LIST_ENTRY(bundle)	mplist;		/* Bundles with the same entry */
+    u_int		total_bw;	/* Total bandwidth available */
     struct bundconf	conf;		/* Configuration for this bundle */
     struct ng_ppp_link_stat64	stats;	/* Statistics for this bundle */
 #ifndef NG_PPP_STATS64
@@ -148,12 +176,14 @@
     struct ifacestate	iface;		/* IP state info */
     struct ipcpstate	ipcp;		/* IPCP state info */
     struct ipv6cpstate	ipv6cp;		/* IPV6CP state info */
-    struct ccpstate	ccp;		/* CCP state info */
-    struct ecpstate	ecp;		/* ECP state info */
+
+    /* Rarely used, allocated on demand */
+    BundBm		bm;		/* Bandwidth management state */
+    CcpState		ccp;		/* CCP state info */
+    EcpState		ecp;		/* ECP state info */
     u_int		ncpstarted;	/* Bitmask of active NCPs wich is sufficient to keep bundle open */
 
     /* Link management stuff */
-    struct pppTimer	bmTimer;		/* Bandwidth mgmt timer */
     struct pppTimer	reOpenTimer;		/* Re-open timer */
 
     /* Boolean variables */
@@ -174,6 +204,7 @@
  * FUNCTIONS
  */
 
+  extern int	BundsInit(void);
   extern void	BundOpen(Bund b);
   extern void	BundClose(Bund b);
   extern int	BundOpenCmd(Context ctx);
@@ -187,6 +218,17 @@
   extern int	BundDestroy(Context ctx, int ac, const char *const av[], const void *arg);
   extern Bund	BundInst(Bund bt, const char *name, int tmpl, int stay);
   extern Bund	BundFind(const char *name);
+  extern Bund	BundFindName(const char *name, int n);
+  extern Bund	BundFindMSession(const char *msession_id, int n);
+  extern Bund	BundFindIface(const char *ifname, int n);
+  extern Bund	BundFindPeer(const struct u_addr *addr, int n);
+  extern void	BundIndexIface(Bund b, int on);
+  extern void	BundIndexPeer(Bund b, int on);
+  extern void	BundIndexUser(Bund b);
+  extern void	BundIndexMp(Bund b);
+  extern u_int	BundCountLogins(const char *authname, int ci);
+  extern int	BundLoginsStat(Context ctx, int ac, const char *const av[], const void *arg);
+  extern void	BundLoginsJSON(FILE *f);
   extern void	BundShutdown(Bund b);
   extern void   BundUpdateStats(Bund b);
   extern void	BundUpdateStatsTimer(void *cookie);
@@ -207,6 +249,7 @@
   extern void	BundNcpsClose(Bund b);
 
   extern void	BundShowLinks(Context ctx, Bund sb);
+  extern int	BundMemStat(Context ctx);
 
 #endif
 
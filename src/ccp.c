@@ -12,6 +12,7 @@
 #include "ccp.h"
 #include "fsm.h"
 #include "ngfunc.h"
+#include "util.h"
 
 #include <netgraph/ng_message.h>
 #include <netgraph/ng_socket.h>
@@ -64,6 +65,9 @@
 
   static void		CcpNgCtrlEvent(int type, void *cookie);
   static void		CcpNgDataEvent(int type, void *cookie);
+  static u_int32_t	CcpNodeHash(struct ghash *g, const void *item);
+  static int		CcpNodeEqual(struct ghash *g, const void *item1,
+			  const void *item2);
 
 /*
  * GLOBAL VARIABLES
@@ -159,12 +163,15 @@ int		gCcpCsock = -1;		/* Socket node control socket */
 int		gCcpDsock = -1;		/* Socket node data socket */
 static EventRef	gCcpCtrlEvent;
 static EventRef	gCcpDataEvent;
+static struct keyindex	*gCcpNodes;	/* CCP states by decompressor node */
 
 int
 CcpsInit(void)
 {
     char	name[NG_NODESIZ];
 
+    gCcpNodes = KeyIndexCreate(MB_COMP, CcpNodeHash, CcpNodeEqual);
+
     /* Create a netgraph socket node */
     snprintf(name, sizeof(name), "mpd%d-cso", gPid);
     if (NgMkSockNode(name, &gCcpCsock, &gCcpDsock) < 0) {
@@ -201,9 +208,10 @@ CcpsShutdown(void)
 void
 CcpInit(Bund b)
 {
-  CcpState	ccp = &b->ccp;
+  CcpState	ccp;
 
   /* Init CCP state for this bundle */
+  ccp = b->ccp = Malloc(MB_COMP, sizeof(*ccp));
   memset(ccp, 0, sizeof(*ccp));
   FsmInit(&ccp->fsm, &gCcpFsmType, b);
   ccp->fsm.conf.maxfailure = CCP_MAXFAILURE;
@@ -233,11 +241,74 @@ CcpInit(Bund b)
 void
 CcpInst(Bund b, Bund bt)
 {
-  CcpState	ccp = &b->ccp;
+  CcpState	ccp;
+
+  /* Instances that can't negotiate CCP don't need its state */
+  if (bt->ccp == NULL ||
+      (!b->tmpl && !Enabled(&b->conf.options, BUND_CONF_COMPRESSION))) {
+    b->ccp = NULL;
+    return;
+  }
 
   /* Init CCP state for this bundle */
-  memcpy(ccp, &bt->ccp, sizeof(*ccp));
-  FsmInst(&ccp->fsm, &bt->ccp.fsm, b);
+  ccp = b->ccp = Mdup(MB_COMP, bt->ccp, sizeof(*ccp));
+  FsmInst(&ccp->fsm, &bt->ccp->fsm, b);
+}
+
+/*
+ * CcpGet()
+ *
+ * CCP state of a bundle, allocated if it had none so far. An instance
+ * gets its template's configuration, as CcpInst() would have given it.
+ */
+
+CcpState
+CcpGet(Bund b)
+{
+  Bund	bt;
+
+  if (b->ccp != NULL)
+    return (b->ccp);
+  if (b->parent >= 0 && (bt = gBundles[b->parent])->ccp != NULL) {
+    b->ccp = Mdup(MB_COMP, bt->ccp, sizeof(*b->ccp));
+    FsmInst(&b->ccp->fsm, &bt->ccp->fsm, b);
+  } else
+    CcpInit(b);
+  return (b->ccp);
+}
+
+/*
+ * CcpShutdown()
+ */
+
+void
+CcpShutdown(Bund b)
+{
+  if (b->ccp == NULL)
+    return;
+  CcpSetDecompNode(b, 0);
+  TimerStop(&b->ccp->fsm.timer);
+  Freee(b->ccp);
+  b->ccp = NULL;
+}
+
+/*
+ * CcpSetDecompNode()
+ *
+ * Set the decompressor node id, indexed to find the bundle of
+ * messages sent by the node. Zero means no node.
+ */
+
+void
+CcpSetDecompNode(Bund b, ng_ID_t id)
+{
+  CcpState	const ccp = b->ccp;
+
+  if (ccp->decomp_node_id != 0)
+    KeyIndexDel(gCcpNodes, &ccp->decomp_node_id);
+  ccp->decomp_node_id = id;
+  if (id != 0)
+    KeyIndexAdd(gCcpNodes, &ccp->decomp_node_id);
 }
 
 /*
@@ -248,7 +319,7 @@ static void
 CcpConfigure(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-    CcpState	const ccp = &b->ccp;
+    CcpState	const ccp = b->ccp;
     unsigned	k;
 
     /* Reset state */
@@ -281,7 +352,7 @@ static void
 CcpUnConfigure(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   unsigned	k;
 
   /* Reset state */
@@ -306,14 +377,15 @@ CcpUnConfigure(Fsm fp)
 void
 CcpNgCtrlEvent(int type, void *cookie)
 {
-    Bund		b = NULL;
+    Bund		b;
     union {
         u_char		buf[2048];
         struct ng_mesg	msg;
     }			u;
     char		raddr[NG_PATHSIZ];
-    int			i, len;
-    ng_ID_t		id;
+    int			len;
+    ng_ID_t		id, *item;
+    int			n;
 
     (void)cookie;
     (void)type;
@@ -330,14 +402,14 @@ CcpNgCtrlEvent(int type, void *cookie)
 	return;
     }
     
-    for (i = 0; i < gNumBundles; i++) {
-	if (gBundles[i] && !gBundles[i]->dead &&
-		gBundles[i]->ccp.decomp_node_id == id) {
-	    b = gBundles[i];
+    if (id == 0)
+	return;
+    for (n = 0; (item = KeyIndexGet(gCcpNodes, &id, n)) != NULL; n++) {
+	b = (Bund)INDEX_ITEM(item, struct ccpstate, decomp_node_id)->fsm.arg;
+	if (!b->dead)
 	    break;
-	}
     }
-    if (!b)
+    if (item == NULL)
 	return;
 
     /* Examine message */
@@ -412,17 +484,24 @@ CcpNgDataEvent(int type, void *cookie)
 	    mbfree(bp);
     	    continue;
 	}
-	bundname++;
-	id = strtol(bundname, &rest, 10);
-	if (rest[0] != 0 || !gBundles[id] || gBundles[id]->dead) {
+	id = strtol(bundname + 1, &rest, 10);
+	if (rest[0] != 0 || id < 0 || id >= gNumBundles || !gBundles[id]
+	    || gBundles[id]->dead) {
     	    Log(LG_ERR, ("CCP: Packet from unexisting bundle \"%s\"",
-    		bundname));
+    		bundname + 1));
 	    mbfree(bp);
 	    continue;
 	}
 		
 	b = gBundles[id];
 
+	/* Stale frame, e.g. the slot now has a bundle without CCP */
+	if (b->ccp == NULL) {
+	    Log(LG_ERR, ("[%s] CCP: Packet for bundle without CCP", b->name));
+	    mbfree(bp);
+	    continue;
+	}
+
 	/* Packet requiring compression */
 	if (bundname[0] == 'c') {
 	    bp = CcpDataOutput(b, bp);
@@ -442,7 +521,7 @@ CcpNgDataEvent(int type, void *cookie)
 void
 CcpRecvMsg(Bund b, struct ng_mesg *msg, int len)
 {
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   Fsm		const fp = &ccp->fsm;
 
   (void)len;
@@ -500,7 +579,7 @@ CcpRecvMsg(Bund b, struct ng_mesg *msg, int len)
 void
 CcpUp(Bund b)
 {
-  FsmUp(&b->ccp.fsm);
+  FsmUp(&b->ccp->fsm);
 }
 
 /*
@@ -510,7 +589,7 @@ CcpUp(Bund b)
 void
 CcpDown(Bund b)
 {
-  FsmDown(&b->ccp.fsm);
+  FsmDown(&b->ccp->fsm);
 }
 
 /*
@@ -520,7 +599,7 @@ CcpDown(Bund b)
 void
 CcpOpen(Bund b)
 {
-  FsmOpen(&b->ccp.fsm);
+  FsmOpen(&b->ccp->fsm);
 }
 
 /*
@@ -530,7 +609,7 @@ CcpOpen(Bund b)
 void
 CcpClose(Bund b)
 {
-  FsmClose(&b->ccp.fsm);
+  FsmClose(&b->ccp->fsm);
 }
 
 /*
@@ -542,7 +621,7 @@ CcpOpenCmd(Context ctx)
 {
     if (ctx->bund->tmpl)
 	Error("impossible to open template");
-    FsmOpen(&ctx->bund->ccp.fsm);
+    FsmOpen(&CcpGet(ctx->bund)->fsm);
     return (0);
 }
 
@@ -555,7 +634,7 @@ CcpCloseCmd(Context ctx)
 {
     if (ctx->bund->tmpl)
 	Error("impossible to close template");
-    FsmClose(&ctx->bund->ccp.fsm);
+    FsmClose(&CcpGet(ctx->bund)->fsm);
     return (0);
 }
 
@@ -582,9 +661,13 @@ CcpFailure(Fsm fp, enum fsmfail reason)
 int
 CcpStat(Context ctx, int ac, const char *const av[], const void *arg)
 {
-  CcpState	const ccp = &ctx->bund->ccp;
+  CcpState	const ccp = ctx->bund->ccp;
   char		buf[64];
 
+  if (ccp == NULL) {
+    Printf("[%s] CCP is not in use\r\n", ctx->bund->name);
+    return(0);
+  }
   Printf("[%s] %s [%s]\r\n", Pref(&ccp->fsm), Fsm(&ccp->fsm), FsmStateName(ccp->fsm.state));
   Printf("Enabled protocols:\r\n");
   OptStat(ctx, &ccp->options, gConfList);
@@ -616,7 +699,7 @@ CcpStat(Context ctx, int ac, const char *const av[], const void *arg)
 void
 CcpSendResetReq(Bund b)
 {
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   CompType	const ct = ccp->recv;
   Fsm		const fp = &ccp->fsm;
   Mbuf		bp = NULL;
@@ -643,7 +726,7 @@ static void
 CcpRecvResetReq(Fsm fp, int id, Mbuf bp)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   CompType	const ct = ccp->xmit;
   int		noAck = 0;
 
@@ -664,7 +747,7 @@ static void
 CcpRecvResetAck(Fsm fp, int id, Mbuf bp)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   CompType	const ct = ccp->recv;
 
   if (ct && ct->RecvResetAck)
@@ -678,7 +761,7 @@ CcpRecvResetAck(Fsm fp, int id, Mbuf bp)
 void
 CcpInput(Bund b, Mbuf bp)
 {
-  FsmInput(&b->ccp.fsm, bp);
+  FsmInput(&b->ccp->fsm, bp);
 }
 
 /*
@@ -690,7 +773,7 @@ CcpInput(Bund b, Mbuf bp)
 Mbuf
 CcpDataOutput(Bund b, Mbuf plain)
 {
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   Mbuf		comp;
 
   LogDumpBp(LG_FRAME, plain, "[%s] %s: xmit plain", Pref(&ccp->fsm), Fsm(&ccp->fsm));
@@ -719,7 +802,7 @@ CcpDataOutput(Bund b, Mbuf plain)
 Mbuf
 CcpDataInput(Bund b, Mbuf comp)
 {
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   Mbuf		plain;
 
   LogDumpBp(LG_FRAME, comp, "[%s] %s: recv comp", Pref(&ccp->fsm), Fsm(&ccp->fsm));
@@ -755,7 +838,7 @@ static u_char *
 CcpBuildConfigReq(Fsm fp, u_char *cp)
 {
     Bund 	b = (Bund)fp->arg;
-    CcpState	const ccp = &b->ccp;
+    CcpState	const ccp = b->ccp;
     unsigned	type;
     int		ok;
 
@@ -781,7 +864,7 @@ static void
 CcpLayerUp(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   struct ngm_connect    cn;
   char		buf[64];
 
@@ -859,7 +942,7 @@ static void
 CcpLayerDown(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
 
   /* Update PPP node config */
   b->pppConfig.bund.enableCompression = 0;
@@ -899,7 +982,7 @@ static void
 CcpDecodeConfig(Fsm fp, FsmOption list, int num, int mode)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   u_int		ackSizeSave, rejSizeSave;
   int		k, rej;
 
@@ -966,7 +1049,7 @@ CcpDecodeConfig(Fsm fp, FsmOption list, int num, int mode)
 int
 CcpSubtractBloat(Bund b, int size)
 {
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
 
   /* Account for transmit compression overhead */
   if (OPEN_STATE(ccp->fsm.state) && ccp->xmit && ccp->xmit->SubtractBloat)
@@ -991,7 +1074,7 @@ static int
 CcpCheckEncryption(Bund b)
 {
 #if 0
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
 
   /* Already checked? */
   if (ccp->crypt_check)
@@ -1048,7 +1131,7 @@ fail:
 static int
 CcpSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
-  CcpState	const ccp = &ctx->bund->ccp;
+  CcpState	const ccp = CcpGet(ctx->bund);
 
   if (ac == 0)
     return(-1);
@@ -1121,3 +1204,16 @@ CcpTypeName(int type, char *buf, size_t len)
   return(buf);
 }
 
+static u_int32_t
+CcpNodeHash(struct ghash *g, const void *item)
+{
+  (void)g;
+  return (*(const ng_ID_t *)item);
+}
+
+static int
+CcpNodeEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  (void)g;
+  return (*(const ng_ID_t *)item1 == *(const ng_ID_t *)item2);
+}
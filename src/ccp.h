@@ -102,6 +102,9 @@
 
   extern void	CcpInit(Bund b);
   extern void	CcpInst(Bund b, Bund bt);
+  extern CcpState	CcpGet(Bund b);
+  extern void	CcpShutdown(Bund b);
+  extern void	CcpSetDecompNode(Bund b, ng_ID_t id);
   extern void	CcpUp(Bund b);
   extern void	CcpDown(Bund b);
   extern void	CcpOpen(Bund b);
@@ -68,7 +68,7 @@
 static int
 DeflateInit(Bund b, int dir)
 {
-    DeflateInfo		const deflate = &b->ccp.deflate;
+    DeflateInfo		const deflate = &b->ccp->deflate;
     struct ng_deflate_config	conf;
     struct ngm_mkpeer	mp;
     char		path[NG_PATHSIZ];
@@ -107,9 +107,9 @@ DeflateInit(Bund b, int dir)
     }
 
     if (dir == COMP_DIR_XMIT) {
-	b->ccp.comp_node_id = id;
+	b->ccp->comp_node_id = id;
     } else {
-	b->ccp.decomp_node_id = id;
+	CcpSetDecompNode(b, id);
     }
 
     /* Configure DEFLATE node */
@@ -135,7 +135,7 @@ fail:
 static int
 DeflateConfigure(Bund b)
 {
-    CcpState	const ccp = &b->ccp;
+    CcpState	const ccp = b->ccp;
     DeflateInfo	const deflate = &ccp->deflate;
   
     deflate->xmit_windowBits=15;
@@ -151,7 +151,7 @@ DeflateConfigure(Bund b)
 static char *
 DeflateDescribe(Bund b, int dir, char *buf, size_t len)
 {
-    CcpState	const ccp = &b->ccp;
+    CcpState	const ccp = b->ccp;
     DeflateInfo	const deflate = &ccp->deflate;
 
     switch (dir) {
@@ -179,11 +179,11 @@ DeflateCleanup(Bund b, int dir)
 
     /* Remove node */
     if (dir == COMP_DIR_XMIT) {
-	snprintf(path, sizeof(path), "[%x]:", b->ccp.comp_node_id);
-	b->ccp.comp_node_id = 0;
+	snprintf(path, sizeof(path), "[%x]:", b->ccp->comp_node_id);
+	b->ccp->comp_node_id = 0;
     } else {
-	snprintf(path, sizeof(path), "[%x]:", b->ccp.decomp_node_id);
-	b->ccp.decomp_node_id = 0;
+	snprintf(path, sizeof(path), "[%x]:", b->ccp->decomp_node_id);
+	CcpSetDecompNode(b, 0);
     }
     NgFuncShutdownNode(gCcpCsock, b->name, path);
 }
@@ -202,7 +202,7 @@ DeflateRecvResetReq(Bund b, int id, Mbuf bp, int *noAck)
     (void)noAck;
 
     /* Forward ResetReq to the DEFLATE compression node */
-    snprintf(path, sizeof(path), "[%x]:", b->ccp.comp_node_id);
+    snprintf(path, sizeof(path), "[%x]:", b->ccp->comp_node_id);
     if (NgSendMsg(gCcpCsock, path,
     	    NGM_DEFLATE_COOKIE, NGM_DEFLATE_RESETREQ, NULL, 0) < 0) {
 	Perror("[%s] reset-req to %s node", b->name, NG_DEFLATE_NODE_TYPE);
@@ -234,7 +234,7 @@ DeflateRecvResetAck(Bund b, int id, Mbuf bp)
     (void)id;
 
     /* Forward ResetReq to the DEFLATE compression node */
-    snprintf(path, sizeof(path), "[%x]:", b->ccp.decomp_node_id);
+    snprintf(path, sizeof(path), "[%x]:", b->ccp->decomp_node_id);
     if (NgSendMsg(gCcpCsock, path,
     	    NGM_DEFLATE_COOKIE, NGM_DEFLATE_RESETREQ, NULL, 0) < 0) {
 	Perror("[%s] reset-ack to %s node", b->name, NG_DEFLATE_NODE_TYPE);
@@ -248,7 +248,7 @@ DeflateRecvResetAck(Bund b, int id, Mbuf bp)
 static u_char *
 DeflateBuildConfigReq(Bund b, u_char *cp, int *ok)
 {
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   DeflateInfo	const deflate = &ccp->deflate;
   u_int16_t	opt;
   
@@ -269,7 +269,7 @@ static void
 DeflateDecodeConfigReq(Fsm fp, FsmOption opt, int mode)
 {
     Bund 	b = (Bund)fp->arg;
-  CcpState	const ccp = &b->ccp;
+  CcpState	const ccp = b->ccp;
   DeflateInfo	const deflate = &ccp->deflate;
   u_int16_t     o;
   u_char	window, method, chk;
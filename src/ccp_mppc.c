@@ -143,7 +143,7 @@
 static int
 MppcInit(Bund b, int dir)
 {
-    MppcInfo		const mppc = &b->ccp.mppc;
+    MppcInfo		const mppc = &b->ccp->mppc;
     struct ng_mppc_config	conf;
     struct ngm_mkpeer	mp;
     char		path[NG_PATHSIZ];
@@ -203,9 +203,9 @@ MppcInit(Bund b, int dir)
     }
 
     if (dir == COMP_DIR_XMIT) {
-	b->ccp.comp_node_id = id;
+	b->ccp->comp_node_id = id;
     } else {
-	b->ccp.decomp_node_id = id;
+	CcpSetDecompNode(b, id);
     }
 
     /* Configure MPPC node */
@@ -228,7 +228,7 @@ fail:
 static int
 MppcConfigure(Bund b)
 {
-    MppcInfo	const mppc = &b->ccp.mppc;
+    MppcInfo	const mppc = &b->ccp->mppc;
 
     mppc->peer_reject = 0;
     mppc->recv_bits = 0;
@@ -255,7 +255,7 @@ MppcConfigure(Bund b)
 static char *
 MppcDescribe(Bund b, int dir, char *buf, size_t len)
 {
-  MppcInfo	const mppc = &b->ccp.mppc;
+  MppcInfo	const mppc = &b->ccp->mppc;
 
   switch (dir) {
     case COMP_DIR_XMIT:
@@ -280,7 +280,7 @@ MppcSubtractBloat(Bund b, int size)
   size -= 2;
 
   /* Account for possible expansion with MPPC compression */
-  if ((b->ccp.mppc.xmit_bits & MPPC_BIT) != 0) {
+  if ((b->ccp->mppc.xmit_bits & MPPC_BIT) != 0) {
     int	l, h, size0 = size;
 
     while (1) {
@@ -308,7 +308,7 @@ MppcSubtractBloat(Bund b, int size)
 static int
 MppcNegotiated(Bund b, int dir)
 {
-  MppcInfo	const mppc = &b->ccp.mppc;
+  MppcInfo	const mppc = &b->ccp->mppc;
 
   switch (dir) {
     case COMP_DIR_XMIT:
@@ -332,11 +332,11 @@ MppcCleanup(Bund b, int dir)
 
     /* Remove node */
     if (dir == COMP_DIR_XMIT) {
-	snprintf(path, sizeof(path), "[%x]:", b->ccp.comp_node_id);
-	b->ccp.comp_node_id = 0;
+	snprintf(path, sizeof(path), "[%x]:", b->ccp->comp_node_id);
+	b->ccp->comp_node_id = 0;
     } else {
-	snprintf(path, sizeof(path), "[%x]:", b->ccp.decomp_node_id);
-	b->ccp.decomp_node_id = 0;
+	snprintf(path, sizeof(path), "[%x]:", b->ccp->decomp_node_id);
+	CcpSetDecompNode(b, 0);
     }
     NgFuncShutdownNode(gCcpCsock, b->name, path);
 }
@@ -348,7 +348,7 @@ MppcCleanup(Bund b, int dir)
 static u_char *
 MppcBuildConfigReq(Bund b, u_char *cp, int *ok)
 {
-  MppcInfo	const mppc = &b->ccp.mppc;
+  MppcInfo	const mppc = &b->ccp->mppc;
   u_int32_t	bits = 0;
 
   /* Compression */
@@ -393,7 +393,7 @@ static void
 MppcDecodeConfigReq(Fsm fp, FsmOption opt, int mode)
 {
     Bund 	b = (Bund)fp->arg;
-  MppcInfo	const mppc = &b->ccp.mppc;
+  MppcInfo	const mppc = &b->ccp->mppc;
   u_int32_t	orig_bits;
   u_int32_t	bits;
   char		buf[64];
@@ -501,7 +501,7 @@ MppcRecvResetReq(Bund b, int id, Mbuf bp, int *noAck)
     (void)bp;
 
     /* Forward ResetReq to the MPPC compression node */
-    snprintf(path, sizeof(path), "[%x]:", b->ccp.comp_node_id);
+    snprintf(path, sizeof(path), "[%x]:", b->ccp->comp_node_id);
     if (NgSendMsg(gCcpCsock, path,
     	    NGM_MPPC_COOKIE, NGM_MPPC_RESETREQ, NULL, 0) < 0) {
 	Perror("[%s] reset-req to %s node", b->name, NG_MPPC_NODE_TYPE);
@@ -547,7 +547,7 @@ MppcDescribeBits(u_int32_t bits, char *buf, size_t len)
 static short
 MppcEnabledMppeType(Bund b, short type)
 {
-    MppcInfo	const mppc = &b->ccp.mppc;
+    MppcInfo	const mppc = &b->ccp->mppc;
     short	ret;
 
     /* Check if we have kernel support */
@@ -596,7 +596,7 @@ MppcEnabledMppeType(Bund b, short type)
 static short
 MppcAcceptableMppeType(Bund b, short type)
 {
-    MppcInfo	const mppc = &b->ccp.mppc;
+    MppcInfo	const mppc = &b->ccp->mppc;
     short	ret;
   
     /* Check if we have kernel support */
@@ -816,12 +816,16 @@ done:
 int
 MppcStat(Context ctx, int ac, const char *const av[], const void *arg)
 {
-  MppcInfo	const mppc = &ctx->bund->ccp.mppc;
+  MppcInfo	mppc;
 
   (void)ac;
   (void)av;
   (void)arg;
 
+  if (ctx->bund->ccp == NULL)
+    return(0);
+  mppc = &ctx->bund->ccp->mppc;
+
   Printf("MPPC options:\r\n");
   OptStat(ctx, &mppc->options, gConfList);
 
@@ -835,7 +839,7 @@ MppcStat(Context ctx, int ac, const char *const av[], const void *arg)
 static int
 MppcSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
-  MppcInfo	const mppc = &ctx->bund->ccp.mppc;
+  MppcInfo	const mppc = &CcpGet(ctx->bund)->mppc;
 
   if (ac == 0)
     return(-1);
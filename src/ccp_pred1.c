@@ -113,7 +113,7 @@ static int
 Pred1Init(Bund b, int dir)
 {
 #ifndef USE_NG_PRED1
-    Pred1Info	p = &b->ccp.pred1;
+    Pred1Info	p = &b->ccp->pred1;
 
     if (dir == COMP_DIR_XMIT) {
 	p->oHash = 0;
@@ -158,9 +158,9 @@ Pred1Init(Bund b, int dir)
     }
 
     if (dir == COMP_DIR_XMIT) {
-	b->ccp.comp_node_id = id;
+	b->ccp->comp_node_id = id;
     } else {
-	b->ccp.decomp_node_id = id;
+	CcpSetDecompNode(b, id);
     }
 
     /* Configure PRED1 node */
@@ -187,12 +187,14 @@ void
 Pred1Cleanup(Bund b, int dir)
 {
 #ifndef USE_NG_PRED1
-    Pred1Info	p = &b->ccp.pred1;
+    Pred1Info	p = &b->ccp->pred1;
 
     if (dir == COMP_DIR_XMIT) {
 	assert(p->OutputGuessTable);
 	Freee(p->OutputGuessTable);
 	p->OutputGuessTable = NULL;
+	mbfree(p->OutputSpare);
+	p->OutputSpare = NULL;
 	memset(&p->xmit_stats, 0, sizeof(p->xmit_stats));
     } else {
 	assert(p->InputGuessTable);
@@ -205,11 +207,11 @@ Pred1Cleanup(Bund b, int dir)
 
     /* Remove node */
     if (dir == COMP_DIR_XMIT) {
-	snprintf(path, sizeof(path), "[%x]:", b->ccp.comp_node_id);
-	b->ccp.comp_node_id = 0;
+	snprintf(path, sizeof(path), "[%x]:", b->ccp->comp_node_id);
+	b->ccp->comp_node_id = 0;
     } else {
-	snprintf(path, sizeof(path), "[%x]:", b->ccp.decomp_node_id);
-	b->ccp.decomp_node_id = 0;
+	snprintf(path, sizeof(path), "[%x]:", b->ccp->decomp_node_id);
+	CcpSetDecompNode(b, 0);
     }
     NgFuncShutdownNode(gCcpCsock, b->name, path);
 #endif
@@ -219,8 +221,10 @@ Pred1Cleanup(Bund b, int dir)
 /*
  * Pred1Compress()
  *
- * Compress a packet and return a compressed version.
- * The original is untouched.
+ * Compress a packet. The original is consumed: it is freed when
+ * the compressed version is returned, or returned itself with the
+ * header and FCS added when it does not compress. In that case the
+ * output buffer is kept for the next packet.
  */
 
 Mbuf
@@ -231,7 +235,7 @@ Pred1Compress(Bund b, Mbuf plain)
   int		len;
   Mbuf		res;
   int		orglen;
-  Pred1Info	p = &b->ccp.pred1;
+  Pred1Info	p = &b->ccp->pred1;
   
   orglen = MBLEN(plain);
   uncomp = MBDATA(plain);
@@ -239,7 +243,12 @@ Pred1Compress(Bund b, Mbuf plain)
   p->xmit_stats.InOctets += orglen;
   p->xmit_stats.FramesPlain++;
   
-  res = mballoc(PRED1_MAX_BLOWUP(orglen + 2));
+  res = p->OutputSpare;
+  p->OutputSpare = NULL;
+  if (res == NULL || MBSPACE(res) < PRED1_MAX_BLOWUP(orglen + 2)) {
+    mbfree(res);
+    res = mballoc(PRED1_MAX_BLOWUP(orglen + 2));
+  }
   comp = MBDATA(res);
 
   wp = comp;
@@ -264,22 +273,30 @@ Pred1Compress(Bund b, Mbuf plain)
     *comp |= 0x80;
     wp += len;
     p->xmit_stats.FramesComp++;
+
+/* Add FCS */
+
+    *wp++ = fcs & 0xFF;
+    *wp++ = fcs >> 8;
+
+    res->cnt = (wp - comp);
+    mbfree(plain);
   }
   else
   {
-    memcpy(wp, uncomp, orglen);
-    wp += orglen;
-    p->xmit_stats.FramesUncomp++;
-  }
+    u_char	fcsbuf[2];
 
-/* Add FCS */
+/* Send the original with header and FCS added, in place if possible */
 
-  *wp++ = fcs & 0xFF;
-  *wp++ = fcs >> 8;
+    fcsbuf[0] = fcs & 0xFF;
+    fcsbuf[1] = fcs >> 8;
+    plain = mbprepend(plain, comp, 2);
+    plain = mbappend(plain, fcsbuf, sizeof(fcsbuf));
+    p->OutputSpare = res;
+    res = plain;
+    p->xmit_stats.FramesUncomp++;
+  }
 
-  res->cnt = (wp - comp);
-  
-  mbfree(plain);
   Log(LG_CCP2, ("[%s] Pred1: orig (%d) --> comp (%d)", b->name, orglen, res->cnt));
 
   p->xmit_stats.OutOctets += res->cnt;
@@ -303,7 +320,7 @@ Pred1Decompress(Bund b, Mbuf mbcomp)
   u_int16_t	fcs;
   int           orglen;
   Mbuf		mbuncomp;
-  Pred1Info	p = &b->ccp.pred1;
+  Pred1Info	p = &b->ccp->pred1;
 
   orglen = MBLEN(mbcomp);
   comp = MBDATA(mbcomp);
@@ -389,7 +406,7 @@ Pred1RecvResetReq(Bund b, int id, Mbuf bp, int *noAck)
   (void)bp;
   (void)noAck;
 #ifndef USE_NG_PRED1
-  Pred1Info     p = &b->ccp.pred1;
+  Pred1Info     p = &b->ccp->pred1;
 
   (void)id;
   (void)bp;
@@ -405,7 +422,7 @@ Pred1RecvResetReq(Bund b, int id, Mbuf bp, int *noAck)
     (void)noAck;
 
     /* Forward ResetReq to the Predictor1 compression node */
-    snprintf(path, sizeof(path), "[%x]:", b->ccp.comp_node_id);
+    snprintf(path, sizeof(path), "[%x]:", b->ccp->comp_node_id);
     if (NgSendMsg(gCcpCsock, path,
     	    NGM_PRED1_COOKIE, NGM_PRED1_RESETREQ, NULL, 0) < 0) {
 	Perror("[%s] reset to %s node", b->name, NG_PRED1_NODE_TYPE);
@@ -447,7 +464,7 @@ Pred1RecvResetAck(Bund b, int id, Mbuf bp)
     (void)bp;
 
     /* Forward ResetReq to the Predictor1 decompression node */
-    snprintf(path, sizeof(path), "[%x]:", b->ccp.decomp_node_id);
+    snprintf(path, sizeof(path), "[%x]:", b->ccp->decomp_node_id);
     if (NgSendMsg(gCcpCsock, path,
     	    NGM_PRED1_COOKIE, NGM_PRED1_RESETREQ, NULL, 0) < 0) {
 	Perror("[%s] reset to %s node", b->name, NG_PRED1_NODE_TYPE);
@@ -514,7 +531,7 @@ static int
 Pred1Stat(Context ctx, int dir) 
 {
 #ifndef USE_NG_PRED1
-    Pred1Info	p = &ctx->bund->ccp.pred1;
+    Pred1Info	p = &ctx->bund->ccp->pred1;
     
     switch (dir) {
 	case COMP_DIR_XMIT:
@@ -622,7 +639,7 @@ Pred1Stat(Context ctx, int dir)
 static int
 Compress(Bund b, u_char *source, u_char *dest, int len)
 {
-  Pred1Info	p = &b->ccp.pred1;
+  Pred1Info	p = &b->ccp->pred1;
   int		i, bitmask;
   u_char	flags;
   u_char	*flagdest, *orgdest;
@@ -656,7 +673,7 @@ Compress(Bund b, u_char *source, u_char *dest, int len)
 static int
 Decompress(Bund b, u_char *source, u_char *dest, int slen, int dlen)
 {
-  Pred1Info	p = &b->ccp.pred1;
+  Pred1Info	p = &b->ccp->pred1;
   int		i, bitmask;
   u_char	flags, *orgdest;
 
@@ -693,7 +710,7 @@ Decompress(Bund b, u_char *source, u_char *dest, int slen, int dlen)
 static void
 SyncTable(Bund b, u_char *source, u_char *dest, int len)
 {
-  Pred1Info	p = &b->ccp.pred1;
+  Pred1Info	p = &b->ccp->pred1;
 
   while (len--)
   {
@@ -44,6 +44,7 @@
     u_short	oHash;
     u_char	*InputGuessTable;
     u_char	*OutputGuessTable;
+    Mbuf	OutputSpare;		/* unused output buffer */
     struct pred1_stats	recv_stats;
     struct pred1_stats	xmit_stats;
 #endif
@@ -31,6 +31,7 @@
 #include "ipcp.h"
 #include "ip.h"
 #include "ippool.h"
+#include "admission.h"
 #include "devices.h"
 #include "netgraph.h"
 #include "ngfunc.h"
@@ -80,6 +81,8 @@
 #endif
     SET_MAX_CHILDREN,
     SET_QTHRESHOLD,
+    SET_TIMER_SLACK,
+    SET_MEM_BUDGET,
 #ifdef USE_NG_BPF
     SET_FILTER
 #endif
@@ -155,6 +158,10 @@
 	GlobalSetCommand, NULL, 2, (void *) SET_MAX_CHILDREN },
     { "qthreshold {min} {max}",		"Message queue limit thresholds",
         GlobalSetCommand, NULL, 2, (void *) SET_QTHRESHOLD },
+    { "timer-slack {ms}",		"Lateness allowed for periodic timers",
+	GlobalSetCommand, NULL, 2, (void *) SET_TIMER_SLACK },
+    { "mem-budget {type} {kbytes}",	"Memory budget for memory type",
+	GlobalSetCommand, NULL, 2, (void *) SET_MEM_BUDGET },
 #ifdef USE_NG_BPF
     { "filter {num} add|clear [\"{flt}\"]",	"Global traffic filters management",
 	GlobalSetCommand, NULL, 2, (void *) SET_FILTER },
@@ -169,6 +176,7 @@
     { 0,	GLOBAL_CONF_ONESHOT,	"one-shot"	},
     { 0,	GLOBAL_CONF_AGENT_CID,	"agent-cid"	},
     { 0,	GLOBAL_CONF_SESS_TIME,	"session-time"	},
+    { 0,	GLOBAL_CONF_EVENT_STATS,	"event-stats"	},
     { 0,	0,			NULL		},
   };
 
@@ -209,6 +217,8 @@
   };
 
   static const struct cmdtab ShowCommands[] = {
+    { "admission",			"Admission control status",
+	AdmissionStat, NULL, 0, NULL },
     { "bundle [{name}]",		"Bundle status",
 	BundStat, AdmitBund, 0, NULL },
     { "customer",			"Customer summary",
@@ -265,7 +275,7 @@
     { "nat",				"NAT status",
 	NatStat, AdmitBund, 0, NULL },
 #endif
-    { "mem",				"Memory map",
+    { "mem [per-session]",		"Memory map",
 	MemStat, NULL, 0, NULL },
     { "console",			"Console status",
 	ConsoleStat, NULL, 0, NULL },
@@ -275,6 +285,10 @@
 #endif
     { "user",				"Console users" ,
       	UserStat, NULL, 0, NULL },
+    { "logins",				"Open sessions per user",
+	BundLoginsStat, NULL, 0, NULL },
+    { "users",				"Open sessions per user",
+	BundLoginsStat, NULL, 0, NULL },
     { "global",				"Global settings",
 	ShowGlobal, NULL, 0, NULL },
     { "types",				"Supported device types",
@@ -315,6 +329,8 @@
 	CMD_SUBMENU, AdmitBund, 2, Ipv6cpSetCmds },
     { "ippool ...",			"IP pool specific stuff",
 	CMD_SUBMENU, NULL, 2, IPPoolSetCmds },
+    { "admission ...",			"Admission control settings",
+	CMD_SUBMENU, NULL, 2, AdmissionSetCmds },
     { "ccp ...",			"CCP specific stuff",
 	CMD_SUBMENU, AdmitBund, 2, CcpSetCmds },
 #ifdef CCP_MPPC
@@ -576,6 +592,9 @@ FindCommand(Context ctx, CmdTab cmds, const char *str, CmdTab *cmdp)
 	if (cmds->name && !strncmp(str, cmds->name, len) &&
 	  cmds->priv <= ctx->priv) {
 	    *cmdp = cmds;
+	    /* Full name wins over longer ones, e.g. "user" and "users" */
+	    if (cmds->name[len] == 0)
+		return (0);
     	    nmatch++;
 	}
     }
@@ -606,7 +625,10 @@ GlobalSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
 
   switch ((intptr_t)arg) {
     case SET_ENABLE:
+      val = Enabled(&gGlobalConf.options, GLOBAL_CONF_EVENT_STATS);
       EnableCommand(ac, av, &gGlobalConf.options, gGlobalConfList);
+      if (!val && Enabled(&gGlobalConf.options, GLOBAL_CONF_EVENT_STATS))
+	EventStatsReset();
       break;
 
     case SET_DISABLE:
@@ -779,6 +801,26 @@ GlobalSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
         else
             return (-1);
         break;
+
+    case SET_TIMER_SLACK:
+	val = atoi(*av);
+	if (val < 0 || val > 60000)
+	    Error("Incorrect timer slack, must be between 0 and 60000 ms");
+	else
+	    gTimerSlack = val;
+	break;
+    case SET_MEM_BUDGET:
+	if (ac != 2)
+	    return (-1);
+	val = atoi(av[1]);
+	if (val < 0)
+	    Error("Incorrect memory budget");
+	if (MemBudgetSet(av[0], (u_long)val * 1024) != 0) {
+	    if (errno == ENOENT)
+		Error("Unknown memory type \"%s\", see \"show mem\"", av[0]);
+	    Error("Too many memory budgets");
+	}
+	break;
     default:
       return(-1);
   }
@@ -973,6 +1015,7 @@ ShowEvents(Context ctx, int ac, const char *const av[], const void *arg)
   (void)arg;
 
   EventDump(ctx);
+  MsgStat(ctx);
   return(0);
 }
 
@@ -1008,6 +1051,8 @@ ShowGlobal(Context ctx, int ac, const char *const av[], const void *arg)
 #endif
     Printf("	max-children	: %d\r\n", gMaxChildren);
     Printf("	qthreshold	: %d %d\r\n", gQThresMin, gQThresMax);
+    Printf("	timer-slack	: %d ms\r\n", gTimerSlack);
+    MemBudgetShow(ctx);
     Printf("Global options:\r\n");
     OptStat(ctx, &gGlobalConf.options, gGlobalConfList);
 #ifdef USE_NG_BPF
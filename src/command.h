@@ -33,7 +33,8 @@
 #endif
     GLOBAL_CONF_ONESHOT,	/* enable OneShot mode */
     GLOBAL_CONF_AGENT_CID,	/* enable display Agent CID in show session */
-    GLOBAL_CONF_SESS_TIME	/* enable display uptime in show session */
+    GLOBAL_CONF_SESS_TIME,	/* enable display uptime in show session */
+    GLOBAL_CONF_EVENT_STATS	/* enable event handler statistics */
   };
 
   struct globalconf {
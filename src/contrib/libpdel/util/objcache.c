@@ -0,0 +1,392 @@
+
+/*
+ * objcache.c
+ *
+ * See ``COPYRIGHT.mpd''
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "structs/structs.h"
+#include "structs/type/array.h"
+
+#include "util/objcache.h"
+#include "util/typed_mem.h"
+
+#define OBJCACHE_NAMELEN	32
+
+/* Per-thread magazine of free objects */
+struct objcache_mag {
+	struct objcache		*cache;		/* owning cache */
+	LIST_ENTRY(objcache_mag) next;		/* next in cache->mags */
+	u_int64_t		gets;		/* objcache_get() calls */
+	u_int64_t		hits;		/* served from 'objs' */
+	u_int64_t		misses;		/* new objects allocated */
+	u_int			nobjs;		/* free objects in 'objs' */
+	void			*objs[];	/* free objects */
+};
+
+/* Object cache */
+struct objcache {
+	char			name[OBJCACHE_NAMELEN];
+	const char		*mtype;		/* typed_mem(3) memory type */
+	char			mtype_buf[TYPED_MEM_TYPELEN];
+	size_t			size;		/* object size */
+	u_int			magsize;	/* magazine capacity */
+	u_int			maxfree;	/* depot capacity */
+	pthread_key_t		key;		/* this thread's magazine */
+	pthread_mutex_t		mutex;		/* protects everything below */
+	void			**free;		/* depot of free objects */
+	u_int			nfree;		/* length of 'free' */
+	LIST_HEAD(, objcache_mag) mags;		/* live magazines */
+	u_int			refs;		/* one, plus one per magazine */
+	u_int64_t		gets;		/* totals not in a magazine */
+	u_int64_t		hits;
+	u_int64_t		misses;
+	u_int64_t		refills;
+	u_int64_t		releases;
+	LIST_ENTRY(objcache)	next;		/* next in objcache_list */
+};
+
+/* Internal functions */
+static struct	objcache_mag *objcache_mag_create(struct objcache *cache);
+static void	objcache_mag_destroy(void *arg);
+static void	objcache_unref(struct objcache *cache);
+
+/* Internal variables */
+static LIST_HEAD(, objcache) objcache_list
+	    = LIST_HEAD_INITIALIZER(objcache_list);
+static pthread_mutex_t objcache_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Create a new object cache.
+ */
+struct objcache *
+objcache_create(const char *name, const char *mtype, size_t size,
+	u_int magsize, u_int maxfree)
+{
+	struct objcache *cache;
+
+	if (size == 0 || magsize < 2) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	if ((cache = MALLOC(mtype, sizeof(*cache))) == NULL)
+		return (NULL);
+	memset(cache, 0, sizeof(*cache));
+	if (maxfree > 0
+	    && (cache->free = MALLOC(mtype,
+	      maxfree * sizeof(*cache->free))) == NULL)
+		goto fail;
+	if ((errno = pthread_key_create(&cache->key,
+	    objcache_mag_destroy)) != 0)
+		goto fail;
+	if ((errno = pthread_mutex_init(&cache->mutex, NULL)) != 0) {
+		pthread_key_delete(cache->key);
+		goto fail;
+	}
+	strlcpy(cache->name, name, sizeof(cache->name));
+	if (mtype != NULL) {
+		strlcpy(cache->mtype_buf, mtype, sizeof(cache->mtype_buf));
+		cache->mtype = cache->mtype_buf;
+	}
+	cache->size = size;
+	cache->magsize = magsize;
+	cache->maxfree = maxfree;
+	LIST_INIT(&cache->mags);
+	cache->refs = 1;
+
+	/* Make it visible to objcache_walk() */
+	pthread_mutex_lock(&objcache_list_mutex);
+	LIST_INSERT_HEAD(&objcache_list, cache, next);
+	pthread_mutex_unlock(&objcache_list_mutex);
+	return (cache);
+
+fail:
+	FREE(mtype, cache->free);
+	FREE(mtype, cache);
+	return (NULL);
+}
+
+/*
+ * Destroy an object cache.
+ */
+void
+objcache_destroy(struct objcache **cachep)
+{
+	struct objcache *const cache = *cachep;
+	struct objcache_mag *mag;
+
+	if (cache == NULL)
+		return;
+	*cachep = NULL;
+
+	pthread_mutex_lock(&objcache_list_mutex);
+	LIST_REMOVE(cache, next);
+	pthread_mutex_unlock(&objcache_list_mutex);
+
+	/* Give back our own magazine now rather than at thread exit */
+	if ((mag = pthread_getspecific(cache->key)) != NULL) {
+		pthread_setspecific(cache->key, NULL);
+		objcache_mag_destroy(mag);
+	}
+
+	/* Drop the creator's reference */
+	pthread_mutex_lock(&cache->mutex);
+	objcache_unref(cache);
+}
+
+/*
+ * Get an object.
+ */
+void *
+objcache_get(struct objcache *cache)
+{
+	struct objcache_mag *mag;
+	void *obj;
+	u_int n;
+
+	/* Fast path: this thread's magazine */
+	if ((mag = pthread_getspecific(cache->key)) == NULL)
+		mag = objcache_mag_create(cache);
+	if (mag != NULL) {
+		mag->gets++;
+		if (mag->nobjs > 0) {
+			mag->hits++;
+			return (mag->objs[--mag->nobjs]);
+		}
+	}
+
+	/* Refill from the depot, half a magazine at a time */
+	pthread_mutex_lock(&cache->mutex);
+	if (mag == NULL) {
+		cache->gets++;
+		if (cache->nfree > 0) {
+			cache->hits++;
+			obj = cache->free[--cache->nfree];
+			pthread_mutex_unlock(&cache->mutex);
+			return (obj);
+		}
+		cache->misses++;
+		pthread_mutex_unlock(&cache->mutex);
+		return (MALLOC(cache->mtype, cache->size));
+	}
+	if (cache->nfree > 0) {
+		for (n = cache->magsize / 2; n > 0 && cache->nfree > 0; n--)
+			mag->objs[mag->nobjs++] = cache->free[--cache->nfree];
+		cache->refills++;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	if (mag->nobjs > 0)
+		return (mag->objs[--mag->nobjs]);
+
+	/* Allocate a new one */
+	if ((obj = MALLOC(cache->mtype, cache->size)) != NULL)
+		mag->misses++;
+	return (obj);
+}
+
+/*
+ * Return an object.
+ */
+void
+objcache_put(struct objcache *cache, void *obj)
+{
+	struct objcache_mag *const mag = pthread_getspecific(cache->key);
+
+	if (obj == NULL)
+		return;
+
+	/* Fast path: room in this thread's magazine */
+	if (mag != NULL && mag->nobjs < cache->magsize) {
+		mag->objs[mag->nobjs++] = obj;
+		return;
+	}
+
+	/*
+	 * Move half of a full magazine to the depot. Threads that never
+	 * allocate, e.g. paction(3) threads, have no magazine and return
+	 * objects straight to the depot.
+	 */
+	pthread_mutex_lock(&cache->mutex);
+	if (mag != NULL) {
+		while (mag->nobjs > cache->magsize / 2
+		    && cache->nfree < cache->maxfree)
+			cache->free[cache->nfree++] = mag->objs[--mag->nobjs];
+		if (mag->nobjs < cache->magsize) {
+			pthread_mutex_unlock(&cache->mutex);
+			mag->objs[mag->nobjs++] = obj;
+			return;
+		}
+	} else if (cache->nfree < cache->maxfree) {
+		cache->free[cache->nfree++] = obj;
+		pthread_mutex_unlock(&cache->mutex);
+		return;
+	}
+
+	/* Cache is full */
+	cache->releases++;
+	pthread_mutex_unlock(&cache->mutex);
+	FREE(cache->mtype, obj);
+}
+
+/*
+ * Get statistics for a cache.
+ */
+void
+objcache_get_stats(struct objcache *cache, struct objcache_stats *stats)
+{
+	struct objcache_mag *mag;
+	u_int64_t allocated;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->name = cache->name;
+	stats->size = cache->size;
+
+	/* Other threads' magazine counters may be slightly stale */
+	pthread_mutex_lock(&cache->mutex);
+	stats->gets = cache->gets;
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->cached = cache->nfree;
+	LIST_FOREACH(mag, &cache->mags, next) {
+		stats->gets += mag->gets;
+		stats->hits += mag->hits;
+		stats->misses += mag->misses;
+		stats->cached += mag->nobjs;
+	}
+	stats->refills = cache->refills;
+	stats->releases = cache->releases;
+	pthread_mutex_unlock(&cache->mutex);
+
+	allocated = stats->misses - stats->releases;
+	stats->inuse = (allocated > stats->cached) ?
+	    allocated - stats->cached : 0;
+}
+
+/*
+ * Report statistics for every cache.
+ */
+void
+objcache_walk(objcache_walk_t *func, void *arg)
+{
+	struct objcache_stats stats;
+	struct objcache *cache;
+
+	pthread_mutex_lock(&objcache_list_mutex);
+	LIST_FOREACH(cache, &objcache_list, next) {
+		objcache_get_stats(cache, &stats);
+		(*func)(&stats, arg);
+	}
+	pthread_mutex_unlock(&objcache_list_mutex);
+}
+
+/*
+ * Free the cached objects we can get at without other threads' help.
+ */
+size_t
+objcache_reclaim(void)
+{
+	struct objcache_mag *mag;
+	struct objcache *cache;
+	size_t freed = 0;
+
+	pthread_mutex_lock(&objcache_list_mutex);
+	LIST_FOREACH(cache, &objcache_list, next) {
+		mag = pthread_getspecific(cache->key);
+		pthread_mutex_lock(&cache->mutex);
+		freed += (cache->nfree + (mag ? mag->nobjs : 0)) * cache->size;
+		while (cache->nfree > 0) {
+			FREE(cache->mtype, cache->free[--cache->nfree]);
+			cache->releases++;
+		}
+		while (mag != NULL && mag->nobjs > 0) {
+			FREE(cache->mtype, mag->objs[--mag->nobjs]);
+			cache->releases++;
+		}
+		pthread_mutex_unlock(&cache->mutex);
+	}
+	pthread_mutex_unlock(&objcache_list_mutex);
+	return (freed);
+}
+
+/*
+ * Create this thread's magazine.
+ */
+static struct objcache_mag *
+objcache_mag_create(struct objcache *cache)
+{
+	struct objcache_mag *mag;
+
+	if ((mag = MALLOC(cache->mtype, sizeof(*mag)
+	    + cache->magsize * sizeof(*mag->objs))) == NULL)
+		return (NULL);
+	memset(mag, 0, sizeof(*mag));
+	mag->cache = cache;
+	if (pthread_setspecific(cache->key, mag) != 0) {
+		FREE(cache->mtype, mag);
+		return (NULL);
+	}
+	pthread_mutex_lock(&cache->mutex);
+	LIST_INSERT_HEAD(&cache->mags, mag, next);
+	cache->refs++;
+	pthread_mutex_unlock(&cache->mutex);
+	return (mag);
+}
+
+/*
+ * Give a magazine's objects back to the depot on thread exit.
+ */
+static void
+objcache_mag_destroy(void *arg)
+{
+	struct objcache_mag *const mag = arg;
+	struct objcache *const cache = mag->cache;
+
+	pthread_mutex_lock(&cache->mutex);
+	while (mag->nobjs > 0 && cache->nfree < cache->maxfree)
+		cache->free[cache->nfree++] = mag->objs[--mag->nobjs];
+	cache->releases += mag->nobjs;
+	cache->gets += mag->gets;
+	cache->hits += mag->hits;
+	cache->misses += mag->misses;
+	LIST_REMOVE(mag, next);
+	while (mag->nobjs > 0)
+		FREE(cache->mtype, mag->objs[--mag->nobjs]);
+	FREE(cache->mtype, mag);
+	objcache_unref(cache);
+}
+
+/*
+ * Release cache lock and drop a cache reference.
+ *
+ * This assumes the mutex is locked. Upon return it will be unlocked.
+ */
+static void
+objcache_unref(struct objcache *cache)
+{
+	const char *const mtype = cache->mtype;
+
+	assert(cache->refs > 0);
+	if (--cache->refs > 0) {
+		pthread_mutex_unlock(&cache->mutex);
+		return;
+	}
+	assert(LIST_EMPTY(&cache->mags));
+	while (cache->nfree > 0)
+		FREE(mtype, cache->free[--cache->nfree]);
+	pthread_mutex_unlock(&cache->mutex);
+	pthread_mutex_destroy(&cache->mutex);
+	pthread_key_delete(cache->key);
+	FREE(mtype, cache->free);
+	FREE(mtype, cache);
+}
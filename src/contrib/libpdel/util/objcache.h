@@ -0,0 +1,86 @@
+
+/*
+ * objcache.h
+ *
+ * See ``COPYRIGHT.mpd''
+ */
+
+#ifndef _PDEL_UTIL_OBJCACHE_H_
+#define _PDEL_UTIL_OBJCACHE_H_
+
+/*
+ * Cache of free fixed-size objects.
+ *
+ * Each thread that allocates has a small magazine of free objects it
+ * can use without locking. Magazines are refilled from, and overflow
+ * into, a depot shared by all threads. Objects are allocated with
+ * typed_mem(3) and stay accounted to the cache's memory type while
+ * they sit in the cache. Objects are not cleared by objcache_get().
+ */
+
+struct objcache;
+
+/*
+ * Cache statistics filled in by objcache_get_stats().
+ */
+struct objcache_stats {
+	const char	*name;		/* name given at creation */
+	size_t		size;		/* object size */
+	u_int		inuse;		/* objects handed out */
+	u_int		cached;		/* free objects in the cache */
+	u_int64_t	gets;		/* objcache_get() calls */
+	u_int64_t	hits;		/* served from a magazine */
+	u_int64_t	refills;	/* magazine refills from depot */
+	u_int64_t	misses;		/* new objects allocated */
+	u_int64_t	releases;	/* objects freed, cache full
+					   or reclaimed */
+};
+
+typedef void	objcache_walk_t(const struct objcache_stats *stats, void *arg);
+
+__BEGIN_DECLS
+
+/*
+ * Create a cache of objects of 'size' bytes allocated with memory
+ * type 'mtype'. Each thread keeps up to 'magsize' free objects and
+ * the depot up to 'maxfree'.
+ */
+extern struct	objcache *objcache_create(const char *name, const char *mtype,
+			size_t size, u_int magsize, u_int maxfree);
+
+/*
+ * Destroy a cache. All objects must have been returned. Objects in
+ * other threads' magazines are released when those threads exit.
+ */
+extern void	objcache_destroy(struct objcache **cachep);
+
+/*
+ * Get an object, or NULL with errno set if out of memory.
+ */
+extern void	*objcache_get(struct objcache *cache);
+
+/*
+ * Return an object. May be called from any thread.
+ */
+extern void	objcache_put(struct objcache *cache, void *obj);
+
+/*
+ * Get statistics for one cache.
+ */
+extern void	objcache_get_stats(struct objcache *cache,
+			struct objcache_stats *stats);
+
+/*
+ * Call 'func' with the statistics of every existing cache.
+ */
+extern void	objcache_walk(objcache_walk_t *func, void *arg);
+
+/*
+ * Free the free objects in the depot of every cache, and in the
+ * calling thread's magazines. Returns the number of bytes freed.
+ */
+extern size_t	objcache_reclaim(void);
+
+__END_DECLS
+
+#endif	/* _PDEL_UTIL_OBJCACHE_H_ */
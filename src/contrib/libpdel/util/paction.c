@@ -53,12 +53,17 @@
 #include "structs/type/array.h"
 
 #include "util/paction.h"
+#include "util/objcache.h"
 #include "util/typed_mem.h"
 
 #include "debug/debug.h"
 
 #define	PACTION_MTYPE		"paction"
 
+/* Free action object cache: per-thread magazine and shared depot sizes */
+#define PACTION_CACHE_MAG	16
+#define PACTION_CACHE_MAX	1024
+
 /* Action structure */
 struct paction {
 	pthread_t		tid;		/* action thread */
@@ -79,6 +84,11 @@ struct paction {
 /* Internal functions */
 static void	*paction_main(void *arg);
 static void	paction_cleanup(void *arg);
+static void	paction_cache_init(void);
+
+/* Internal variables */
+static struct	objcache *paction_cache;
+static pthread_once_t paction_cache_once = PTHREAD_ONCE_INIT;
 
 /*
  * Start an action.
@@ -96,7 +106,12 @@ paction_start(struct paction **actionp, pthread_mutex_t *mutex,
 	}
 
 	/* Create new action */
-	if ((action = MALLOC(PACTION_MTYPE, sizeof(*action))) == NULL)
+	pthread_once(&paction_cache_once, paction_cache_init);
+	if (paction_cache == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	if ((action = objcache_get(paction_cache)) == NULL)
 		return (-1);
 	memset(action, 0, sizeof(*action));
 	action->actionp = actionp;
@@ -107,7 +122,7 @@ paction_start(struct paction **actionp, pthread_mutex_t *mutex,
 
 	/* Create mutex */
 	if ((errno = pthread_mutex_init(&action->mutex, NULL)) != 0) {
-		FREE(PACTION_MTYPE, action);
+		objcache_put(paction_cache, action);
 		return (-1);
 	}
 
@@ -115,7 +130,7 @@ paction_start(struct paction **actionp, pthread_mutex_t *mutex,
 	if ((errno = pthread_create(&action->tid,
 	    NULL, paction_main, action)) != 0) {
 		pthread_mutex_destroy(&action->mutex);
-		FREE(PACTION_MTYPE, action);
+		objcache_put(paction_cache, action);
 		return (-1);
 	}
 	pthread_detach(action->tid);
@@ -162,6 +177,16 @@ paction_cancel(struct paction **actionp)
 	MUTEX_UNLOCK(&action->mutex, action->mutex_count);
 }
 
+/*
+ * Create the cache of free action objects.
+ */
+static void
+paction_cache_init(void)
+{
+	paction_cache = objcache_create("paction", PACTION_MTYPE,
+	    sizeof(struct paction), PACTION_CACHE_MAG, PACTION_CACHE_MAX);
+}
+
 /*
  * Action thread main entry point.
  */
@@ -261,6 +286,6 @@ canceled:
 
 	/* Destroy action */
 	pthread_mutex_destroy(&action->mutex);
-	FREE(PACTION_MTYPE, action);
+	objcache_put(paction_cache, action);
 }
 
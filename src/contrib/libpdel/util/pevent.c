@@ -45,6 +45,8 @@
 
 #include <netinet/in.h>
 
+#include <time.h>
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <syslog.h>
@@ -56,11 +58,42 @@
 #include <sched.h>
 #include <pthread.h>
 
+/*
+ * Pick the native readiness backend. poll(2) is always available
+ * as a fallback; define PEVENT_POLL_ONLY to use nothing else.
+ */
+#ifndef PEVENT_POLL_ONLY
+#if defined(__FreeBSD__) || defined(__DragonFly__) || defined(__NetBSD__) \
+    || defined(__OpenBSD__) || defined(__APPLE__)
+#define PEVENT_HAVE_KQUEUE	1
+#include <sys/event.h>
+#elif defined(__linux__)
+#define PEVENT_HAVE_EPOLL	1
+#include <sys/epoll.h>
+#endif
+#endif	/* !PEVENT_POLL_ONLY */
+
+/*
+ * Timers run off the monotonic clock so that stepping the wall clock
+ * does not make them all fire at once or stall. A coarse clock is good
+ * enough for millisecond timers and much cheaper to read.
+ */
+#ifndef PEVENT_CLOCK
+#if defined(CLOCK_MONOTONIC_FAST)
+#define PEVENT_CLOCK		CLOCK_MONOTONIC_FAST
+#elif defined(CLOCK_MONOTONIC_COARSE)
+#define PEVENT_CLOCK		CLOCK_MONOTONIC_COARSE
+#else
+#define PEVENT_CLOCK		CLOCK_MONOTONIC
+#endif
+#endif	/* !PEVENT_CLOCK */
+
 #include "structs/structs.h"
 #include "structs/type/array.h"
 #include "util/typed_mem.h"
 #include "util/mesg_port.h"
 #include "util/pevent.h"
+#include "util/objcache.h"
 #ifdef SYSLOG_FACILITY
 #define alogf(sev, fmt, arg...) syslog(sev, "%s: " fmt, __FUNCTION__ , ## arg)
 #else
@@ -73,11 +106,16 @@
 #define PEVENT_MAGIC		0x31d7699b
 #define PEVENT_CTX_MAGIC	0x7842f901
 
+/* Free event object cache: per-thread magazine and shared depot sizes */
+#define PEVENT_CACHE_MAG	64
+#define PEVENT_CACHE_MAX	4096
+
 /* Private flags */
 #define PEVENT_OCCURRED		0x8000		/* event has occurred */
 #define PEVENT_CANCELED		0x4000		/* event canceled or done */
 #define PEVENT_ENQUEUED		0x2000		/* in the ctx->events queue */
 #define PEVENT_GOT_MUTEX	0x1000		/* user mutex acquired */
+#define PEVENT_TRIGGERED	0x0800		/* triggered while dequeued */
 
 #define PEVENT_USER_FLAGS	(PEVENT_RECURRING | PEVENT_OWN_THREAD)
 
@@ -86,6 +124,54 @@
 #define WRITABLE_EVENTS		(POLLOUT | POLLWRNORM | POLLWRBAND \
 				    | POLLERR | POLLHUP | POLLNVAL)
 
+/* Readiness bits for file descriptors */
+#define PEVENT_FD_READ		0x01
+#define PEVENT_FD_WRITE		0x02
+
+/* Descriptor state flags */
+#define PEVENT_FD_DIRTY		0x01		/* on the ctx->dirty list */
+#define PEVENT_FD_DROPPED	0x02		/* interest went to zero */
+#define PEVENT_FD_ALWAYS	0x04		/* backend can't poll it */
+
+/*
+ * Per-descriptor state, indexed by file descriptor number.
+ *
+ * 'want' is the union of the READ/WRITE events registered on the
+ * descriptor and 'have' is what the backend was last told. They are
+ * reconciled by pevent_fd_sync() just before the event thread sleeps,
+ * so a recurring event that is dequeued and re-registered during one
+ * loop iteration costs no backend update at all.
+ *
+ * The event list is an SLIST because 'fdtab' is realloc()'d.
+ */
+struct pevent_fd {
+	SLIST_HEAD(, pevent)	events;		/* events on this descriptor */
+	u_char			want;		/* wanted PEVENT_FD_* bits */
+	u_char			have;		/* PEVENT_FD_* bits in backend */
+	u_char			flags;		/* PEVENT_FD_DIRTY, etc. */
+	int			poll_idx;	/* index in poll(2) fds array */
+};
+
+/*
+ * Readiness backend.
+ *
+ * update() pushes one descriptor's interest set to the backend and
+ * commit() flushes any batched updates. wait() is called without the
+ * context lock and must only touch backend private state; dispatch()
+ * is then called with the lock held to report the results through
+ * pevent_fd_ready().
+ */
+struct pevent_backend {
+	const char	*name;
+	int		(*init)(struct pevent_ctx *ctx);
+	void		(*fini)(struct pevent_ctx *ctx);
+	int		(*update)(struct pevent_ctx *ctx, int fd,
+			    struct pevent_fd *slot);
+	void		(*commit)(struct pevent_ctx *ctx);
+	int		(*wait)(struct pevent_ctx *ctx, int timeout);
+	void		(*dispatch)(struct pevent_ctx *ctx, int nready);
+};
+
 /* Event context */
 struct pevent_ctx {
 	u_int32_t		magic;		/* magic number */
@@ -98,10 +184,29 @@ struct pevent_ctx {
 	TAILQ_HEAD(, pevent)	events;		/* pending event list */
 	u_int			nevents;	/* length of 'events' list */
 	u_int			nrwevents;	/* number read/write events */
+	const struct pevent_backend *backend;	/* readiness backend */
+	int			bfd;		/* kqueue(2)/epoll(7) fd */
+	void			*bevents;	/* backend results buffer */
+	u_int			bevents_alloc;	/* allocated size of 'bevents' */
+	u_int			nchanges;	/* batched backend changes */
+	struct pevent_fd	*fdtab;		/* descriptor state, by fd */
+	int			*dirty;		/* descriptors needing sync */
+	u_int			ndirty;		/* length of 'dirty' list */
+	u_int			fdtab_alloc;	/* size of 'fdtab' and 'dirty' */
 	struct pollfd		*fds;		/* poll(2) fds array */
+	u_int			nfds;		/* used entries in 'fds' */
 	u_int			fds_alloc;	/* allocated size of 'fds' */
+	struct pevent		**timers;	/* time events, binary min-heap */
+	u_int			ntimers;	/* length of 'timers' heap */
+	u_int			timers_alloc;	/* allocated size of 'timers' */
 	const char		*mtype;		/* typed_mem(3) memory type */
 	char			mtype_buf[TYPED_MEM_TYPELEN];
+	struct timeval		now;		/* cached PEVENT_CLOCK time */
+	pevent_clock_t		*clock;		/* clock replacing PEVENT_CLOCK */
+	void			*clock_arg;	/* clock function arg */
+	u_int64_t		timer_seq;	/* orders equal expirations */
+	struct pevent_ctx_stats	stats;		/* event thread statistics */
+	struct objcache		*evcache;	/* free struct pevent's */
 	int			pipe[2];	/* event thread notify pipe */
 	u_char			notified;	/* data in the pipe */
 	u_char			has_attr;	/* 'attr' is valid */
@@ -116,13 +221,15 @@ struct pevent {
 	pevent_handler_t	*handler;	/* event handler function */
 	void			*arg;		/* event handler function arg */
 	int			flags;		/* event flags */
-	int			poll_idx;	/* index in poll(2) fds array */
 	pthread_mutex_t		*mutex;		/* user mutex, if any */
 #if PDEL_DEBUG
 	int			mutex_count;	/* mutex count */
 #endif
 	enum pevent_type	type;		/* type of this event */
 	struct timeval		when;		/* expiration for time events */
+	u_int64_t		seq;		/* when armed, see timer_seq */
+	int			heap_idx;	/* index in ctx->timers, or -1 */
+	int			slack;		/* allowed lateness, millis */
 	u_int			refs;		/* references to this event */
 	union {
 		int		fd;		/* file descriptor */
@@ -130,6 +237,7 @@ struct pevent {
 		struct mesg_port *port;		/* mesg_port */
 	}			u;
 	TAILQ_ENTRY(pevent)	next;		/* next in ctx->events */
+	SLIST_ENTRY(pevent)	fdnext;		/* next on same descriptor */
 };
 
 /* Macros */
@@ -140,8 +248,11 @@ struct pevent {
 		(ev)->flags |= PEVENT_ENQUEUED;				\
 		(ctx)->nevents++;					\
 		if ((ev)->type == PEVENT_READ				\
-		    || (ev)->type == PEVENT_WRITE)			\
+		    || (ev)->type == PEVENT_WRITE) {			\
 			(ctx)->nrwevents++;				\
+			pevent_fd_attach((ctx), (ev));			\
+		} else if ((ev)->type == PEVENT_TIME)			\
+			pevent_timer_insert((ctx), (ev));		\
 		DBG(PEVENT, "ev %p refs %d -> %d (enqueued)",		\
 		    (ev), (ev)->refs, (ev)->refs + 1);			\
 		(ev)->refs++;						\
@@ -153,8 +264,11 @@ struct pevent {
 		TAILQ_REMOVE(&(ctx)->events, (ev), next);		\
 		(ctx)->nevents--;					\
 		if ((ev)->type == PEVENT_READ				\
-		    || (ev)->type == PEVENT_WRITE)			\
+		    || (ev)->type == PEVENT_WRITE) {			\
 			(ctx)->nrwevents--;				\
+			pevent_fd_detach((ctx), (ev));			\
+		} else if ((ev)->heap_idx != -1)			\
+			pevent_timer_remove((ctx), (ev));		\
 		(ev)->flags &= ~PEVENT_ENQUEUED;			\
 		_pevent_unref(ev);					\
 	} while (0)
@@ -175,12 +289,98 @@ static void	pevent_ctx_main_cleanup(void *arg);
 static void	*pevent_ctx_execute(void *arg);
 static void	pevent_ctx_execute_cleanup(void *arg);
 static void	pevent_ctx_notify(struct pevent_ctx *ctx);
+static int	pevent_requeue(struct pevent_ctx *ctx, struct pevent *ev);
+static void	pevent_set_when(struct pevent_ctx *ctx, struct pevent *ev);
+static void	pevent_round_when(struct pevent *ev);
+static void	pevent_ctx_update_time(struct pevent_ctx *ctx);
+static void	pevent_ctx_now(struct pevent_ctx *ctx, struct timeval *now);
 static void	pevent_ctx_unref(struct pevent_ctx *ctx);
 static void	pevent_cancel(struct pevent *ev);
+static int	pevent_fd_reserve(struct pevent_ctx *ctx, int fd);
+static void	pevent_fd_attach(struct pevent_ctx *ctx, struct pevent *ev);
+static void	pevent_fd_detach(struct pevent_ctx *ctx, struct pevent *ev);
+static void	pevent_fd_dirty(struct pevent_ctx *ctx, int fd);
+static void	pevent_fd_sync(struct pevent_ctx *ctx);
+static void	pevent_fd_ready(struct pevent_ctx *ctx, int fd, int ready);
+static int	pevent_timer_reserve(struct pevent_ctx *ctx);
+static void	pevent_timer_insert(struct pevent_ctx *ctx, struct pevent *ev);
+static void	pevent_timer_remove(struct pevent_ctx *ctx, struct pevent *ev);
+static int	pevent_timer_before(const struct pevent *ev1,
+			const struct pevent *ev2);
+static void	pevent_timer_up(struct pevent_ctx *ctx, u_int i);
+static void	pevent_timer_down(struct pevent_ctx *ctx, u_int i);
+
+static int	pevent_poll_init(struct pevent_ctx *ctx);
+static void	pevent_poll_fini(struct pevent_ctx *ctx);
+static int	pevent_poll_update(struct pevent_ctx *ctx, int fd,
+			struct pevent_fd *slot);
+static int	pevent_poll_wait(struct pevent_ctx *ctx, int timeout);
+static void	pevent_poll_dispatch(struct pevent_ctx *ctx, int nready);
+#ifdef PEVENT_HAVE_KQUEUE
+static int	pevent_kqueue_init(struct pevent_ctx *ctx);
+static void	pevent_kqueue_fini(struct pevent_ctx *ctx);
+static int	pevent_kqueue_update(struct pevent_ctx *ctx, int fd,
+			struct pevent_fd *slot);
+static void	pevent_kqueue_commit(struct pevent_ctx *ctx);
+static int	pevent_kqueue_wait(struct pevent_ctx *ctx, int timeout);
+static void	pevent_kqueue_dispatch(struct pevent_ctx *ctx, int nready);
+#endif
+#ifdef PEVENT_HAVE_EPOLL
+static int	pevent_epoll_init(struct pevent_ctx *ctx);
+static void	pevent_epoll_fini(struct pevent_ctx *ctx);
+static int	pevent_epoll_update(struct pevent_ctx *ctx, int fd,
+			struct pevent_fd *slot);
+static int	pevent_epoll_wait(struct pevent_ctx *ctx, int timeout);
+static void	pevent_epoll_dispatch(struct pevent_ctx *ctx, int nready);
+#endif
 
 /* Internal variables */
 static char	pevent_byte;
 
+/* Readiness backends, in order of preference */
+#ifdef PEVENT_HAVE_KQUEUE
+static const struct pevent_backend pevent_kqueue_backend = {
+	"kqueue",
+	pevent_kqueue_init,
+	pevent_kqueue_fini,
+	pevent_kqueue_update,
+	pevent_kqueue_commit,
+	pevent_kqueue_wait,
+	pevent_kqueue_dispatch,
+};
+#endif
+#ifdef PEVENT_HAVE_EPOLL
+static const struct pevent_backend pevent_epoll_backend = {
+	"epoll",
+	pevent_epoll_init,
+	pevent_epoll_fini,
+	pevent_epoll_update,
+	NULL,
+	pevent_epoll_wait,
+	pevent_epoll_dispatch,
+};
+#endif
+static const struct pevent_backend pevent_poll_backend = {
+	"poll",
+	pevent_poll_init,
+	pevent_poll_fini,
+	pevent_poll_update,
+	NULL,
+	pevent_poll_wait,
+	pevent_poll_dispatch,
+};
+
+static const struct pevent_backend *const pevent_backends[] = {
+#ifdef PEVENT_HAVE_KQUEUE
+	&pevent_kqueue_backend,
+#endif
+#ifdef PEVENT_HAVE_EPOLL
+	&pevent_epoll_backend,
+#endif
+	&pevent_poll_backend,
+	NULL
+};
+
 /*
  * Create a new event context.
  */
@@ -191,6 +391,8 @@ pevent_ctx_create(const char *mtype, const pthread_attr_t *attr)
 	struct pevent_ctx *ctx;
 	int got_mutexattr = 0;
 	int got_mutex = 0;
+	int got_pipe = 0;
+	int i;
 
 	/* Create context object */
 	if ((ctx = MALLOC(mtype, sizeof(*ctx))) == NULL)
@@ -202,6 +404,12 @@ pevent_ctx_create(const char *mtype, const pthread_attr_t *attr)
 	}
 	TAILQ_INIT(&ctx->events);
 
+	/* Create cache for event objects */
+	if ((ctx->evcache = objcache_create("pevent", mtype,
+	    sizeof(struct pevent), PEVENT_CACHE_MAG,
+	    PEVENT_CACHE_MAX)) == NULL)
+		goto fail;
+
 	/* Copy thread attributes */
 	if (attr != NULL) {
 		struct sched_param param;
@@ -232,22 +440,40 @@ pevent_ctx_create(const char *mtype, const pthread_attr_t *attr)
 	/* Initialize notify pipe */
 	if (pipe(ctx->pipe) == -1)
 		goto fail;
+	got_pipe = 1;
+
+	/* Initialize readiness backend, falling back to poll(2) */
+	ctx->bfd = -1;
+	for (i = 0; pevent_backends[i] != NULL; i++) {
+		if ((*pevent_backends[i]->init)(ctx) == 0) {
+			ctx->backend = pevent_backends[i];
+			break;
+		}
+		alogf(LOG_WARNING, "%s: %m", pevent_backends[i]->name);
+	}
+	if (ctx->backend == NULL)
+		goto fail;
 
 	/* Finish up */
 	pthread_mutexattr_destroy(&mutexattr);
 	ctx->magic = PEVENT_CTX_MAGIC;
 	ctx->refs = 1;
-	DBG(PEVENT, "created ctx %p", ctx);
+	DBG(PEVENT, "created ctx %p (%s)", ctx, ctx->backend->name);
 	return (ctx);
 
 fail:
 	/* Clean up after failure */
+	if (got_pipe) {
+		(void)close(ctx->pipe[0]);
+		(void)close(ctx->pipe[1]);
+	}
 	if (got_mutex)
 		pthread_mutex_destroy(&ctx->mutex);
 	if (got_mutexattr)
 		pthread_mutexattr_destroy(&mutexattr);
 	if (ctx->has_attr)
 		pthread_attr_destroy(&ctx->attr);
+	objcache_destroy(&ctx->evcache);
 	FREE(mtype, ctx);
 	return (NULL);
 }
@@ -297,6 +523,46 @@ pevent_ctx_count(struct pevent_ctx *ctx)
 	return (nevents);
 }
 
+/*
+ * Return the name of the readiness backend in use.
+ */
+const char *
+pevent_ctx_backend(struct pevent_ctx *ctx)
+{
+	assert(ctx->magic == PEVENT_CTX_MAGIC);
+	return (ctx->backend->name);
+}
+
+/*
+ * Get the event thread's statistics.
+ */
+void
+pevent_ctx_get_stats(struct pevent_ctx *ctx, struct pevent_ctx_stats *stats)
+{
+	assert(ctx->magic == PEVENT_CTX_MAGIC);
+	MUTEX_LOCK(&ctx->mutex, ctx->mutex_count);
+	*stats = ctx->stats;
+	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+}
+
+/*
+ * Replace the clock time events run off.
+ *
+ * The event thread does not sleep until the next expiration of such
+ * a clock; it looks at it again when this is called.
+ */
+void
+pevent_ctx_set_clock(struct pevent_ctx *ctx, pevent_clock_t *clock, void *arg)
+{
+	assert(ctx->magic == PEVENT_CTX_MAGIC);
+	MUTEX_LOCK(&ctx->mutex, ctx->mutex_count);
+	ctx->clock = clock;
+	ctx->clock_arg = arg;
+	pevent_ctx_update_time(ctx);
+	pevent_ctx_notify(ctx);
+	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+}
+
 /*
  * Create a new schedule item.
  */
@@ -321,7 +587,7 @@ pevent_register(struct pevent_ctx *ctx, struct pevent **peventp, int flags,
 	}
 
 	/* Create new event */
-	if ((ev = MALLOC(ctx->mtype, sizeof(*ev))) == NULL)
+	if ((ev = objcache_get(ctx->evcache)) == NULL)
 		return (-1);
 	memset(ev, 0, sizeof(*ev));
 	ev->magic = PEVENT_MAGIC;
@@ -329,7 +595,7 @@ pevent_register(struct pevent_ctx *ctx, struct pevent **peventp, int flags,
 	ev->handler = handler;
 	ev->arg = arg;
 	ev->flags = flags;
-	ev->poll_idx = -1;
+	ev->heap_idx = -1;
 	ev->mutex = mutex;
 	ev->type = type;
 	ev->refs = 1;				/* the caller's reference */
@@ -349,13 +615,6 @@ pevent_register(struct pevent_ctx *ctx, struct pevent **peventp, int flags,
 		va_end(args);
 		if (ev->u.millis < 0)
 			ev->u.millis = 0;
-		gettimeofday(&ev->when, NULL);
-		ev->when.tv_sec += ev->u.millis / 1000;
-		ev->when.tv_usec += (ev->u.millis % 1000) * 1000;
-		if (ev->when.tv_usec > 1000000) {
-			ev->when.tv_sec++;
-			ev->when.tv_usec -= 1000000;
-		}
 		break;
 	case PEVENT_MESG_PORT:
 		va_start(args, type);
@@ -378,6 +637,22 @@ pevent_register(struct pevent_ctx *ctx, struct pevent **peventp, int flags,
 
 	/* Link to related object (if appropriate) */
 	switch (ev->type) {
+	case PEVENT_READ:
+	case PEVENT_WRITE:
+		if (pevent_fd_reserve(ctx, ev->u.fd) == -1) {
+			MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+			_pevent_unref(ev);
+			return (-1);
+		}
+		break;
+	case PEVENT_TIME:
+		if (pevent_timer_reserve(ctx) == -1) {
+			MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+			_pevent_unref(ev);
+			return (-1);
+		}
+		pevent_set_when(ctx, ev);
+		break;
 	case PEVENT_MESG_PORT:
 		if (_mesg_port_set_event(ev->u.port, ev) == -1) {
 			MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
@@ -418,6 +693,13 @@ pevent_register(struct pevent_ctx *ctx, struct pevent **peventp, int flags,
 	/* Add event to the pending event list */
 	PEVENT_ENQUEUE(ctx, ev);
 
+	/*
+	 * A message port only triggers its event when it goes non-empty,
+	 * so catch messages that were queued while no event was attached.
+	 */
+	if (ev->type == PEVENT_MESG_PORT && mesg_port_qlen(ev->u.port) > 0)
+		PEVENT_SET_OCCURRED(ctx, ev);
+
 	/* Unlock context */
 	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
 
@@ -486,18 +768,156 @@ pevent_trigger(struct pevent *ev)
 	if ((ev->flags & PEVENT_CANCELED) != 0)
 		goto done;
 
-	/* Mark event as having occurred */
-	PEVENT_SET_OCCURRED(ctx, ev);
+	/*
+	 * If the event is off the queue on its way to the handler, remember
+	 * the trigger; a recurring event will be requeued as occurred.
+	 */
+	if ((ev->flags & PEVENT_ENQUEUED) == 0) {
+		ev->flags |= PEVENT_TRIGGERED;
+		goto done;
+	}
 
-	/* Wake up thread if event is still in the queue */
-	if ((ev->flags & PEVENT_ENQUEUED) != 0)
-		pevent_ctx_notify(ctx);
+	/* Mark event as having occurred and wake up thread */
+	PEVENT_SET_OCCURRED(ctx, ev);
+	pevent_ctx_notify(ctx);
 
 done:
 	/* Unlock context */
 	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
 }
 
+/*
+ * Re-arm a pending time event to expire 'millis' from now.
+ *
+ * The event keeps its handler, flags and user handle, and no memory
+ * is allocated or freed. Fails with EALREADY if the event is no longer
+ * pending (e.g. its handler is about to run).
+ */
+int
+pevent_reschedule(struct pevent *ev, int millis)
+{
+	struct pevent_ctx *ctx;
+
+	/* Sanity check */
+	if (ev == NULL) {
+		errno = ENXIO;
+		return (-1);
+	}
+	assert(ev->magic == PEVENT_MAGIC);
+	if (ev->type != PEVENT_TIME) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/* Lock context */
+	ctx = ev->ctx;
+	MUTEX_LOCK(&ctx->mutex, ctx->mutex_count);
+	DBG(PEVENT, "reschedule ev %p in ctx %p", ev, ctx);
+
+	/* Event must still be waiting in the queue */
+	if ((ev->flags & (PEVENT_ENQUEUED | PEVENT_CANCELED))
+	    != PEVENT_ENQUEUED) {
+		MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+		errno = EALREADY;
+		return (-1);
+	}
+
+	/* Put expired events back on the timer heap */
+	if (ev->heap_idx == -1 && pevent_timer_reserve(ctx) == -1) {
+		MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+		return (-1);
+	}
+
+	/* Set new expiration time */
+	ev->u.millis = (millis < 0) ? 0 : millis;
+	pevent_set_when(ctx, ev);
+	if ((ev->flags & PEVENT_OCCURRED) != 0) {
+		ev->flags &= ~PEVENT_OCCURRED;
+		TAILQ_REMOVE(&ctx->events, ev, next);
+		TAILQ_INSERT_TAIL(&ctx->events, ev, next);
+	}
+	if (ev->heap_idx == -1)
+		pevent_timer_insert(ctx, ev);
+	else {
+		pevent_timer_down(ctx, ev->heap_idx);
+		pevent_timer_up(ctx, ev->heap_idx);
+	}
+	pevent_ctx_notify(ctx);
+
+	/* Unlock context */
+	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+	return (0);
+}
+
+/*
+ * Set how late a time event may expire.
+ */
+int
+pevent_set_slack(struct pevent *ev, int millis)
+{
+	struct pevent_ctx *ctx;
+
+	/* Sanity check */
+	if (ev == NULL) {
+		errno = ENXIO;
+		return (-1);
+	}
+	assert(ev->magic == PEVENT_MAGIC);
+	if (ev->type != PEVENT_TIME) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/* Lock context */
+	ctx = ev->ctx;
+	MUTEX_LOCK(&ctx->mutex, ctx->mutex_count);
+	ev->slack = (millis < 0) ? 0 : millis;
+
+	/* Expiration can only move later, no need to notify */
+	if (ev->heap_idx != -1) {
+		pevent_round_when(ev);
+		pevent_timer_down(ctx, ev->heap_idx);
+	}
+
+	/* Unlock context */
+	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+	return (0);
+}
+
+/*
+ * Get the number of milliseconds until a time event expires.
+ */
+int
+pevent_remain(struct pevent *ev)
+{
+	struct pevent_ctx *ctx;
+	struct timeval now;
+	struct timeval remain;
+	int millis;
+
+	if (ev == NULL) {
+		errno = ENXIO;
+		return (-1);
+	}
+	assert(ev->magic == PEVENT_MAGIC);
+	if (ev->type != PEVENT_TIME) {
+		errno = EINVAL;
+		return (-1);
+	}
+	ctx = ev->ctx;
+	MUTEX_LOCK(&ctx->mutex, ctx->mutex_count);
+	pevent_ctx_now(ctx, &now);
+	if (timercmp(&ev->when, &now, <=))
+		millis = 0;
+	else {
+		timersub(&ev->when, &now, &remain);
+		millis = remain.tv_sec * 1000;
+		millis += (remain.tv_usec + 999) / 1000;
+	}
+	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+	return (millis);
+}
+
 /*
  * Get event info.
  */
@@ -538,11 +958,11 @@ static void *
 pevent_ctx_main(void *arg)
 {
 	struct pevent_ctx *const ctx = arg;
-	struct timeval now;
-	struct pollfd *fd;
 	struct pevent *ev;
-	struct pevent *next_ev;
-	unsigned poll_idx;
+	struct pevent *prev_ev;
+	struct timeval woke;
+	struct timeval elapsed;
+	u_int nserviced;
 	int timeout;
 	int r;
 
@@ -557,7 +977,8 @@ pevent_ctx_main(void *arg)
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
 	/* Get current time */
-	gettimeofday(&now, NULL);
+	pevent_ctx_update_time(ctx);
+	woke = ctx->now;
 	DBG(PEVENT, "ctx %p thread starting", ctx);
 
 loop:
@@ -567,20 +988,6 @@ loop:
 		goto done;
 	}
 
-	/* Make sure ctx->fds array is long enough */
-	if (ctx->fds_alloc < 1 + ctx->nrwevents) {
-		const u_int new_alloc = roundup(1 + ctx->nrwevents, 16);
-		void *mem;
-
-		if ((mem = REALLOC(ctx->mtype, ctx->fds,
-		    new_alloc * sizeof(*ctx->fds))) == NULL)
-			alogf(LOG_ERR, "%s: %m", "realloc");
-		else {
-			ctx->fds = mem;
-			ctx->fds_alloc = new_alloc;
-		}
-	}
-
 	/* If we were intentionally woken up, read the wakeup byte */
 	if (ctx->notified) {
 		DBG(PEVENT, "ctx %p thread was notified", ctx);
@@ -588,72 +995,28 @@ loop:
 		ctx->notified = 0;
 	}
 
-	/* Add event for the notify pipe */
-	poll_idx = 0;
-	if (ctx->fds_alloc > 0) {
-		fd = &ctx->fds[poll_idx++];
-		memset(fd, 0, sizeof(*fd));
-		fd->fd = ctx->pipe[0];
-		fd->events = POLLRDNORM;
-	}
+	/* Bring the backend's interest set up to date */
+	pevent_fd_sync(ctx);
 
-	/* Fill in rest of poll() array */
+	/* Compute milliseconds until the nearest timer, rounding up */
 	timeout = INFTIM;
-	TAILQ_FOREACH(ev, &ctx->events, next) {
-		switch (ev->type) {
-		case PEVENT_READ:
-		case PEVENT_WRITE:
-		    {
-			if (poll_idx >= ctx->fds_alloc) {
-				ev->poll_idx = -1;
-				break;
-			}
-			ev->poll_idx = poll_idx++;
-			fd = &ctx->fds[ev->poll_idx];
-			memset(fd, 0, sizeof(*fd));
-			fd->fd = ev->u.fd;
-			fd->events = (ev->type == PEVENT_READ) ?
-			    POLLRDNORM : POLLWRNORM;
-			break;
-		    }
-		case PEVENT_TIME:
-		    {
-			struct timeval remain;
-			int millis;
-
-			/* Compute milliseconds until event */
-			if (timercmp(&ev->when, &now, <=))
-				millis = 0;
-			else {
-				timersub(&ev->when, &now, &remain);
-				millis = remain.tv_sec * 1000;
-				millis += remain.tv_usec / 1000;
-			}
-
-			/* Remember the minimum delay */
-			if (timeout == INFTIM || millis < timeout)
-				timeout = millis;
-			break;
-		    }
-		default:
-			break;
+	if (ctx->ntimers > 0) {
+		struct timeval remain;
+
+		ev = ctx->timers[0];
+		if (timercmp(&ev->when, &ctx->now, <=))
+			timeout = 0;
+		else if (ctx->clock == NULL) {	/* else moved by its owner */
+			timersub(&ev->when, &ctx->now, &remain);
+			timeout = remain.tv_sec * 1000;
+			timeout += (remain.tv_usec + 999) / 1000;
 		}
 	}
 
-	/* Mark non-poll() events that have occurred */
-	TAILQ_FOREACH(ev, &ctx->events, next) {
-		assert(ev->magic == PEVENT_MAGIC);
-		switch (ev->type) {
-		case PEVENT_MESG_PORT:
-			if (mesg_port_qlen(ev->u.port) > 0)
-				PEVENT_SET_OCCURRED(ctx, ev);
-			break;
-		default:
-			break;
-		}
-		if ((ev->flags & PEVENT_OCCURRED) != 0)
-			timeout = 0;			/* don't delay */
-	}
+	/* Don't delay if some events have already occurred */
+	if ((ev = TAILQ_FIRST(&ctx->events)) != NULL
+	    && (ev->flags & PEVENT_OCCURRED) != 0)
+		timeout = 0;
 
 #if PDEL_DEBUG
 	/* Debugging */
@@ -662,48 +1025,60 @@ loop:
 		DBG(PEVENT, "\tev %p", ev);
 #endif
 
+	/* Account for the time since we woke up */
+	timersub(&ctx->now, &woke, &elapsed);
+	r = elapsed.tv_sec * 1000000 + elapsed.tv_usec;
+	ctx->stats.busy_usec += r;
+	if ((u_int)r > ctx->stats.max_busy_usec)
+		ctx->stats.max_busy_usec = r;
+	woke = ctx->now;
+
 	/* Wait for something to happen */
 	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
 	DBG(PEVENT, "ctx %p thread sleeping", ctx);
-	r = poll(ctx->fds, poll_idx, timeout);
+	r = (*ctx->backend->wait)(ctx, timeout);
 	DBG(PEVENT, "ctx %p thread woke up", ctx);
 	assert(ctx->magic == PEVENT_CTX_MAGIC);
 	MUTEX_LOCK(&ctx->mutex, ctx->mutex_count);
 
 	/* Check for errors */
 	if (r == -1 && errno != EINTR) {
-		alogf(LOG_CRIT, "%s: %m", "poll");
+		alogf(LOG_CRIT, "%s: %m", ctx->backend->name);
 		assert(0);
 	}
 
-	/* Update current time */
-	gettimeofday(&now, NULL);
-
-	/* Mark poll() events that have occurred */
-	for (ev = TAILQ_FIRST((&ctx->events)); ev != NULL; ev = next_ev) {
-		next_ev = TAILQ_NEXT(ev, next);
+	/* Update current time; handlers and timers use it until we sleep */
+	pevent_ctx_update_time(ctx);
+	timersub(&ctx->now, &woke, &elapsed);
+	ctx->stats.wait_usec += elapsed.tv_sec * 1000000 + elapsed.tv_usec;
+	woke = ctx->now;
+	ctx->stats.loops++;
+
+	/* Mark descriptor events that have occurred */
+	if (r > 0)
+		(*ctx->backend->dispatch)(ctx, r);
+
+	/* Mark timer events that have expired, keeping them in order */
+	for (prev_ev = NULL; ctx->ntimers > 0
+	    && timercmp(&ctx->timers[0]->when, &ctx->now, <=); prev_ev = ev) {
+		ev = ctx->timers[0];
 		assert(ev->magic == PEVENT_MAGIC);
-		switch (ev->type) {
-		case PEVENT_READ:
-		case PEVENT_WRITE:
-			if (ev->poll_idx == -1)
-				break;
-			fd = &ctx->fds[ev->poll_idx];
-			if ((fd->revents & ((ev->type == PEVENT_READ) ?
-			    READABLE_EVENTS : WRITABLE_EVENTS)) != 0)
-				PEVENT_SET_OCCURRED(ctx, ev);
-			break;
-		case PEVENT_TIME:
-			if (timercmp(&ev->when, &now, <=))
-				PEVENT_SET_OCCURRED(ctx, ev);
-			break;
-		default:
-			break;
-		}
+		pevent_timer_remove(ctx, ev);
+		ctx->stats.timers++;
+		if (prev_ev == NULL)
+			ctx->stats.timer_wakeups++;
+		else if (ev->slack > 0)
+			ctx->stats.coalesced++;
+		ev->flags |= PEVENT_OCCURRED;
+		TAILQ_REMOVE(&ctx->events, ev, next);
+		if (prev_ev == NULL)
+			TAILQ_INSERT_HEAD(&ctx->events, ev, next);
+		else
+			TAILQ_INSERT_AFTER(&ctx->events, prev_ev, ev, next);
 	}
 
 	/* Service all events that are marked as having occurred */
-	while (1) {
+	for (nserviced = 0; ; nserviced++) {
 
 		/* Find next event that needs service */
 		ev = TAILQ_FIRST(&ctx->events);
@@ -719,6 +1094,13 @@ loop:
 		pevent_ctx_service(ev);
 	}
 
+	/* Handlers take time, so don't compute the next timeout from stale */
+	if (nserviced > 0)
+		pevent_ctx_update_time(ctx);
+	ctx->stats.serviced += nserviced;
+	if (nserviced > ctx->stats.max_serviced)
+		ctx->stats.max_serviced = nserviced;
+
 	/* Spin again */
 	DBG(PEVENT, "ctx %p thread spin again", ctx);
 	goto loop;
@@ -840,7 +1222,19 @@ try_again:
 		ev->flags |= PEVENT_GOT_MUTEX;
 	}
 
-	/* Remove user's event reference (we still have one though) */
+	/*
+	 * Recurring events handled by the event thread are put straight
+	 * back on the queue, keeping the user's reference. Otherwise remove
+	 * user's event reference (we still have one though) and register
+	 * a new event if recurring.
+	 */
+	if ((ev->flags & (PEVENT_RECURRING | PEVENT_OWN_THREAD))
+	      == PEVENT_RECURRING
+	    && ev->type != PEVENT_MESG_PORT
+	    && pevent_requeue(ctx, ev) == 0) {
+		MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
+		goto execute;
+	}
 	pevent_cancel(ev);
 
 	/* Release context mutex */
@@ -859,6 +1253,8 @@ try_again:
 			r = pevent_register(ev->ctx, ev->peventp,
 			    (ev->flags & PEVENT_USER_FLAGS), ev->mutex,
 			    ev->handler, ev->arg, ev->type, ev->u.millis);
+			if (r != -1 && ev->slack > 0)
+				(void)pevent_set_slack(*ev->peventp, ev->slack);
 			break;
 		case PEVENT_MESG_PORT:
 			r = pevent_register(ev->ctx, ev->peventp,
@@ -880,6 +1276,7 @@ try_again:
 		}
 	}
 
+execute:
 	/* Execute the handler */
 	(*ev->handler)(ev->arg);
 
@@ -899,8 +1296,10 @@ pevent_ctx_execute_cleanup(void *arg)
 
 	DBG(PEVENT, "ev %p cleanup", ev);
 	assert(ev->magic == PEVENT_MAGIC);
-	if ((ev->flags & PEVENT_GOT_MUTEX) != 0)
+	if ((ev->flags & PEVENT_GOT_MUTEX) != 0) {
+		ev->flags &= ~PEVENT_GOT_MUTEX;
 		MUTEX_UNLOCK(ev->mutex, ev->mutex_count);
+	}
 	_pevent_unref(ev);
 }
 
@@ -913,6 +1312,10 @@ static void
 pevent_ctx_notify(struct pevent_ctx *ctx)
 {
 	DBG(PEVENT, "ctx %p being notified", ctx);
+
+	/* The event thread looks at everything again before sleeping */
+	if (ctx->thread != 0 && pthread_equal(ctx->thread, pthread_self()))
+		return;
 	if (!ctx->notified) {
 		(void)write(ctx->pipe[1], &pevent_byte, 1);
 		ctx->notified = 1;
@@ -920,26 +1323,143 @@ pevent_ctx_notify(struct pevent_ctx *ctx)
 }
 
 /*
- * Cancel an event (make it so that it never gets triggered) and
- * remove the user reference to it.
+ * Put a recurring event whose handler is about to run back on the
+ * queue without allocating a new one.
  *
- * This assumes the lock is held.
+ * This assumes the mutex is locked.
  */
-static void
-pevent_cancel(struct pevent *ev)
+static int
+pevent_requeue(struct pevent_ctx *ctx, struct pevent *ev)
 {
-	DBG(PEVENT, "canceling ev %p", ev);
-	assert((ev->flags & PEVENT_CANCELED) == 0);
-	ev->flags |= PEVENT_CANCELED;
-	*ev->peventp = NULL;
-	_pevent_unref(ev);
+	struct pevent_fd *slot;
+
+	assert((ev->flags & (PEVENT_ENQUEUED | PEVENT_CANCELED)) == 0);
+	switch (ev->type) {
+	case PEVENT_READ:
+	case PEVENT_WRITE:
+		slot = &ctx->fdtab[ev->u.fd];
+		ev->flags &= ~PEVENT_OCCURRED;
+		PEVENT_ENQUEUE(ctx, ev);
+
+		/* The descriptor stayed registered, it can't have changed */
+		if (slot->want == slot->have)
+			slot->flags &= ~PEVENT_FD_DROPPED;
+		break;
+	case PEVENT_TIME:
+		if (pevent_timer_reserve(ctx) == -1)
+			return (-1);
+		pevent_set_when(ctx, ev);
+		/* fall through */
+	default:
+		ev->flags &= ~PEVENT_OCCURRED;
+		PEVENT_ENQUEUE(ctx, ev);
+		break;
+	}
+	if ((ev->flags & PEVENT_TRIGGERED) != 0) {
+		ev->flags &= ~PEVENT_TRIGGERED;
+		PEVENT_SET_OCCURRED(ctx, ev);
+	}
+	pevent_ctx_notify(ctx);
+	return (0);
 }
 
 /*
- * Returns true if the event has been canceled.
+ * Set a time event's expiration to 'u.millis' from now.
+ *
+ * This assumes the mutex is locked.
  */
-int
-_pevent_canceled(struct pevent *ev)
+static void
+pevent_set_when(struct pevent_ctx *ctx, struct pevent *ev)
+{
+	struct timeval delay;
+
+	delay.tv_sec = ev->u.millis / 1000;
+	delay.tv_usec = (ev->u.millis % 1000) * 1000;
+	pevent_ctx_now(ctx, &ev->when);
+	timeradd(&ev->when, &delay, &ev->when);
+	if (ev->slack > 0)
+		pevent_round_when(ev);
+	ev->seq = ctx->timer_seq++;
+}
+
+/*
+ * Round a time event's expiration up to a multiple of its slack,
+ * so that events with the same slack expiring close together are
+ * serviced in the same event thread wakeup.
+ */
+static void
+pevent_round_when(struct pevent *ev)
+{
+	u_int64_t ms;
+
+	if (ev->slack <= 0)
+		return;
+	ms = (u_int64_t)ev->when.tv_sec * 1000
+	    + (ev->when.tv_usec + 999) / 1000;
+	ms = (ms + ev->slack - 1) / ev->slack * ev->slack;
+	ev->when.tv_sec = ms / 1000;
+	ev->when.tv_usec = (ms % 1000) * 1000;
+}
+
+/*
+ * Read the clock into the context's cached time.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_ctx_update_time(struct pevent_ctx *ctx)
+{
+	struct timespec ts;
+
+	if (ctx->clock != NULL) {
+		(*ctx->clock)(ctx->clock_arg, &ctx->now);
+		return;
+	}
+	if (clock_gettime(PEVENT_CLOCK, &ts) == -1) {
+		alogf(LOG_CRIT, "%s: %m", "clock_gettime");
+		assert(0);
+	}
+	TIMESPEC_TO_TIMEVAL(&ctx->now, &ts);
+}
+
+/*
+ * Get the current time for timer purposes.
+ *
+ * The event thread uses the time cached once per loop iteration.
+ * Other threads may have waited a while for the lock and the event
+ * thread may have been asleep, so they read the clock.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_ctx_now(struct pevent_ctx *ctx, struct timeval *now)
+{
+	if (ctx->thread == 0 || !pthread_equal(ctx->thread, pthread_self()))
+		pevent_ctx_update_time(ctx);
+	*now = ctx->now;
+}
+
+/*
+ * Cancel an event (make it so that it never gets triggered) and
+ * remove the user reference to it.
+ *
+ * This assumes the lock is held.
+ */
+static void
+pevent_cancel(struct pevent *ev)
+{
+	DBG(PEVENT, "canceling ev %p", ev);
+	assert((ev->flags & PEVENT_CANCELED) == 0);
+	ev->flags |= PEVENT_CANCELED;
+	*ev->peventp = NULL;
+	_pevent_unref(ev);
+}
+
+/*
+ * Returns true if the event has been canceled.
+ */
+int
+_pevent_canceled(struct pevent *ev)
 {
 	assert(ev->magic == PEVENT_MAGIC);
 	return ((ev->flags & PEVENT_CANCELED) != 0);
@@ -964,7 +1484,7 @@ _pevent_unref(struct pevent *ev)
 	assert((ev->flags & PEVENT_ENQUEUED) == 0);
 	ev->magic = ~0;				/* invalidate magic number */
 	DBG(PEVENT, "freeing ev %p", ev);
-	FREE(ctx->mtype, ev);
+	objcache_put(ctx->evcache, ev);
 	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
 }
 
@@ -986,6 +1506,7 @@ pevent_ctx_unref(struct pevent_ctx *ctx)
 	assert(TAILQ_EMPTY(&ctx->events));
 	assert(ctx->nevents == 0);
 	assert(ctx->thread == 0);
+	(*ctx->backend->fini)(ctx);
 	(void)close(ctx->pipe[0]);
 	(void)close(ctx->pipe[1]);
 	MUTEX_UNLOCK(&ctx->mutex, ctx->mutex_count);
@@ -994,7 +1515,639 @@ pevent_ctx_unref(struct pevent_ctx *ctx)
 		pthread_attr_destroy(&ctx->attr);
 	ctx->magic = ~0;			/* invalidate magic number */
 	DBG(PEVENT, "freeing ctx %p", ctx);
-	FREE(ctx->mtype, ctx->fds);
+	FREE(ctx->mtype, ctx->fdtab);
+	FREE(ctx->mtype, ctx->dirty);
+	FREE(ctx->mtype, ctx->timers);
+	objcache_destroy(&ctx->evcache);
 	FREE(ctx->mtype, ctx);
 }
 
+
+/*
+ * Make sure the descriptor state table covers 'fd'.
+ *
+ * This assumes the mutex is locked.
+ */
+static int
+pevent_fd_reserve(struct pevent_ctx *ctx, int fd)
+{
+	struct pevent_fd *fdtab;
+	u_int new_alloc;
+	int *dirty;
+
+	if (fd < 0) {
+		errno = EBADF;
+		return (-1);
+	}
+	if ((u_int)fd < ctx->fdtab_alloc)
+		return (0);
+	new_alloc = roundup(fd + 1, 64);
+	if ((fdtab = REALLOC(ctx->mtype, ctx->fdtab,
+	    new_alloc * sizeof(*fdtab))) == NULL)
+		return (-1);
+	memset(fdtab + ctx->fdtab_alloc, 0,
+	    (new_alloc - ctx->fdtab_alloc) * sizeof(*fdtab));
+	ctx->fdtab = fdtab;
+	if ((dirty = REALLOC(ctx->mtype, ctx->dirty,
+	    new_alloc * sizeof(*dirty))) == NULL)
+		return (-1);
+	ctx->dirty = dirty;
+	ctx->fdtab_alloc = new_alloc;
+	return (0);
+}
+
+/*
+ * Add a READ or WRITE event to its descriptor's interest set.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_fd_attach(struct pevent_ctx *ctx, struct pevent *ev)
+{
+	struct pevent_fd *const slot = &ctx->fdtab[ev->u.fd];
+	const int bit = (ev->type == PEVENT_READ) ?
+	    PEVENT_FD_READ : PEVENT_FD_WRITE;
+
+	SLIST_INSERT_HEAD(&slot->events, ev, fdnext);
+	if ((slot->want & bit) == 0) {
+		slot->want |= bit;
+		pevent_fd_dirty(ctx, ev->u.fd);
+	}
+}
+
+/*
+ * Remove a READ or WRITE event from its descriptor's interest set.
+ *
+ * When the last event goes away the backend is not updated right away;
+ * if the descriptor is registered again before the thread sleeps (as
+ * recurring events are) the update is skipped or merged.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_fd_detach(struct pevent_ctx *ctx, struct pevent *ev)
+{
+	struct pevent_fd *const slot = &ctx->fdtab[ev->u.fd];
+	struct pevent *ev2;
+	int want = 0;
+
+	SLIST_REMOVE(&slot->events, ev, pevent, fdnext);
+	SLIST_FOREACH(ev2, &slot->events, fdnext) {
+		want |= (ev2->type == PEVENT_READ) ?
+		    PEVENT_FD_READ : PEVENT_FD_WRITE;
+	}
+	if (want != slot->want) {
+		slot->want = want;
+		if (want == 0)
+			slot->flags |= PEVENT_FD_DROPPED;
+		pevent_fd_dirty(ctx, ev->u.fd);
+	}
+}
+
+/*
+ * Put a descriptor on the list of those needing a backend update.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_fd_dirty(struct pevent_ctx *ctx, int fd)
+{
+	struct pevent_fd *const slot = &ctx->fdtab[fd];
+
+	if ((slot->flags & PEVENT_FD_DIRTY) != 0)
+		return;
+	slot->flags |= PEVENT_FD_DIRTY;
+	ctx->dirty[ctx->ndirty++] = fd;
+}
+
+/*
+ * Push all pending interest changes to the backend.
+ *
+ * A descriptor that lost all its events may have been closed and its
+ * number reused since the backend last saw it, so if it was registered
+ * again in the meantime the backend is told about it anyway.
+ *
+ * A descriptor the backend can't poll, e.g. a regular file with epoll,
+ * is always ready. It stays on the dirty list while it has events and
+ * they are marked on every pass, as poll(2) would report them.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_fd_sync(struct pevent_ctx *ctx)
+{
+	struct pevent_fd *slot;
+	u_int i, n;
+	int fd;
+
+	for (n = i = 0; i < ctx->ndirty; i++) {
+		fd = ctx->dirty[i];
+		slot = &ctx->fdtab[fd];
+		if (slot->want != slot->have
+		    || (slot->want != 0
+		      && (slot->flags & PEVENT_FD_DROPPED) != 0)) {
+			slot->flags &= ~PEVENT_FD_ALWAYS;
+			if ((*ctx->backend->update)(ctx, fd, slot) == -1) {
+				alogf(LOG_ERR, "%s: fd %d: %m",
+				    ctx->backend->name, fd);
+				ctx->dirty[n++] = fd;	/* try again later */
+				continue;
+			}
+			slot->have = slot->want;
+		}
+		if (slot->want == 0)
+			slot->flags &= ~PEVENT_FD_ALWAYS;
+		else if ((slot->flags & PEVENT_FD_ALWAYS) != 0) {
+			pevent_fd_ready(ctx, fd, slot->want);
+			slot->flags &= ~PEVENT_FD_DROPPED;
+			ctx->dirty[n++] = fd;		/* check it again */
+			continue;
+		}
+		slot->flags &= ~(PEVENT_FD_DIRTY | PEVENT_FD_DROPPED);
+	}
+	ctx->ndirty = n;
+	if (ctx->backend->commit != NULL)
+		(*ctx->backend->commit)(ctx);
+}
+
+/*
+ * Mark the events on a descriptor that became ready.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_fd_ready(struct pevent_ctx *ctx, int fd, int ready)
+{
+	struct pevent *ev;
+
+	if (fd < 0 || (u_int)fd >= ctx->fdtab_alloc)
+		return;
+	SLIST_FOREACH(ev, &ctx->fdtab[fd].events, fdnext) {
+		if ((ready & ((ev->type == PEVENT_READ) ?
+		    PEVENT_FD_READ : PEVENT_FD_WRITE)) != 0)
+			PEVENT_SET_OCCURRED(ctx, ev);
+	}
+}
+
+/*
+ * Make sure the timer heap has room for one more event.
+ *
+ * This assumes the mutex is locked.
+ */
+static int
+pevent_timer_reserve(struct pevent_ctx *ctx)
+{
+	const u_int new_alloc = roundup(ctx->ntimers + 1, 64);
+	void *mem;
+
+	if (ctx->timers_alloc >= new_alloc)
+		return (0);
+	if ((mem = REALLOC(ctx->mtype, ctx->timers,
+	    new_alloc * sizeof(*ctx->timers))) == NULL)
+		return (-1);
+	ctx->timers = mem;
+	ctx->timers_alloc = new_alloc;
+	return (0);
+}
+
+/*
+ * Add a time event to the timer heap.
+ *
+ * This assumes the mutex is locked and pevent_timer_reserve() succeeded.
+ */
+static void
+pevent_timer_insert(struct pevent_ctx *ctx, struct pevent *ev)
+{
+	assert(ev->heap_idx == -1);
+	assert(ctx->ntimers < ctx->timers_alloc);
+	ctx->timers[ctx->ntimers] = ev;
+	ev->heap_idx = ctx->ntimers++;
+	pevent_timer_up(ctx, ev->heap_idx);
+}
+
+/*
+ * Remove a time event from the timer heap.
+ *
+ * This assumes the mutex is locked.
+ */
+static void
+pevent_timer_remove(struct pevent_ctx *ctx, struct pevent *ev)
+{
+	const u_int i = ev->heap_idx;
+	struct pevent *last;
+
+	assert(ev->heap_idx >= 0 && i < ctx->ntimers);
+	assert(ctx->timers[i] == ev);
+	last = ctx->timers[--ctx->ntimers];
+	ev->heap_idx = -1;
+	if (last == ev)
+		return;
+	ctx->timers[i] = last;
+	last->heap_idx = i;
+	pevent_timer_down(ctx, i);
+	pevent_timer_up(ctx, last->heap_idx);
+}
+
+/*
+ * Timer heap order: earliest expiration first and, among equal
+ * expirations, the event armed first.
+ */
+static int
+pevent_timer_before(const struct pevent *ev1, const struct pevent *ev2)
+{
+	if (timercmp(&ev1->when, &ev2->when, !=))
+		return (timercmp(&ev1->when, &ev2->when, <));
+	return (ev1->seq < ev2->seq);
+}
+
+/*
+ * Move a timer heap entry toward the root until its parent is earlier.
+ */
+static void
+pevent_timer_up(struct pevent_ctx *ctx, u_int i)
+{
+	struct pevent **const heap = ctx->timers;
+	struct pevent *const ev = heap[i];
+	u_int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!pevent_timer_before(ev, heap[parent]))
+			break;
+		heap[i] = heap[parent];
+		heap[i]->heap_idx = i;
+		i = parent;
+	}
+	heap[i] = ev;
+	ev->heap_idx = i;
+}
+
+/*
+ * Move a timer heap entry toward the leaves until its children are later.
+ */
+static void
+pevent_timer_down(struct pevent_ctx *ctx, u_int i)
+{
+	struct pevent **const heap = ctx->timers;
+	struct pevent *const ev = heap[i];
+	u_int child;
+
+	while ((child = 2 * i + 1) < ctx->ntimers) {
+		if (child + 1 < ctx->ntimers
+		    && pevent_timer_before(heap[child + 1], heap[child]))
+			child++;
+		if (!pevent_timer_before(heap[child], ev))
+			break;
+		heap[i] = heap[child];
+		heap[i]->heap_idx = i;
+		i = child;
+	}
+	heap[i] = ev;
+	ev->heap_idx = i;
+}
+
+/*
+ * poll(2) backend.
+ *
+ * Entry zero of ctx->fds is the notify pipe, so a zero poll_idx in
+ * a descriptor's state means it is not in the array.
+ */
+static int
+pevent_poll_init(struct pevent_ctx *ctx)
+{
+	if ((ctx->fds = MALLOC(ctx->mtype, 16 * sizeof(*ctx->fds))) == NULL)
+		return (-1);
+	ctx->fds_alloc = 16;
+	memset(&ctx->fds[0], 0, sizeof(*ctx->fds));
+	ctx->fds[0].fd = ctx->pipe[0];
+	ctx->fds[0].events = POLLRDNORM;
+	ctx->nfds = 1;
+	return (0);
+}
+
+static void
+pevent_poll_fini(struct pevent_ctx *ctx)
+{
+	FREE(ctx->mtype, ctx->fds);
+	ctx->fds = NULL;
+}
+
+static int
+pevent_poll_update(struct pevent_ctx *ctx, int fd, struct pevent_fd *slot)
+{
+	struct pollfd *pfd;
+	u_int last;
+
+	/* Remove from the array by moving the last entry into the hole */
+	if (slot->want == 0) {
+		if (slot->poll_idx == 0)
+			return (0);
+		last = --ctx->nfds;
+		if ((u_int)slot->poll_idx != last) {
+			ctx->fds[slot->poll_idx] = ctx->fds[last];
+			ctx->fdtab[ctx->fds[last].fd].poll_idx = slot->poll_idx;
+		}
+		slot->poll_idx = 0;
+		return (0);
+	}
+
+	/* Add to the end of the array if not already there */
+	if (slot->poll_idx == 0) {
+		if (ctx->nfds == ctx->fds_alloc) {
+			const u_int new_alloc = roundup(ctx->nfds + 1, 16);
+			void *mem;
+
+			if ((mem = REALLOC(ctx->mtype, ctx->fds,
+			    new_alloc * sizeof(*ctx->fds))) == NULL)
+				return (-1);
+			ctx->fds = mem;
+			ctx->fds_alloc = new_alloc;
+		}
+		slot->poll_idx = ctx->nfds++;
+	}
+	pfd = &ctx->fds[slot->poll_idx];
+	memset(pfd, 0, sizeof(*pfd));
+	pfd->fd = fd;
+	if ((slot->want & PEVENT_FD_READ) != 0)
+		pfd->events |= POLLRDNORM;
+	if ((slot->want & PEVENT_FD_WRITE) != 0)
+		pfd->events |= POLLWRNORM;
+	return (0);
+}
+
+static int
+pevent_poll_wait(struct pevent_ctx *ctx, int timeout)
+{
+	return (poll(ctx->fds, ctx->nfds, timeout));
+}
+
+static void
+pevent_poll_dispatch(struct pevent_ctx *ctx, int nready)
+{
+	struct pollfd *pfd;
+	int ready;
+	u_int i;
+
+	for (i = 1; i < ctx->nfds && nready > 0; i++) {
+		pfd = &ctx->fds[i];
+		if (pfd->revents == 0)
+			continue;
+		nready--;
+		ready = 0;
+		if ((pfd->revents & READABLE_EVENTS) != 0)
+			ready |= PEVENT_FD_READ;
+		if ((pfd->revents & WRITABLE_EVENTS) != 0)
+			ready |= PEVENT_FD_WRITE;
+		pevent_fd_ready(ctx, pfd->fd, ready);
+	}
+}
+
+#ifdef PEVENT_HAVE_KQUEUE
+
+/*
+ * kqueue(2) backend.
+ *
+ * Changes are batched in ctx->bevents and submitted by
+ * pevent_kqueue_commit() with EV_RECEIPT, so that errors for
+ * descriptors closed behind our back do not disturb the wait.
+ *
+ * EVFILT_READ on a regular file is only ready before end of file;
+ * NOTE_FILE_POLL makes it always ready, as poll(2) reports it.
+ */
+#ifndef NOTE_FILE_POLL
+#define NOTE_FILE_POLL		0
+#endif
+
+static int
+pevent_kqueue_init(struct pevent_ctx *ctx)
+{
+	struct kevent kev;
+
+	if ((ctx->bevents = MALLOC(ctx->mtype,
+	    PEVENT_MAX_EVENTS * sizeof(struct kevent))) == NULL)
+		return (-1);
+	ctx->bevents_alloc = PEVENT_MAX_EVENTS;
+	if ((ctx->bfd = kqueue()) == -1)
+		goto fail;
+	EV_SET(&kev, ctx->pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+	if (kevent(ctx->bfd, &kev, 1, NULL, 0, NULL) == -1)
+		goto fail;
+	return (0);
+
+fail:
+	pevent_kqueue_fini(ctx);
+	return (-1);
+}
+
+static void
+pevent_kqueue_fini(struct pevent_ctx *ctx)
+{
+	const int errno_save = errno;
+
+	if (ctx->bfd != -1) {
+		(void)close(ctx->bfd);
+		ctx->bfd = -1;
+	}
+	FREE(ctx->mtype, ctx->bevents);
+	ctx->bevents = NULL;
+	errno = errno_save;
+}
+
+static int
+pevent_kqueue_update(struct pevent_ctx *ctx, int fd, struct pevent_fd *slot)
+{
+	struct kevent *const kevs = ctx->bevents;
+	const int dropped = (slot->flags & PEVENT_FD_DROPPED) != 0;
+	static const struct {
+		int	bit;
+		short	filter;
+		u_int	fflags;
+	} filters[] = {
+		{ PEVENT_FD_READ,	EVFILT_READ,	NOTE_FILE_POLL },
+		{ PEVENT_FD_WRITE,	EVFILT_WRITE,	0 },
+	};
+	u_int i;
+	int flags;
+
+	for (i = 0; i < sizeof(filters) / sizeof(*filters); i++) {
+		if ((slot->want & filters[i].bit) != 0) {
+			if ((slot->have & filters[i].bit) != 0 && !dropped)
+				continue;
+			flags = EV_ADD;
+		} else if ((slot->have & filters[i].bit) != 0)
+			flags = EV_DELETE;
+		else
+			continue;
+		if (ctx->nchanges == ctx->bevents_alloc)
+			pevent_kqueue_commit(ctx);
+		EV_SET(&kevs[ctx->nchanges++], fd, filters[i].filter,
+		    flags | EV_RECEIPT, filters[i].fflags, 0, NULL);
+	}
+	return (0);
+}
+
+static void
+pevent_kqueue_commit(struct pevent_ctx *ctx)
+{
+	struct kevent *const kevs = ctx->bevents;
+	const struct timespec zero = { 0, 0 };
+	int i, n;
+
+	if (ctx->nchanges == 0)
+		return;
+	n = kevent(ctx->bfd, kevs, ctx->nchanges, kevs, ctx->nchanges, &zero);
+	if (n == -1)
+		alogf(LOG_ERR, "%s: %m", "kevent");
+	for (i = 0; i < n; i++) {
+		if ((kevs[i].flags & EV_ERROR) == 0 || kevs[i].data == 0)
+			continue;
+		if (kevs[i].data == ENOENT || kevs[i].data == EBADF)
+			continue;		/* descriptor already closed */
+		errno = kevs[i].data;
+		alogf(LOG_ERR, "kevent: fd %d: %m", (int)kevs[i].ident);
+	}
+	ctx->nchanges = 0;
+}
+
+static int
+pevent_kqueue_wait(struct pevent_ctx *ctx, int timeout)
+{
+	struct timespec ts;
+
+	if (timeout == INFTIM) {
+		return (kevent(ctx->bfd, NULL, 0,
+		    ctx->bevents, ctx->bevents_alloc, NULL));
+	}
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	return (kevent(ctx->bfd, NULL, 0,
+	    ctx->bevents, ctx->bevents_alloc, &ts));
+}
+
+static void
+pevent_kqueue_dispatch(struct pevent_ctx *ctx, int nready)
+{
+	struct kevent *const kevs = ctx->bevents;
+	int i;
+
+	for (i = 0; i < nready; i++) {
+		if ((kevs[i].flags & EV_ERROR) != 0
+		    || (int)kevs[i].ident == ctx->pipe[0])
+			continue;
+		pevent_fd_ready(ctx, (int)kevs[i].ident,
+		    (kevs[i].filter == EVFILT_READ) ?
+		      PEVENT_FD_READ : PEVENT_FD_WRITE);
+	}
+}
+
+#endif	/* PEVENT_HAVE_KQUEUE */
+
+#ifdef PEVENT_HAVE_EPOLL
+
+/*
+ * epoll(7) backend.
+ */
+static int
+pevent_epoll_init(struct pevent_ctx *ctx)
+{
+	struct epoll_event ee;
+
+	if ((ctx->bevents = MALLOC(ctx->mtype,
+	    PEVENT_MAX_EVENTS * sizeof(struct epoll_event))) == NULL)
+		return (-1);
+	ctx->bevents_alloc = PEVENT_MAX_EVENTS;
+	if ((ctx->bfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		goto fail;
+	memset(&ee, 0, sizeof(ee));
+	ee.events = EPOLLIN;
+	ee.data.fd = ctx->pipe[0];
+	if (epoll_ctl(ctx->bfd, EPOLL_CTL_ADD, ctx->pipe[0], &ee) == -1)
+		goto fail;
+	return (0);
+
+fail:
+	pevent_epoll_fini(ctx);
+	return (-1);
+}
+
+static void
+pevent_epoll_fini(struct pevent_ctx *ctx)
+{
+	const int errno_save = errno;
+
+	if (ctx->bfd != -1) {
+		(void)close(ctx->bfd);
+		ctx->bfd = -1;
+	}
+	FREE(ctx->mtype, ctx->bevents);
+	ctx->bevents = NULL;
+	errno = errno_save;
+}
+
+static int
+pevent_epoll_update(struct pevent_ctx *ctx, int fd, struct pevent_fd *slot)
+{
+	struct epoll_event ee;
+	int op;
+
+	/* Removal fails harmlessly if the descriptor was already closed */
+	if (slot->want == 0) {
+		(void)epoll_ctl(ctx->bfd, EPOLL_CTL_DEL, fd, NULL);
+		return (0);
+	}
+
+	/* Add or modify, whichever the kernel says is right */
+	memset(&ee, 0, sizeof(ee));
+	if ((slot->want & PEVENT_FD_READ) != 0)
+		ee.events |= EPOLLIN;
+	if ((slot->want & PEVENT_FD_WRITE) != 0)
+		ee.events |= EPOLLOUT;
+	ee.data.fd = fd;
+	op = (slot->have != 0) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl(ctx->bfd, op, fd, &ee) == 0)
+		return (0);
+	if (op == EPOLL_CTL_MOD && errno == ENOENT)
+		op = EPOLL_CTL_ADD;
+	else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+		op = EPOLL_CTL_MOD;
+	else
+		goto fail;
+	if (epoll_ctl(ctx->bfd, op, fd, &ee) == 0)
+		return (0);
+
+fail:
+	/* Not pollable (e.g. a regular file): always ready */
+	if (errno == EPERM) {
+		slot->flags |= PEVENT_FD_ALWAYS;
+		return (0);
+	}
+	return (-1);
+}
+
+static int
+pevent_epoll_wait(struct pevent_ctx *ctx, int timeout)
+{
+	return (epoll_wait(ctx->bfd, ctx->bevents,
+	    ctx->bevents_alloc, timeout));
+}
+
+static void
+pevent_epoll_dispatch(struct pevent_ctx *ctx, int nready)
+{
+	struct epoll_event *const ees = ctx->bevents;
+	int ready;
+	int i;
+
+	for (i = 0; i < nready; i++) {
+		if (ees[i].data.fd == ctx->pipe[0])
+			continue;
+		ready = 0;
+		if ((ees[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0)
+			ready |= PEVENT_FD_READ;
+		if ((ees[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0)
+			ready |= PEVENT_FD_WRITE;
+		pevent_fd_ready(ctx, ees[i].data.fd, ready);
+	}
+}
+
+#endif	/* PEVENT_HAVE_EPOLL */
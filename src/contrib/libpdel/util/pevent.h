@@ -48,6 +48,7 @@
 struct pevent;
 struct pevent_ctx;
 struct mesg_port;
+struct timeval;
 
 #define PEVENT_MAX_EVENTS		128
 
@@ -56,6 +57,11 @@ struct mesg_port;
  */
 typedef void	pevent_handler_t(void *arg);
 
+/*
+ * Clock function type, see pevent_ctx_set_clock().
+ */
+typedef void	pevent_clock_t(void *arg, struct timeval *now);
+
 /*
  * Event types
  */
@@ -79,6 +85,22 @@ struct pevent_info {
 	}			u;
 };
 
+/*
+ * Event thread statistics filled in by pevent_ctx_get_stats().
+ * Times are measured with the event thread's cached clock.
+ */
+struct pevent_ctx_stats {
+	u_int64_t		loops;		/* loop iterations */
+	u_int64_t		serviced;	/* events serviced */
+	u_int			max_serviced;	/* most in one iteration */
+	u_int64_t		wait_usec;	/* time spent waiting */
+	u_int64_t		busy_usec;	/* time spent servicing */
+	u_int			max_busy_usec;	/* longest iteration */
+	u_int64_t		timers;		/* time events expired */
+	u_int64_t		timer_wakeups;	/* iterations expiring any */
+	u_int64_t		coalesced;	/* expired with another, slack */
+};
+
 /*
  * Event flags
  */
@@ -106,6 +128,25 @@ extern void	pevent_ctx_destroy(struct pevent_ctx **ctxp);
  */
 extern u_int	pevent_ctx_count(struct pevent_ctx *ctx);
 
+/*
+ * Return the name of the readiness backend ("kqueue", "epoll" or "poll").
+ */
+extern const char *pevent_ctx_backend(struct pevent_ctx *ctx);
+
+/*
+ * Get the event thread's statistics.
+ */
+extern void	pevent_ctx_get_stats(struct pevent_ctx *ctx,
+			struct pevent_ctx_stats *stats);
+
+/*
+ * Make time events run off 'clock' instead of the monotonic clock,
+ * e.g. a fake clock for testing; NULL restores the monotonic clock.
+ * Call again after moving a fake clock so the event thread sees it.
+ */
+extern void	pevent_ctx_set_clock(struct pevent_ctx *ctx,
+			pevent_clock_t *clock, void *arg);
+
 /*
  * Create a new event.
  */
@@ -119,6 +160,24 @@ extern int	pevent_register(struct pevent_ctx *ctx, struct pevent **peventp,
  */
 extern void	pevent_trigger(struct pevent *pevent);
 
+/*
+ * Re-arm a pending PEVENT_TIME event to expire 'millis' from now,
+ * reusing the existing event.
+ */
+extern int	pevent_reschedule(struct pevent *pevent, int millis);
+
+/*
+ * Allow a PEVENT_TIME event to expire up to 'millis' late, now and
+ * when re-armed. Expirations are rounded up to a multiple of 'millis'
+ * so that events with similar slack share one wakeup. Zero disables.
+ */
+extern int	pevent_set_slack(struct pevent *pevent, int millis);
+
+/*
+ * Get the number of milliseconds until a PEVENT_TIME event expires.
+ */
+extern int	pevent_remain(struct pevent *pevent);
+
 /*
  * Get the type and parameters for an event.
  */
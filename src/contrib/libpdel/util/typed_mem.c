@@ -51,6 +51,8 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <sys/queue.h>
 #else
 #include <sys/systm.h>
 #include <machine/stdarg.h>
@@ -88,6 +90,38 @@ struct mem_info {
 	struct mem_type	*type;			/* pointer to type info */
 };
 
+#ifndef _KERNEL
+
+/*
+ * TYPED_MEM_COUNT mode: each block starts with a header giving its
+ * type and size, and each thread keeps its own counters per type.
+ * Types past COUNT_MAXTYPES are all counted as COUNT_OVERFLOW.
+ */
+#define COUNT_MAXTYPES		512
+#define COUNT_HASHSIZE		1024		/* power of two */
+#define COUNT_OVERFLOW		"(other)"
+
+struct count_type {
+	char		name[TYPED_MEM_TYPELEN];/* string for this type */
+	const char	*key;			/* first pointer seen */
+	u_int		index;			/* index into counters */
+};
+
+struct count_hdr {
+	struct count_type	*type;
+	size_t			size;
+};
+#define COUNT_HDRLEN	roundup(sizeof(struct count_hdr), ALIGNMENT)
+
+/* Counters of one thread; only that thread writes to them */
+struct count_thread {
+	LIST_ENTRY(count_thread)	next;
+	_Atomic int64_t			count[COUNT_MAXTYPES];
+	_Atomic int64_t			total[COUNT_MAXTYPES];
+};
+
+#endif	/* !_KERNEL */
+
 /*
  * Structs type for 'struct typed_mem_stats'
  */
@@ -151,6 +185,16 @@ static u_int	tree_node_size;
 
 #ifndef _KERNEL
 static pthread_mutex_t	typed_mem_mutex;
+static int		typed_mem_mode;
+
+/* TYPED_MEM_COUNT mode */
+static _Atomic(struct count_type *) count_hash[COUNT_HASHSIZE];
+static struct count_type	*count_types[COUNT_MAXTYPES];
+static u_int			count_ntypes;
+static pthread_key_t		count_key;
+static LIST_HEAD(, count_thread) count_threads
+				    = LIST_HEAD_INITIALIZER(count_threads);
+static int64_t			count_gone[2][COUNT_MAXTYPES];
 #endif
 
 /* Guard bytes. Should have an "aligned" length. */
@@ -172,6 +216,16 @@ static struct		mem_info *typed_mem_find(
 
 #ifndef _KERNEL
 static gtree_print_t	mem_print;
+
+static void		*typed_mem_count_realloc(const char *typename,
+				void *mem, size_t size);
+static void		typed_mem_count_free(void *mem);
+static int		typed_mem_count_usage(struct typed_mem_stats *stats);
+static struct		count_type *count_type_get(const char *typename);
+static void		count_add(struct count_type *type,
+				int64_t count, int64_t total);
+static void		count_thread_destroy(void *arg);
+static int		count_stats_cmp(const void *v1, const void *v2);
 #else
 #define mem_print	NULL
 #endif
@@ -181,6 +235,15 @@ static gtree_print_t	mem_print;
  */
 int
 typed_mem_enable(void)
+{
+	return (typed_mem_enable_mode(TYPED_MEM_FULL));
+}
+
+/*
+ * Enable typed memory in the given accounting mode.
+ */
+int
+typed_mem_enable_mode(int mode)
 {
 	pthread_mutexattr_t mattr;
 	int i;
@@ -189,6 +252,15 @@ typed_mem_enable(void)
 	if (typed_mem_enabled)
 		return (0);
 
+#ifndef _KERNEL
+	if (mode != TYPED_MEM_FULL && mode != TYPED_MEM_COUNT) {
+#else
+	if (mode != TYPED_MEM_FULL) {
+#endif
+		errno = EINVAL;
+		return (-1);
+	}
+
 	/* Already started allocating memory? */
 	if (typed_mem_started) {
 		errno = EALREADY;
@@ -209,6 +281,17 @@ typed_mem_enable(void)
 	}
 	pthread_mutexattr_destroy(&mattr);
 
+#ifndef _KERNEL
+	/* Per thread counters */
+	if (mode == TYPED_MEM_COUNT
+	    && (errno = pthread_key_create(&count_key,
+	      count_thread_destroy)) != 0) {
+		pthread_mutex_destroy(&typed_mem_mutex);
+		return (-1);
+	}
+	typed_mem_mode = mode;
+#endif
+
 	/* Fill in guard bytes */
 	for (i = 0; i < (int)ALIGNMENT; i++) {
 		typed_mem_guard[i] = typed_mem_guard_data[
@@ -243,6 +326,10 @@ typed_mem_realloc(
 	typed_mem_started = 1;
 	if (!typed_mem_enabled || typename == NULL)
 		return (realloc(mem, size));
+#ifndef _KERNEL
+	if (typed_mem_mode == TYPED_MEM_COUNT)
+		return (typed_mem_count_realloc(typename, mem, size));
+#endif
 
 	/* Lock info */
 	r = pthread_mutex_lock(&typed_mem_mutex);
@@ -439,6 +526,13 @@ typed_mem_free(
 		free(mem);
 		return;
 	}
+#ifndef _KERNEL
+	if (typed_mem_mode == TYPED_MEM_COUNT) {
+		typed_mem_count_free(mem);
+		errno = errno_save;
+		return;
+	}
+#endif
 
 	/* Lock info */
 	r = pthread_mutex_lock(&typed_mem_mutex);
@@ -608,6 +702,15 @@ typed_mem_type(void *mem, char *typebuf)
 		errno = ENXIO;
 		return (NULL);
 	}
+#ifndef _KERNEL
+	if (typed_mem_mode == TYPED_MEM_COUNT) {
+		const struct count_hdr *const hdr = (const struct count_hdr *)
+		    (void *)((u_char *)mem - COUNT_HDRLEN);
+
+		strlcpy(typebuf, hdr->type->name, TYPED_MEM_TYPELEN);
+		return (typebuf);
+	}
+#endif
 
 	/* Lock info */
 	r = pthread_mutex_lock(&typed_mem_mutex);
@@ -652,6 +755,10 @@ typed_mem_usage(struct typed_mem_stats *stats)
 		errno = ENXIO;
 		return (-1);
 	}
+#ifndef _KERNEL
+	if (typed_mem_mode == TYPED_MEM_COUNT)
+		return (typed_mem_count_usage(stats));
+#endif
 
 	/* Lock info */
 	r = pthread_mutex_lock(&typed_mem_mutex);
@@ -707,6 +814,30 @@ typed_mem_dump(FILE *fp)
 		fprintf(fp, "Typed memory is not enabled.\n");
 		return;
 	}
+	if (typed_mem_mode == TYPED_MEM_COUNT) {
+		struct typed_mem_stats stats;
+		int i;
+
+		if (typed_mem_usage(&stats) == -1) {
+			fprintf(fp, "Typed memory usage: %s\n",
+			    strerror(errno));
+			return;
+		}
+		fprintf(fp, "   %-28s %10s %10s\n", "Type", "Count", "Total");
+		fprintf(fp, "   %-28s %10s %10s\n", "----", "-----", "-----");
+		for (i = 0; i < (int)stats.length; i++) {
+			fprintf(fp, "   %-28s %10u %10lu\n",
+			    stats.elems[i].type, stats.elems[i].allocs,
+			    (u_long)stats.elems[i].bytes);
+			total_blocks += stats.elems[i].allocs;
+			total_alloc += stats.elems[i].bytes;
+		}
+		fprintf(fp, "   %-28s %10s %10s\n", "", "-----", "-----");
+		fprintf(fp, "   %-28s %10lu %10lu\n",
+		    "Totals", total_blocks, total_alloc);
+		structs_free(&typed_mem_stats_type, NULL, &stats);
+		return;
+	}
 
 	/* Print header */
 	fprintf(fp, "   %-28s %10s %10s\n", "Type", "Count", "Total");
@@ -867,5 +998,245 @@ mem_print(struct gtree *g, const void *item)
 	return (buf);
 }
 
-#endif	/* !_KERNEL */
+/*
+ * realloc(3) replacement in TYPED_MEM_COUNT mode.
+ */
+static void *
+typed_mem_count_realloc(const char *typename, void *mem, size_t size)
+{
+	struct count_type *type;
+	struct count_hdr *hdr;
+
+	if (mem == NULL) {
+		if ((type = count_type_get(typename)) == NULL)
+			return (NULL);
+		if ((hdr = malloc(COUNT_HDRLEN + size)) == NULL)
+			return (NULL);
+		hdr->type = type;
+		hdr->size = size;
+		count_add(type, 1, size);
+	} else {
+		size_t osize;
+
+		hdr = (struct count_hdr *)(void *)((u_char *)mem - COUNT_HDRLEN);
+		osize = hdr->size;
+		if ((hdr = realloc(hdr, COUNT_HDRLEN + size)) == NULL)
+			return (NULL);
+		hdr->size = size;
+		count_add(hdr->type, 0, (int64_t)size - (int64_t)osize);
+	}
+	return ((u_char *)hdr + COUNT_HDRLEN);
+}
+
+/*
+ * free(3) replacement in TYPED_MEM_COUNT mode.
+ */
+static void
+typed_mem_count_free(void *mem)
+{
+	struct count_hdr *const hdr
+	    = (struct count_hdr *)(void *)((u_char *)mem - COUNT_HDRLEN);
+
+	count_add(hdr->type, -1, -(int64_t)hdr->size);
+	free(hdr);
+}
+
+/*
+ * Add up the counters of all threads.
+ */
+static int
+typed_mem_count_usage(struct typed_mem_stats *stats)
+{
+	struct count_thread *ct;
+	int64_t count, total;
+	u_int i, n;
+	int r;
+
+	/* Lock info */
+	r = pthread_mutex_lock(&typed_mem_mutex);
+	assert(r == 0);
+
+	/* Allocate array */
+	memset(stats, 0, sizeof(*stats));
+	if ((stats->elems = typed_mem_realloc(
+#if TYPED_MEM_TRACE
+	    __FILE__, __LINE__,
+#endif
+	    TYPED_MEM_STATS_MTYPE, NULL, (count_ntypes + 1)
+	    * sizeof(*stats->elems))) == NULL) {
+		r = pthread_mutex_unlock(&typed_mem_mutex);
+		assert(r == 0);
+		return (-1);
+	}
+
+	/* Types only in use now are reported, like in TYPED_MEM_FULL mode */
+	for (n = i = 0; i < COUNT_MAXTYPES; i++) {
+		struct typed_mem_typestats *const elem = &stats->elems[n];
+
+		if (count_types[i] == NULL)
+			continue;
+		count = count_gone[0][i];
+		total = count_gone[1][i];
+		LIST_FOREACH(ct, &count_threads, next) {
+			count += atomic_load_explicit(&ct->count[i],
+			    memory_order_relaxed);
+			total += atomic_load_explicit(&ct->total[i],
+			    memory_order_relaxed);
+		}
+		if (count <= 0)
+			continue;
+		strlcpy(elem->type, count_types[i]->name, sizeof(elem->type));
+		elem->allocs = count;
+		elem->bytes = total;
+		n++;
+	}
+	stats->length = n;
+
+	/* Unlock info */
+	r = pthread_mutex_unlock(&typed_mem_mutex);
+	assert(r == 0);
+
+	qsort(stats->elems, stats->length, sizeof(*stats->elems),
+	    count_stats_cmp);
+	return (0);
+}
+
+/*
+ * Find or create a type descriptor.
+ */
+static struct count_type *
+count_type_get(const char *typename)
+{
+	struct count_type *type;
+	u_int32_t hash = 0;
+	const u_char *s;
+	u_int i;
+	int r;
 
+	for (s = (const u_char *)typename;
+	    *s != '\0' && s - (const u_char *)typename < TYPED_MEM_TYPELEN - 1;
+	    s++)
+		hash = hash * 31 + *s;
+
+	/* Lock-free lookup; types are never removed */
+	for (i = hash; ; i++) {
+		type = atomic_load_explicit(&count_hash[i % COUNT_HASHSIZE],
+		    memory_order_acquire);
+		if (type == NULL)
+			break;
+		if (type->key == typename || strncmp(type->name, typename,
+		    TYPED_MEM_TYPELEN - 1) == 0)
+			return (type);
+	}
+
+	/* Not found, add it */
+	r = pthread_mutex_lock(&typed_mem_mutex);
+	assert(r == 0);
+	for (i = hash; ; i++) {
+		type = atomic_load_explicit(&count_hash[i % COUNT_HASHSIZE],
+		    memory_order_relaxed);
+		if (type == NULL)
+			break;
+		if (strncmp(type->name, typename, TYPED_MEM_TYPELEN - 1) == 0)
+			goto done;
+	}
+	if (count_ntypes == COUNT_MAXTYPES - 1) {
+		/* The last slot is shared by everything else */
+		if ((type = count_types[COUNT_MAXTYPES - 1]) != NULL)
+			goto done;
+		typename = COUNT_OVERFLOW;
+	}
+	if ((type = malloc(sizeof(*type))) == NULL)
+		goto done;
+	strlcpy(type->name, typename, sizeof(type->name));
+	type->key = typename;
+	type->index = count_ntypes;
+	if (count_ntypes < COUNT_MAXTYPES - 1) {
+		count_types[count_ntypes++] = type;
+		atomic_store_explicit(&count_hash[i % COUNT_HASHSIZE], type,
+		    memory_order_release);
+	} else
+		count_types[COUNT_MAXTYPES - 1] = type;
+done:
+	r = pthread_mutex_unlock(&typed_mem_mutex);
+	assert(r == 0);
+	return (type);
+}
+
+/*
+ * Update this thread's counters for a type.
+ */
+static void
+count_add(struct count_type *type, int64_t count, int64_t total)
+{
+	struct count_thread *ct;
+	const u_int i = type->index;
+	int r;
+
+	if ((ct = pthread_getspecific(count_key)) == NULL) {
+		if ((ct = malloc(sizeof(*ct))) != NULL) {
+			memset(ct, 0, sizeof(*ct));
+			if (pthread_setspecific(count_key, ct) != 0) {
+				free(ct);
+				ct = NULL;
+			}
+		}
+		r = pthread_mutex_lock(&typed_mem_mutex);
+		assert(r == 0);
+		if (ct == NULL) {
+			count_gone[0][i] += count;
+			count_gone[1][i] += total;
+		} else
+			LIST_INSERT_HEAD(&count_threads, ct, next);
+		r = pthread_mutex_unlock(&typed_mem_mutex);
+		assert(r == 0);
+		if (ct == NULL)
+			return;
+	}
+
+	/* Single writer, so no need for atomic read-modify-write */
+	atomic_store_explicit(&ct->count[i], atomic_load_explicit(
+	    &ct->count[i], memory_order_relaxed) + count,
+	    memory_order_relaxed);
+	atomic_store_explicit(&ct->total[i], atomic_load_explicit(
+	    &ct->total[i], memory_order_relaxed) + total,
+	    memory_order_relaxed);
+}
+
+/*
+ * Fold an exiting thread's counters into the totals.
+ */
+static void
+count_thread_destroy(void *arg)
+{
+	struct count_thread *const ct = arg;
+	u_int i;
+	int r;
+
+	r = pthread_mutex_lock(&typed_mem_mutex);
+	assert(r == 0);
+	for (i = 0; i < COUNT_MAXTYPES; i++) {
+		count_gone[0][i] += atomic_load_explicit(&ct->count[i],
+		    memory_order_relaxed);
+		count_gone[1][i] += atomic_load_explicit(&ct->total[i],
+		    memory_order_relaxed);
+	}
+	LIST_REMOVE(ct, next);
+	r = pthread_mutex_unlock(&typed_mem_mutex);
+	assert(r == 0);
+	free(ct);
+}
+
+/*
+ * Sort statistics by type string.
+ */
+static int
+count_stats_cmp(const void *v1, const void *v2)
+{
+	const struct typed_mem_typestats *const s1 = v1;
+	const struct typed_mem_typestats *const s2 = v2;
+
+	return (strcmp(s1->type, s2->type));
+}
+
+#endif	/* !_KERNEL */
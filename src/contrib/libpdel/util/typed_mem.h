@@ -61,6 +61,15 @@
  */
 #define TYPED_MEM_TYPELEN	24
 
+/*
+ * Accounting modes. TYPED_MEM_FULL keeps every block in a tree and
+ * checks types and guard bytes on each operation; it is meant for
+ * debugging. TYPED_MEM_COUNT only keeps per-type block and byte
+ * counters, per thread, which are added up when statistics are read.
+ */
+#define TYPED_MEM_FULL		0
+#define TYPED_MEM_COUNT		1
+
 /*
  * Define this to print all (de)allocations to stderr. Doing
  * so requires rebuilding the entire library and all user code.
@@ -169,6 +178,7 @@ extern int	typed_mem_vasprintf(const char *type, char **ret,
 
 /* Typed memory must be enabled by calling this function before any ops */
 extern int	typed_mem_enable(void);
+extern int	typed_mem_enable_mode(int mode);
 
 /* Typed statistics routines */
 extern char	*typed_mem_type(void *mem, char *typebuf);
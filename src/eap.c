@@ -427,7 +427,7 @@ EapRadiusProxy(Link l, AuthData auth, const u_char *pkt, u_short len)
   lh.id = auth->id;
   lh.length = htons(len + sizeof(lh));
 
-  auth->params.eapmsg = Malloc(MB_AUTH, len + sizeof(lh));
+  auth->params.eapmsg = MallocRaw(MB_AUTH, len + sizeof(lh));
   memcpy(auth->params.eapmsg, &lh, sizeof(lh));
   memcpy(&auth->params.eapmsg[sizeof(lh)], pkt, len);
 
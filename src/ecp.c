@@ -202,10 +202,11 @@ EcpsShutdown(void)
 void
 EcpInit(Bund b)
 {
-  EcpState	ecp = &b->ecp;
+  EcpState	ecp;
 
 /* Init ECP state for this bundle */
 
+  ecp = b->ecp = Malloc(MB_CRYPT, sizeof(*ecp));
   memset(ecp, 0, sizeof(*ecp));
   FsmInit(&ecp->fsm, &gEcpFsmType, b);
   ecp->fsm.conf.maxfailure = ECP_MAXFAILURE;
@@ -236,11 +237,54 @@ EcpInit(Bund b)
 void
 EcpInst(Bund b, Bund bt)
 {
-  EcpState	ecp = &b->ecp;
+  EcpState	ecp;
+
+/* Instances that can't negotiate ECP don't need its state */
+  if (bt->ecp == NULL ||
+      (!b->tmpl && !Enabled(&b->conf.options, BUND_CONF_ENCRYPTION))) {
+    b->ecp = NULL;
+    return;
+  }
 
 /* Init ECP state for this bundle */
-  memcpy(ecp, &bt->ecp, sizeof(*ecp));
-  FsmInst(&ecp->fsm, &bt->ecp.fsm, b);
+  ecp = b->ecp = Mdup(MB_CRYPT, bt->ecp, sizeof(*ecp));
+  FsmInst(&ecp->fsm, &bt->ecp->fsm, b);
+}
+
+/*
+ * EcpGet()
+ *
+ * ECP state of a bundle, allocated if it had none so far. An instance
+ * gets its template's configuration, as EcpInst() would have given it.
+ */
+
+EcpState
+EcpGet(Bund b)
+{
+  Bund	bt;
+
+  if (b->ecp != NULL)
+    return (b->ecp);
+  if (b->parent >= 0 && (bt = gBundles[b->parent])->ecp != NULL) {
+    b->ecp = Mdup(MB_CRYPT, bt->ecp, sizeof(*b->ecp));
+    FsmInst(&b->ecp->fsm, &bt->ecp->fsm, b);
+  } else
+    EcpInit(b);
+  return (b->ecp);
+}
+
+/*
+ * EcpShutdown()
+ */
+
+void
+EcpShutdown(Bund b)
+{
+  if (b->ecp == NULL)
+    return;
+  TimerStop(&b->ecp->fsm.timer);
+  Freee(b->ecp);
+  b->ecp = NULL;
 }
 
 /*
@@ -251,7 +295,7 @@ static void
 EcpConfigure(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   unsigned	k;
 
   for (k = 0; k < ECP_NUM_PROTOS; k++)
@@ -275,7 +319,7 @@ static void
 EcpUnConfigure(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   unsigned	k;
 
   for (k = 0; k < ECP_NUM_PROTOS; k++)
@@ -342,7 +386,8 @@ EcpNgDataEvent(int type, void *cookie)
 	b1 = bundname;
 	bundname++;
 	id = strtol(bundname, &rest, 10);
-	if (rest[0] != 0 || !gBundles[id] || gBundles[id]->dead) {
+	if (rest[0] != 0 || id < 0 || id >= gNumBundles || !gBundles[id]
+	    || gBundles[id]->dead) {
     	    Log(LG_ERR, ("ECP: Packet from unexisting bundle \"%s\"",
 		bundname));
 	    mbfree(bp);
@@ -351,6 +396,13 @@ EcpNgDataEvent(int type, void *cookie)
 		
 	b = gBundles[id];
 
+	/* Stale frame, e.g. the slot now has a bundle without ECP */
+	if (b->ecp == NULL) {
+	    Log(LG_ERR, ("[%s] ECP: Packet for bundle without ECP", b->name));
+	    mbfree(bp);
+	    continue;
+	}
+
 	/* Packet requiring compression */
 	if (b1[0] == 'e') {
 	    bp = EcpDataOutput(b, bp);
@@ -373,7 +425,7 @@ EcpNgDataEvent(int type, void *cookie)
 Mbuf
 EcpDataOutput(Bund b, Mbuf plain)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   Mbuf		cypher;
 
   LogDumpBp(LG_FRAME, plain, "[%s] %s: xmit plain", Pref(&ecp->fsm), Fsm(&ecp->fsm));
@@ -404,7 +456,7 @@ EcpDataOutput(Bund b, Mbuf plain)
 Mbuf
 EcpDataInput(Bund b, Mbuf cypher)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   Mbuf		plain;
 
   LogDumpBp(LG_FRAME, cypher, "[%s] %s: recv cypher", Pref(&ecp->fsm), Fsm(&ecp->fsm));
@@ -441,7 +493,7 @@ EcpDataInput(Bund b, Mbuf cypher)
 void
 EcpUp(Bund b)
 {
-  FsmUp(&b->ecp.fsm);
+  FsmUp(&b->ecp->fsm);
 }
 
 /*
@@ -451,7 +503,7 @@ EcpUp(Bund b)
 void
 EcpDown(Bund b)
 {
-  FsmDown(&b->ecp.fsm);
+  FsmDown(&b->ecp->fsm);
 }
 
 /*
@@ -461,7 +513,7 @@ EcpDown(Bund b)
 void
 EcpOpen(Bund b)
 {
-  FsmOpen(&b->ecp.fsm);
+  FsmOpen(&b->ecp->fsm);
 }
 
 /*
@@ -471,7 +523,7 @@ EcpOpen(Bund b)
 void
 EcpClose(Bund b)
 {
-  FsmClose(&b->ecp.fsm);
+  FsmClose(&b->ecp->fsm);
 }
 
 /*
@@ -483,7 +535,7 @@ EcpOpenCmd(Context ctx)
 {
     if (ctx->bund->tmpl)
 	Error("impossible to open template");
-    FsmOpen(&ctx->bund->ecp.fsm);
+    FsmOpen(&EcpGet(ctx->bund)->fsm);
     return (0);
 }
 
@@ -496,7 +548,7 @@ EcpCloseCmd(Context ctx)
 {
     if (ctx->bund->tmpl)
 	Error("impossible to close template");
-    FsmClose(&ctx->bund->ecp.fsm);
+    FsmClose(&EcpGet(ctx->bund)->fsm);
     return (0);
 }
 
@@ -525,12 +577,16 @@ EcpFailure(Fsm fp, enum fsmfail reason)
 int
 EcpStat(Context ctx, int ac, const char *const av[], const void *arg)
 {
-  EcpState	const ecp = &ctx->bund->ecp;
+  EcpState	const ecp = ctx->bund->ecp;
 
   (void)ac;
   (void)av;
   (void)arg;
 
+  if (ecp == NULL) {
+    Printf("[%s] ECP is not in use\r\n", ctx->bund->name);
+    return(0);
+  }
   Printf("[%s] %s [%s]\r\n", Pref(&ecp->fsm), Fsm(&ecp->fsm), FsmStateName(ecp->fsm.state));
   Printf("Enabled protocols:\r\n");
   OptStat(ctx, &ecp->options, gConfList);
@@ -555,7 +611,7 @@ void
 EcpSendResetReq(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   EncType	const et = ecp->recv;
   Mbuf		bp = NULL;
 
@@ -575,7 +631,7 @@ void
 EcpRecvResetReq(Fsm fp, int id, Mbuf bp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   EncType	const et = ecp->xmit;
 
   ecp->xmit_resets++;
@@ -592,7 +648,7 @@ static void
 EcpRecvResetAck(Fsm fp, int id, Mbuf bp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   EncType	const et = ecp->recv;
 
   if (et && et->RecvResetAck)
@@ -606,7 +662,7 @@ EcpRecvResetAck(Fsm fp, int id, Mbuf bp)
 void
 EcpInput(Bund b, Mbuf bp)
 {
-  FsmInput(&b->ecp.fsm, bp);
+  FsmInput(&b->ecp->fsm, bp);
 }
 
 /*
@@ -617,7 +673,7 @@ static u_char *
 EcpBuildConfigReq(Fsm fp, u_char *cp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   unsigned	type;
 
 /* Put in all options that peer hasn't rejected */
@@ -646,7 +702,7 @@ static void
 EcpLayerUp(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   struct ngm_connect    cn;
 
   /* Initialize */
@@ -702,7 +758,7 @@ static void
 EcpLayerDown(Fsm fp)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
 
   /* Update PPP node config */
   b->pppConfig.bund.enableEncryption = 0;
@@ -743,7 +799,7 @@ static void
 EcpDecodeConfig(Fsm fp, FsmOption list, int num, int mode)
 {
     Bund 	b = (Bund)fp->arg;
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   u_int		ackSizeSave, rejSizeSave;
   int		k, rej;
 
@@ -819,7 +875,7 @@ EcpDecodeConfig(Fsm fp, FsmOption list, int num, int mode)
 int
 EcpSubtractBloat(Bund b, int size)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
 
   /* Check transmit encryption */
   if (OPEN_STATE(ecp->fsm.state) && ecp->xmit && ecp->xmit->SubtractBloat)
@@ -840,7 +896,7 @@ EcpSubtractBloat(Bund b, int size)
 static int
 EcpSetCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
-  EcpState	const ecp = &ctx->bund->ecp;
+  EcpState	const ecp = EcpGet(ctx->bund);
 
   if (ac == 0)
     return(-1);
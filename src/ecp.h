@@ -74,6 +74,8 @@
 
   extern void	EcpInit(Bund b);
   extern void	EcpInst(Bund b, Bund bt);
+  extern EcpState	EcpGet(Bund b);
+  extern void	EcpShutdown(Bund b);
   extern void	EcpUp(Bund b);
   extern void	EcpDown(Bund b);
   extern void	EcpOpen(Bund b);
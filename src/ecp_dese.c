@@ -63,7 +63,7 @@
 static int
 DesInit(Bund b, int dir)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DesInfo	const des = &ecp->des;
 
   switch (dir) {
@@ -87,7 +87,7 @@ DesInit(Bund b, int dir)
 static void
 DesConfigure(Bund b)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DesInfo	const des = &ecp->des;
   DES_cblock	key;
 
@@ -113,7 +113,7 @@ DesSubtractBloat(Bund b, int size)
 static int
 DesStat(Context ctx, int dir) 
 {
-    EcpState	const ecp = &ctx->bund->ecp;
+    EcpState	const ecp = ctx->bund->ecp;
     DesInfo	const des = &ecp->des;
     
     switch (dir) {
@@ -158,34 +158,30 @@ DesStat(Context ctx, int dir)
 Mbuf
 DesEncrypt(Bund b, Mbuf plain)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DesInfo	const des = &ecp->des;
   const int	plen = MBLEN(plain);
   int		padlen = roundup2(plen, 8) - plen;
   int		clen = plen + padlen;
+  u_char	pad[8];
+  u_char	seq[DES_OVERHEAD];
   Mbuf		cypher;
   int		k;
 
   des->xmit_stats.FramesIn++;
   des->xmit_stats.OctetsIn += plen;
 
-/* Get mbuf for encrypted frame */
+/* Pad plaintext and prepend sequence number, in place if there is room */
 
-  cypher = mballoc(DES_OVERHEAD + clen);
+  memset(pad, 0, sizeof(pad));
+  cypher = mbappend(plain, pad, padlen);
 
-/* Copy in sequence number */
-
-  MBDATAU(cypher)[0] = des->xmit_seq >> 8;
-  MBDATAU(cypher)[1] = des->xmit_seq & 0xff;
+  seq[0] = des->xmit_seq >> 8;
+  seq[1] = des->xmit_seq & 0xff;
   des->xmit_seq++;
+  cypher = mbprepend(cypher, seq, sizeof(seq));
 
-/* Copy in plaintext */
-
-  mbcopy(plain, 0, MBDATA(cypher) + DES_OVERHEAD, plen);
-  
-  cypher->cnt = DES_OVERHEAD + clen;
-  
-/* Copy in plaintext and encrypt it */
+/* Encrypt it */
   
   for (k = 0; k < clen; k += 8)
   {
@@ -200,7 +196,6 @@ DesEncrypt(Bund b, Mbuf plain)
 
 /* Return cyphertext */
 
-  mbfree(plain);
   return(cypher);
 }
 
@@ -211,7 +206,7 @@ DesEncrypt(Bund b, Mbuf plain)
 Mbuf
 DesDecrypt(Bund b, Mbuf cypher)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DesInfo	des = &ecp->des;
   const int	clen = MBLEN(cypher) - DES_OVERHEAD;
   u_int16_t	seq;
@@ -280,7 +275,7 @@ DesDecrypt(Bund b, Mbuf cypher)
 static void
 DesCleanup(Bund b, int dir)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DesInfo	const des = &ecp->des;
   
   if (dir == ECP_DIR_RECV)
@@ -300,7 +295,7 @@ DesCleanup(Bund b, int dir)
 static u_char *
 DesBuildConfigReq(Bund b, u_char *cp)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DesInfo	const des = &ecp->des;
 
   ((u_int32_t *)(void *) des->xmit_ivec)[0] = random();
@@ -316,7 +311,7 @@ static void
 DesDecodeConfigReq(Fsm fp, FsmOption opt, int mode)
 {
     Bund 	b = (Bund)fp->arg;
-  DesInfo	const des = &b->ecp.des;
+  DesInfo	const des = &b->ecp->des;
 
   if (opt->len != 10)
   {
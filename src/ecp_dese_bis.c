@@ -63,7 +63,7 @@
 static int
 DeseBisInit(Bund b, int dir)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DeseBisInfo	const des = &ecp->desebis;
 
   switch (dir) {
@@ -87,7 +87,7 @@ DeseBisInit(Bund b, int dir)
 static void
 DeseBisConfigure(Bund b)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DeseBisInfo	const des = &ecp->desebis;
   DES_cblock	key;
 
@@ -114,7 +114,7 @@ DeseBisSubtractBloat(Bund b, int size)
 static int
 DeseBisStat(Context ctx, int dir) 
 {
-    EcpState	const ecp = &ctx->bund->ecp;
+    EcpState	const ecp = ctx->bund->ecp;
     DeseBisInfo	const des = &ecp->desebis;
     
     switch (dir) {
@@ -159,46 +159,41 @@ DeseBisStat(Context ctx, int dir)
 Mbuf
 DeseBisEncrypt(Bund b, Mbuf plain)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DeseBisInfo	const des = &ecp->desebis;
   const int	plen = MBLEN(plain);
   int		padlen = roundup2(plen + 1, 8) - plen;
   int		clen = plen + padlen;
+  u_char	pad[8];
+  u_char	seq[DES_OVERHEAD];
+  u_char	last;
   Mbuf		cypher;
   int		k;
 
   des->xmit_stats.FramesIn++;
   des->xmit_stats.OctetsIn += plen;
 
-/* Get mbuf for encrypted frame */
-
-  cypher = mballoc(DES_OVERHEAD + clen);
-
-/* Copy in sequence number */
-
-  MBDATAU(cypher)[0] = des->xmit_seq >> 8;
-  MBDATAU(cypher)[1] = des->xmit_seq & 0xff;
+  seq[0] = des->xmit_seq >> 8;
+  seq[1] = des->xmit_seq & 0xff;
   des->xmit_seq++;
 
-/* Copy in plaintext */
-
-  mbcopy(plain, 0, MBDATA(cypher) + DES_OVERHEAD, plen);
-
-/* Correct and add padding */
+/* Correct and add padding, in place if there is room */
 
-  if ((padlen>7) &&
-    ((MBDATA(cypher)[DES_OVERHEAD + plen - 1]==0) ||
-     (MBDATA(cypher)[DES_OVERHEAD + plen - 1]>8))) {
+  last = (plen > 0) ? MBDATAU(plain)[plen - 1] : seq[DES_OVERHEAD - 1];
+  if ((padlen>7) && ((last==0) || (last>8))) {
         padlen -=8;
 	clen = plen + padlen;
   }
   for (k = 0; k < padlen; k++) {
-    MBDATA(cypher)[DES_OVERHEAD + plen + k] = k + 1;
+    pad[k] = k + 1;
   }
-  
-  cypher->cnt = DES_OVERHEAD + clen;
-  
-/* Copy in plaintext and encrypt it */
+  cypher = mbappend(plain, pad, padlen);
+
+/* Prepend sequence number */
+
+  cypher = mbprepend(cypher, seq, sizeof(seq));
+
+/* Encrypt it */
   
   for (k = 0; k < clen; k += 8)
   {
@@ -213,7 +208,6 @@ DeseBisEncrypt(Bund b, Mbuf plain)
 
 /* Return cyphertext */
 
-  mbfree(plain);
   return(cypher);
 }
 
@@ -224,7 +218,7 @@ DeseBisEncrypt(Bund b, Mbuf plain)
 Mbuf
 DeseBisDecrypt(Bund b, Mbuf cypher)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DeseBisInfo	des = &ecp->desebis;
   int		clen = MBLEN(cypher) - DES_OVERHEAD;
   u_int16_t	seq;
@@ -300,7 +294,7 @@ DeseBisDecrypt(Bund b, Mbuf cypher)
 static void
 DeseBisCleanup(Bund b, int dir)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DeseBisInfo	const des = &ecp->desebis;
   
   if (dir == ECP_DIR_RECV)
@@ -320,7 +314,7 @@ DeseBisCleanup(Bund b, int dir)
 static u_char *
 DeseBisBuildConfigReq(Bund b, u_char *cp)
 {
-  EcpState	const ecp = &b->ecp;
+  EcpState	const ecp = b->ecp;
   DeseBisInfo	const des = &ecp->desebis;
 
   ((u_int32_t *)(void *) des->xmit_ivec)[0] = random();
@@ -336,7 +330,7 @@ static void
 DeseBisDecodeConfigReq(Fsm fp, FsmOption opt, int mode)
 {
     Bund 	b = (Bund)fp->arg;
-  DeseBisInfo	const des = &b->ecp.desebis;
+  DeseBisInfo	const des = &b->ecp->desebis;
 
   if (opt->len != 10)
   {
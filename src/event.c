@@ -7,18 +7,41 @@
 
   #include "ppp.h"
   #include "event.h"
+  #include "command.h"
+
+  #include <strings.h>
+  #include <time.h>
 
 /*
  * DEFINITIONS
  */
 
+  #define EVENT_HIST_LEN	24	/* log2 usec buckets, up to ~8 sec */
+
+  struct event_stats
+  {
+    const char	*name;
+    u_int	count;
+    uint64_t	total;			/* usec */
+    u_int	max;			/* usec */
+    u_int	hist[EVENT_HIST_LEN];	/* hist[n]: under 2^n usec */
+  };
+
   struct pevent_ctx	*gPeventCtx = NULL;
 
+  static struct ghash	*gEventStats;	/* struct event_stats by name */
+  static uint64_t	gEventGiant;	/* usec spent in handlers */
+
 /*
  * INTERNAL FUNCTIONS
  */
 
   static void		EventHandler(void *arg);
+  static struct event_stats	*EventStatsGet(const char *name);
+  static u_int32_t	EventStatsHash(struct ghash *g, const void *item);
+  static int		EventStatsEqual(struct ghash *g, const void *item1,
+			  const void *item2);
+  static int		EventStatsCmp(const void *p1, const void *p2);
 
 /*
  * EventInit()
@@ -57,10 +80,193 @@ EventStop(void)
 void
 EventDump(Context ctx)
 {
-  u_int	n;
+  struct pevent_ctx_stats	ls;
+  struct event_stats		**list;
+  struct event_stats		*st;
+  u_int				n;
+  int				i, k, num;
 
   n = pevent_ctx_count(gPeventCtx);
   Printf("%d Events registered\r\n", n);
+  Printf("Event backend: %s\r\n", pevent_ctx_backend(gPeventCtx));
+
+  pevent_ctx_get_stats(gPeventCtx, &ls);
+  Printf("Event loop:\r\n");
+  Printf("\tIterations  : %ju\r\n", (uintmax_t)ls.loops);
+  Printf("\tServiced    : %ju (max %u per iteration)\r\n",
+    (uintmax_t)ls.serviced, ls.max_serviced);
+  Printf("\tWaiting     : %ju ms\r\n", (uintmax_t)(ls.wait_usec / 1000));
+  Printf("\tBusy        : %ju ms (max %u us per iteration)\r\n",
+    (uintmax_t)(ls.busy_usec / 1000), ls.max_busy_usec);
+  Printf("\tTimers      : %ju in %ju wakeups (%ju coalesced)\r\n",
+    (uintmax_t)ls.timers, (uintmax_t)ls.timer_wakeups,
+    (uintmax_t)ls.coalesced);
+
+  if (gEventStats == NULL)
+    return;
+  Printf("\tIn handlers : %ju ms\r\n", (uintmax_t)(gEventGiant / 1000));
+  if ((num = ghash_dump(gEventStats, (void ***)&list, MB_EVENT)) < 0)
+    return;
+  qsort(list, num, sizeof(*list), EventStatsCmp);
+  Printf("Event handlers%s:\r\n",
+    Enabled(&gGlobalConf.options, GLOBAL_CONF_EVENT_STATS) ? "" :
+    " (event-stats disabled)");
+  Printf("\t%-40s %10s %10s %8s %8s\r\n",
+    "Handler", "Count", "Total ms", "Avg us", "Max us");
+  for (i = 0; i < num; i++) {
+    st = list[i];
+    Printf("\t%-40s %10u %10ju %8ju %8u\r\n", st->name, st->count,
+      (uintmax_t)(st->total / 1000),
+      (uintmax_t)(st->count ? st->total / st->count : 0), st->max);
+    Printf("\t ");
+    for (k = 0; k < EVENT_HIST_LEN; k++) {
+      if (st->hist[k])
+	Printf(" <%uus:%u", 1U << k, st->hist[k]);
+    }
+    Printf("\r\n");
+  }
+  FREE(MB_EVENT, list);
+}
+
+/*
+ * EventDumpJSON()
+ *
+ * Event loop and per-handler statistics for the web interface.
+ */
+
+void
+EventDumpJSON(FILE *f)
+{
+  struct pevent_ctx_stats	ls;
+  struct event_stats		**list;
+  struct event_stats		*st;
+  int				i, k, num = 0;
+
+  pevent_ctx_get_stats(gPeventCtx, &ls);
+  fprintf(f, "{\"loop\": {\n");
+  fprintf(f, "\"backend\": \"%s\",\n", pevent_ctx_backend(gPeventCtx));
+  fprintf(f, "\"events\": %u,\n", pevent_ctx_count(gPeventCtx));
+  fprintf(f, "\"iterations\": %ju,\n", (uintmax_t)ls.loops);
+  fprintf(f, "\"serviced\": %ju,\n", (uintmax_t)ls.serviced);
+  fprintf(f, "\"max_serviced\": %u,\n", ls.max_serviced);
+  fprintf(f, "\"wait_us\": %ju,\n", (uintmax_t)ls.wait_usec);
+  fprintf(f, "\"busy_us\": %ju,\n", (uintmax_t)ls.busy_usec);
+  fprintf(f, "\"max_busy_us\": %u,\n", ls.max_busy_usec);
+  fprintf(f, "\"timers\": %ju,\n", (uintmax_t)ls.timers);
+  fprintf(f, "\"timer_wakeups\": %ju,\n", (uintmax_t)ls.timer_wakeups);
+  fprintf(f, "\"timers_coalesced\": %ju,\n", (uintmax_t)ls.coalesced);
+  fprintf(f, "\"handlers_us\": %ju\n", (uintmax_t)gEventGiant);
+  fprintf(f, "},\n");
+
+  fprintf(f, "\"enabled\": %s,\n",
+    Enabled(&gGlobalConf.options, GLOBAL_CONF_EVENT_STATS) ? "true" : "false");
+  fprintf(f, "\"handlers\":[\n");
+  if (gEventStats != NULL &&
+      (num = ghash_dump(gEventStats, (void ***)&list, MB_EVENT)) > 0) {
+    qsort(list, num, sizeof(*list), EventStatsCmp);
+    for (i = 0; i < num; i++) {
+      st = list[i];
+      fprintf(f, "%s{\n", i ? ",\n" : "");
+      fprintf(f, "\"handler\": \"%s\",\n", st->name);
+      fprintf(f, "\"count\": %u,\n", st->count);
+      fprintf(f, "\"total_us\": %ju,\n", (uintmax_t)st->total);
+      fprintf(f, "\"max_us\": %u,\n", st->max);
+      fprintf(f, "\"histogram\": [");
+      for (k = 0; k < EVENT_HIST_LEN; k++)
+	fprintf(f, "%s%u", k ? "," : "", st->hist[k]);
+      fprintf(f, "]\n}");
+    }
+  }
+  if (num > 0)
+    FREE(MB_EVENT, list);
+  fprintf(f, "\n]}\n");
+}
+
+/*
+ * EventStatsReset()
+ *
+ * Clears per-handler and handler time statistics. Entries are kept
+ * because registered events point to them.
+ */
+
+void
+EventStatsReset(void)
+{
+  struct ghash_walk	walk;
+  struct event_stats	*st;
+
+  gEventGiant = 0;
+  if (gEventStats == NULL)
+    return;
+  ghash_walk_init(gEventStats, &walk);
+  while ((st = ghash_walk_next(gEventStats, &walk)) != NULL) {
+    st->count = 0;
+    st->total = 0;
+    st->max = 0;
+    memset(st->hist, 0, sizeof(st->hist));
+  }
+}
+
+/*
+ * EventStatsGet()
+ *
+ * Find or create the statistics entry for a handler name.
+ */
+
+static struct event_stats *
+EventStatsGet(const char *name)
+{
+  struct event_stats	key, *st;
+
+  if (gEventStats == NULL &&
+      (gEventStats = ghash_create(NULL, 0, 0, MB_EVENT, EventStatsHash,
+	EventStatsEqual, NULL, NULL)) == NULL)
+    return(NULL);
+
+  key.name = name;
+  if ((st = ghash_get(gEventStats, &key)) != NULL)
+    return(st);
+  st = Malloc(MB_EVENT, sizeof(*st));
+  st->name = name;
+  if (ghash_put(gEventStats, st) == -1) {
+    Freee(st);
+    return(NULL);
+  }
+  return(st);
+}
+
+static u_int32_t
+EventStatsHash(struct ghash *g, const void *item)
+{
+  const struct event_stats	*st = item;
+  const u_char			*p;
+  u_int32_t			h = 0;
+
+  (void)g;
+  for (p = (const u_char *)st->name; *p; p++)
+    h = h * 31 + *p;
+  return(h);
+}
+
+static int
+EventStatsEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  const struct event_stats	*st1 = item1;
+  const struct event_stats	*st2 = item2;
+
+  (void)g;
+  return(strcmp(st1->name, st2->name) == 0);
+}
+
+static int
+EventStatsCmp(const void *p1, const void *p2)
+{
+  const struct event_stats	*st1 = *(const struct event_stats *const *)p1;
+  const struct event_stats	*st2 = *(const struct event_stats *const *)p2;
+
+  if (st1->total != st2->total)
+    return(st1->total < st2->total ? 1 : -1);
+  return(strcmp(st1->name, st2->name));
 }
 
 /*
@@ -79,8 +285,10 @@ EventRegister2(EventRef *refp, int type, int val, int flags,
     refp->arg = cookie;
     refp->handler = action;
     refp->type = type;
+    refp->flags = flags;
     refp->pe = NULL;
     refp->dbg = dbg;
+    refp->stats = NULL;
 
     if (pevent_register(gPeventCtx, &refp->pe, flags, &gGiantMutex, EventHandler,
 	    refp, type, val) == -1) {
@@ -105,6 +313,51 @@ EventUnRegister2(EventRef *refp, const char *file, int line)
     return(0);
 }
 
+/*
+ * EventReschedule()
+ *
+ * Restarts a registered timer event to expire in value milliseconds,
+ * reusing the existing registration. Returns -1 if the event is not
+ * a pending timer, in which case the caller must register it again.
+ */
+
+int
+EventReschedule(EventRef *refp, int value)
+{
+    if (refp->pe == NULL || pevent_reschedule(refp->pe, value) == -1)
+	return(-1);
+    Log(LG_EVENTS, ("EVENT: Rescheduled event %s for %d ms", refp->dbg, value));
+    return(0);
+}
+
+/*
+ * EventSetSlack()
+ *
+ * Lets a registered timer event expire up to slack milliseconds late,
+ * so that it can share a wakeup with other timers.
+ */
+
+int
+EventSetSlack(EventRef *refp, int slack)
+{
+    if (refp->pe == NULL || pevent_set_slack(refp->pe, slack) == -1)
+	return(-1);
+    return(0);
+}
+
+/*
+ * EventTrigger()
+ *
+ * Marks a registered EVENT_USER event as occurred. Unlike the other
+ * Event functions this may be called from any thread.
+ */
+
+void
+EventTrigger(EventRef *refp)
+{
+    pevent_trigger(refp->pe);
+}
+
 /*
  * EventIsRegistered()
  */
@@ -128,12 +381,7 @@ EventIsRegistered(EventRef *ref)
 int
 EventTimerRemain(EventRef *refp)
 {
-    struct pevent_info	info;
-
-    if (pevent_get_info(refp->pe, &info) == -1)
-	return(-1);
-
-    return(info.u.millis);
+    return(pevent_remain(refp->pe));
 }
 
 static void
@@ -142,7 +390,38 @@ EventHandler(void *arg)
     EventRef	*refp = (EventRef *) arg;
     const char	*dbg = refp->dbg;
 
+    struct event_stats	*st;
+    struct timespec	start, end;
+    u_int		usec;
+    int			k;
+
+    if (!Enabled(&gGlobalConf.options, GLOBAL_CONF_EVENT_STATS)) {
+	Log(LG_EVENTS, ("EVENT: Processing event %s", dbg));
+	(refp->handler)(refp->type, refp->arg);
+	Log(LG_EVENTS, ("EVENT: Processing event %s done", dbg));
+	return;
+    }
+
+    /* The handler may unregister or free the event, fetch stats first */
+    if ((st = refp->stats) == NULL)
+	st = refp->stats = EventStatsGet(dbg);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
     Log(LG_EVENTS, ("EVENT: Processing event %s", dbg));
     (refp->handler)(refp->type, refp->arg);
     Log(LG_EVENTS, ("EVENT: Processing event %s done", dbg));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    usec = (end.tv_sec - start.tv_sec) * 1000000 +
+	(end.tv_nsec - start.tv_nsec) / 1000;
+    gEventGiant += usec;
+    if (st == NULL)
+	return;
+    st->count++;
+    st->total += usec;
+    if (usec > st->max)
+	st->max = usec;
+    if ((k = fls(usec)) >= EVENT_HIST_LEN)
+	k = EVENT_HIST_LEN - 1;
+    st->hist[k]++;
 }
@@ -17,18 +17,23 @@
   #define EVENT_READ		PEVENT_READ	/* value = file descriptor */
   #define EVENT_WRITE		PEVENT_WRITE	/* value = file descriptor */
   #define EVENT_TIMEOUT		PEVENT_TIME	/* value = time in miliseconds */
+  #define EVENT_USER		PEVENT_USER	/* value ignored, see EventTrigger */
   
   #define EVENT_RECURRING	PEVENT_RECURRING
 
   typedef void		(*EventHdlr)(int type, void *cookie);
 
+  struct event_stats;
+
   struct event_ref
   {
     int			type;
+    int			flags;
     EventHdlr		handler;
     struct pevent	*pe;
     void		*arg;
     const char		*dbg;
+    struct event_stats	*stats;		/* handler stats, when enabled */
   };
   typedef struct event_ref	EventRef;
 
@@ -47,9 +52,14 @@
 #define EventUnRegister(ref)						\
 	    EventUnRegister2(ref, __FILE__, __LINE__)
   extern int	EventUnRegister2(EventRef *ref, const char *file, int line);
+  extern int	EventReschedule(EventRef *ref, int value);
+  extern int	EventSetSlack(EventRef *ref, int slack);
+  extern void	EventTrigger(EventRef *ref);
   extern int	EventIsRegistered(EventRef *ref);
   extern int	EventTimerRemain(EventRef *ref);
   extern void	EventDump(Context ctx);
+  extern void	EventDumpJSON(FILE *f);
+  extern void	EventStatsReset(void);
 
 #endif
 
@@ -197,6 +197,7 @@ FsmNewState(Fsm fp, enum fsm_state new)
     memset(&fp->idleStats, 0, sizeof(fp->idleStats));
     TimerInit(&fp->echoTimer, "FsmKeepAlive",
       fp->conf.echo_int * SECONDS, FsmEchoTimeout, fp);
+    TimerSetSlack(&fp->echoTimer, gTimerSlack);
     TimerStartRecurring(&fp->echoTimer);
   }
 }
@@ -225,7 +226,7 @@ FsmOutputMbuf(Fsm fp, u_int code, u_int id, Mbuf payload)
     hdr.length = htons(sizeof(hdr) + MBLEN(payload));
 
     /* Prepend to payload */
-    bp = mbcopyback(payload, -(int)sizeof(hdr), &hdr, sizeof(hdr));
+    bp = mbprepend(payload, &hdr, sizeof(hdr));
 
     /* Send it out */
     if (fp->type->link_layer) {
@@ -246,7 +247,7 @@ FsmOutput(Fsm fp, u_int code, u_int id, u_char *ptr, int len)
 {
   Mbuf	bp;
 
-  bp = (len > 0) ? mbcopyback(NULL, 0, ptr, len) : NULL;
+  bp = (len > 0) ? mbappend(mballoc2(MB_HEADROOM, len), ptr, len) : NULL;
   FsmOutputMbuf(fp, code, id, bp);
 }
 
@@ -1122,7 +1123,7 @@ FsmSendEchoReq(Fsm fp, Mbuf payload)
     return;
 
   /* Prepend my magic number */
-  bp = mbcopyback(payload, -(int)sizeof(self_magic), &self_magic, sizeof(self_magic));
+  bp = mbprepend(payload, &self_magic, sizeof(self_magic));
 
   /* Send it */
   Log(LG_ECHO, ("[%s] %s: SendEchoReq #%d", Pref(fp), Fsm(fp), fp->echoid));
@@ -1147,8 +1148,9 @@ FsmSendIdent(Fsm fp, const char *ident)
     self_magic = 0;
 
   /* Prepend my magic number */
-  bp = mbcopyback(NULL, 0, (u_char *) &self_magic, sizeof(self_magic));
-  bp = mbcopyback(bp, sizeof(self_magic), ident, len);
+  bp = mballoc2(MB_HEADROOM, sizeof(self_magic) + len);
+  bp = mbappend(bp, &self_magic, sizeof(self_magic));
+  bp = mbappend(bp, ident, len);
 
   /* Send it */
   Log(fp->log2, ("[%s] %s: SendIdent #%d", Pref(fp), Fsm(fp), fp->echoid));
@@ -1174,8 +1176,9 @@ FsmSendTimeRemaining(Fsm fp, u_int seconds)
     self_magic = 0;
 
   /* Prepend my magic number */
-  bp = mbcopyback(NULL, 0, (u_char *) &self_magic, sizeof(self_magic));
-  bp = mbcopyback(bp, sizeof(self_magic), &data, 4);
+  bp = mballoc2(MB_HEADROOM, sizeof(self_magic) + sizeof(data));
+  bp = mbappend(bp, &self_magic, sizeof(self_magic));
+  bp = mbappend(bp, &data, sizeof(data));
 
   /* Send it */
   Log(fp->log2, ("[%s] %s: SendTimeRemaining #%d", Pref(fp), Fsm(fp), fp->echoid));
@@ -1203,7 +1206,7 @@ FsmRecvEchoReq(Fsm fp, FsmHeader lhp, Mbuf bp)
 
   /* Stick my magic number in there instead */
   self_magic = htonl(((Link)(fp->arg))->lcp.want_magic);
-  bp = mbcopyback(bp, -(int)sizeof(self_magic), &self_magic, sizeof(self_magic));
+  bp = mbprepend(bp, &self_magic, sizeof(self_magic));
 
   /* Send it back, preserving everything else */
   Log(LG_ECHO, ("[%s] %s: SendEchoRep #%d", Pref(fp), Fsm(fp), lhp->id));
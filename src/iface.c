@@ -500,7 +500,7 @@ IfaceUp(Bund b, int ready)
 	}
 	TimerInit(&iface->idleTimer, "IfaceIdle",
     	    idle_timeout * SECONDS / IFACE_IDLE_SPLIT, IfaceIdleTimeout, b);
-	TimerStart(&iface->idleTimer);
+	TimerStartRecurring(&iface->idleTimer);
 	iface->traffic[1] = TRUE;
 	iface->traffic[0] = FALSE;
 
@@ -747,6 +747,7 @@ IfaceDown(Bund b)
 #endif /* USE_IPFW */
 
     /* Clearing self and peer addresses */
+    BundIndexPeer(b, 0);
     u_rangeclear(&iface->self_addr);
     u_addrclear(&iface->peer_addr);
     u_addrclear(&iface->self_ipv6_addr);
@@ -1029,11 +1030,13 @@ IfaceIpIfaceUp(Bund b, int ready)
     } else {
 	u_rangecopy(&iface->conf.self_addr, &iface->self_addr);
     }
+    BundIndexPeer(b, 0);
     if (ready && !iface->conf.peer_addr_force) {
 	in_addrtou_addr(&b->ipcp.peer_addr, &iface->peer_addr);
     } else {
 	u_addrcopy(&iface->conf.peer_addr, &iface->peer_addr);
     }
+    BundIndexPeer(b, 1);
 
     if (IfaceNgIpInit(b, ready)) {
 	Log(LG_ERR, ("[%s] IFACE: IfaceNgIpInit() error, closing IPCP", b->name));
@@ -1342,6 +1345,7 @@ IfaceIdleTimeout(void *arg)
     for (k = 0; k < IFACE_IDLE_SPLIT && !iface->traffic[k]; k++);
     if (k == IFACE_IDLE_SPLIT) {
       Log(LG_BUND, ("[%s] IFACE: Idle timeout", b->name));
+      TimerStop(&iface->idleTimer);
       RecordLinkUpDownReason(b, NULL, 0, STR_IDLE_TIMEOUT, NULL);
       BundClose(b);
       return;
@@ -1354,9 +1358,6 @@ IfaceIdleTimeout(void *arg)
   memmove(iface->traffic + 1,
     iface->traffic, (IFACE_IDLE_SPLIT - 1) * sizeof(*iface->traffic));
   iface->traffic[0] = FALSE;
-
-  /* Restart timer */
-  TimerStart(&iface->idleTimer);
 }
 
 /*
@@ -3789,7 +3790,9 @@ IfaceSetName(Bund b, const char * ifname)
 
     close(s);
     /* Save name */
+    BundIndexIface(b, 0);
     strlcpy(iface->ifname, ifname, sizeof(iface->ifname));
+    BundIndexIface(b, 1);
     return(0);
 }
 
@@ -75,7 +75,7 @@ InputFrame(Bund b, Link l, int proto, Mbuf bp)
 
     /* Send a protocol reject on the chosen link */
     nprot = htons((u_int16_t) proto);
-    protoRej = mbcopyback(bp, -2, (u_char *) &nprot, 2);
+    protoRej = mbprepend(bp, &nprot, sizeof(nprot));
     FsmOutputMbuf(&l->lcp.fsm, CODE_PROTOREJ, l->lcp.fsm.rejid++, protoRej);
 }
 
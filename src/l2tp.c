@@ -14,6 +14,7 @@
 #include "l2tp_ctrl.h"
 #include "log.h"
 #include "util.h"
+#include "admission.h"
 
 #include <sys/types.h>
 #ifdef NOLIBPDEL
@@ -61,6 +62,7 @@
     u_char		alive;		/* control connection is not dying */
     u_int		active_sessions;/* number of calls in this sunnels */
     struct ppp_l2tp_ctrl *ctrl;		/* control connection for this tunnel */
+    LIST_HEAD(, l2tpinfo) links;	/* links associated with tunnel */
   };
   
   struct l2tpinfo {
@@ -83,6 +85,8 @@
     u_char		sync;		/* sync or async call */
     struct l2tp_server	*server;	/* server associated with link */
     struct l2tp_tun	*tun;		/* tunnel associated with link */
+    LIST_ENTRY(l2tpinfo) tunlist;	/* other links of the tunnel */
+    Link		link;		/* this link, while it has a tunnel */
     struct ppp_l2tp_sess *sess;		/* current session for this link */
     char		callingnum[64];	/* current L2TP phone number */
     char		callednum[64];	/* current L2TP phone number */
@@ -142,6 +146,8 @@
   static void	L2tpUnhook(Link l);
 
   static void	L2tpNodeUpdate(Link l);
+  static void	L2tpSetTun(Link l, struct l2tp_tun *tun);
+  static int	L2tpTunLinks(struct l2tp_tun *tun, int **ids);
   static int	L2tpListen(Link l);
   static void	L2tpUnListen(Link l);
   static int	L2tpSetCommand(Context ctx, int ac, const char *const av[], const void *arg);
@@ -427,8 +433,7 @@ L2tpOpen(Link l)
 		(u_addrempty(&pi->conf.self_addr) || u_addrempty(&tun->self_addr) ||
 		    u_addrcompare(&pi->conf.self_addr, &tun->self_addr) == 0) &&
 		(pi->conf.peer_port == 0 || pi->conf.peer_port == tun->peer_port)) {
-		    pi->tun = tun;
-		    tun->active_sessions++;
+		    L2tpSetTun(l, tun);
 		    if (tun->connected) { /* if tun is connected then just initiate */
 		    
 			/* Create number AVPs */
@@ -453,8 +458,7 @@ L2tpOpen(Link l)
 			    Perror("[%s] ppp_l2tp_initiate", l->name);
 			    ppp_l2tp_avp_list_destroy(&avps);
 			    pi->sess = NULL;
-			    pi->tun = NULL;
-			    tun->active_sessions--;
+			    L2tpSetTun(l, NULL);
 			    l->state = PHYS_STATE_DOWN;
 			    PhysDown(l, STR_ERROR, NULL);
 			    return;
@@ -497,6 +501,7 @@ L2tpOpen(Link l)
 	/* There is no tun which we need. Create a new one. */
 	tun = Malloc(MB_PHYS, sizeof(*tun));
 	memset(tun, 0, sizeof(*tun));
+	LIST_INIT(&tun->links);
 	u_addrcopy(&pi->conf.peer_addr.addr, &tun->peer_addr);
 	tun->peer_port = pi->conf.peer_port?pi->conf.peer_port:L2TP_PORT;
 	u_addrcopy(&pi->conf.self_addr, &tun->self_addr);
@@ -617,8 +622,7 @@ L2tpOpen(Link l)
 		Perror("[%s] ghash_put", l->name);
 		goto fail;
 	}
-	pi->tun = tun;
-	tun->active_sessions++;
+	L2tpSetTun(l, tun);
 	Log(LG_PHYS2, ("L2TP: Control connection %p %s %u <-> %s %u initiated",
 	    tun->ctrl, u_addrtoa(&tun->self_addr,buf,sizeof(buf)), tun->self_port,
 	    u_addrtoa(&tun->peer_addr,buf2,sizeof(buf2)), tun->peer_port));
@@ -665,9 +669,7 @@ L2tpClose(Link l)
 	ppp_l2tp_terminate(pi->sess, L2TP_RESULT_ADMIN, 0, NULL);
 	pi->sess = NULL;
     }
-    if (pi->tun)
-	pi->tun->active_sessions--;
-    pi->tun = NULL;
+    L2tpSetTun(l, NULL);
     pi->callingnum[0]=0;
     pi->callednum[0]=0;
     l->state = PHYS_STATE_DOWN;
@@ -687,6 +689,7 @@ L2tpShutdown(Link l)
         Freee(pi->conf.fqdn_peer_addr);
     if (pi->conf.peer_mask)
         Freee(pi->conf.peer_mask);
+    L2tpSetTun(l, NULL);
     L2tpUnListen(l);
     Freee(l->info);
 }
@@ -960,7 +963,7 @@ ppp_l2tp_ctrl_connected_cb(struct ppp_l2tp_ctrl *ctrl)
 	struct ppp_l2tp_avp_list *avps = NULL;
 	struct sockaddr_dl  hwa;
 	char	buf[32], buf2[32];
-	int	k;
+	int	k, n, *ids;
 
 	Log(LG_PHYS, ("L2TP: Control connection %p %s %u <-> %s %u connected",
 	    ctrl, u_addrtoa(&tun->self_addr,buf,sizeof(buf)), tun->self_port,
@@ -971,15 +974,15 @@ ppp_l2tp_ctrl_connected_cb(struct ppp_l2tp_ctrl *ctrl)
 	    memcpy(tun->peer_mac_addr, LLADDR(&hwa), sizeof(tun->peer_mac_addr));
 	};
 
-	/* Examine all L2TP links. */
-	for (k = 0; k < gNumLinks; k++) {
+	/* Examine all links of this tunnel. */
+	n = L2tpTunLinks(tun, &ids);
+	for (k = 0; k < n; k++) {
 		Link l;
 	        L2tpInfo pi;
 
-		if (!gLinks[k] || gLinks[k]->type != &gL2tpPhysType)
+		if (!(l = gLinks[ids[k]]) || l->type != &gL2tpPhysType)
 			continue;
 
-		l = gLinks[k];
 		pi = (L2tpInfo)l->info;
 
 		if (pi->tun != tun)
@@ -1007,8 +1010,7 @@ ppp_l2tp_ctrl_connected_cb(struct ppp_l2tp_ctrl *ctrl)
 			    avps)) == NULL) {
 			Perror("ppp_l2tp_initiate");
 			pi->sess = NULL;
-			pi->tun = NULL;
-			tun->active_sessions--;
+			L2tpSetTun(l, NULL);
 			l->state = PHYS_STATE_DOWN;
 			PhysDown(l, STR_ERROR, NULL);
 			continue;
@@ -1043,6 +1045,7 @@ ppp_l2tp_ctrl_connected_cb(struct ppp_l2tp_ctrl *ctrl)
 			ppp_l2tp_avp_list_destroy(&avps);
 		}
 	};
+	Freee(ids);
 }
 
 /*
@@ -1054,21 +1057,21 @@ ppp_l2tp_ctrl_terminated_cb(struct ppp_l2tp_ctrl *ctrl,
 	u_int16_t result, u_int16_t error, const char *errmsg)
 {
 	struct l2tp_tun *tun = ppp_l2tp_ctrl_get_cookie(ctrl);
-	int	k;
+	int	k, n, *ids;
 
 	(void)result;
 	Log(LG_PHYS, ("L2TP: Control connection %p terminated: %d (%s)", 
 	    ctrl, error, errmsg));
 
-	/* Examine all L2TP links. */
-	for (k = 0; k < gNumLinks; k++) {
+	/* Examine all links of this tunnel. */
+	n = L2tpTunLinks(tun, &ids);
+	for (k = 0; k < n; k++) {
 		Link l;
 	        L2tpInfo pi;
 
-		if (!gLinks[k] || gLinks[k]->type != &gL2tpPhysType)
+		if (!(l = gLinks[ids[k]]) || l->type != &gL2tpPhysType)
 			continue;
 
-		l = gLinks[k];
 		pi = (L2tpInfo)l->info;
 
 		if (pi->tun != tun)
@@ -1077,12 +1080,12 @@ ppp_l2tp_ctrl_terminated_cb(struct ppp_l2tp_ctrl *ctrl,
 		l->state = PHYS_STATE_DOWN;
 		L2tpUnhook(l);
 		pi->sess = NULL;
-		pi->tun = NULL;
-		tun->active_sessions--;
+		L2tpSetTun(l, NULL);
 		pi->callingnum[0]=0;
 	        pi->callednum[0]=0;
 		PhysDown(l, STR_DROPPED, NULL);
 	};
+	Freee(ids);
 	
 	tun->alive = 0;
 }
@@ -1095,9 +1098,16 @@ static void
 ppp_l2tp_ctrl_destroyed_cb(struct ppp_l2tp_ctrl *ctrl)
 {
 	struct l2tp_tun *tun = ppp_l2tp_ctrl_get_cookie(ctrl);
+	L2tpInfo pi;
 
 	Log(LG_PHYS, ("L2TP: Control connection %p destroyed", ctrl));
 
+	/* Links must not point to the freed tunnel or its sessions */
+	while ((pi = LIST_FIRST(&tun->links)) != NULL) {
+		pi->sess = NULL;
+		L2tpSetTun(pi->link, NULL);
+	}
+
 	ghash_remove(gL2tpTuns, tun);
 	Freee(tun);
 }
@@ -1115,9 +1125,9 @@ ppp_l2tp_initiated_cb(struct ppp_l2tp_ctrl *ctrl,
 	struct	l2tp_tun *const tun = ppp_l2tp_ctrl_get_cookie(ctrl);
 	char   *peername = ppp_l2tp_ctrl_get_peer_name_p(ctrl);
 	struct	ppp_l2tp_avp_ptrs *ptrs = NULL;
-	Link 	l = NULL;
+	Link 	l = NULL, l2;
 	L2tpInfo pi = NULL;
-	int	k;
+	char	buf[48];
 
 	/* Convert AVP's to friendly form */
 	if ((ptrs = ppp_l2tp_avp_list2ptrs(avps)) == NULL) {
@@ -1136,21 +1146,16 @@ ppp_l2tp_initiated_cb(struct ppp_l2tp_ctrl *ctrl,
 		goto failed;
 	}
 
-	if (OVERLOAD()) {
+	if (AdmissionCheck(ADM_L2TP,
+	    u_addrtoa(&tun->self_addr, buf, sizeof(buf)))) {
 		Log(LG_PHYS, ("Daemon overloaded, ignoring request."));
 		goto failed;
 	}
 
 	/* Examine all L2TP links. */
-	for (k = 0; k < gNumLinks; k++) {
-		Link l2;
-	        L2tpInfo pi2;
-
-		if (!gLinks[k] || gLinks[k]->type != &gL2tpPhysType)
-			continue;
-
-		l2 = gLinks[k];
-		pi2 = (L2tpInfo)l2->info;
+	for (l2 = LinkPoolFirst(&gL2tpPhysType); l2 != NULL;
+	    l2 = LinkPoolNext(l2)) {
+		L2tpInfo pi2 = (L2tpInfo)l2->info;
 
 		if ((!PhysIsBusy(l2)) &&
 		    Enabled(&l2->conf.options, LINK_CONF_INCOMING) &&
@@ -1187,8 +1192,7 @@ ppp_l2tp_initiated_cb(struct ppp_l2tp_ctrl *ctrl,
 		    l->state = PHYS_STATE_CONNECTING;
 		pi->incoming = 1;
 		pi->outcall = out;
-		pi->tun = tun;
-		tun->active_sessions++;
+		L2tpSetTun(l, tun);
 		pi->sess = sess;
 		if (ptrs->callingnum)
 		    strlcpy(pi->callingnum, ptrs->callingnum->number, sizeof(pi->callingnum));
@@ -1279,9 +1283,7 @@ ppp_l2tp_terminated_cb(struct ppp_l2tp_sess *sess,
 	l->state = PHYS_STATE_DOWN;
 	L2tpUnhook(l);
 	pi->sess = NULL;
-	if (pi->tun)
-	    pi->tun->active_sessions--;
-	pi->tun = NULL;
+	L2tpSetTun(l, NULL);
 	pi->callingnum[0]=0;
 	pi->callednum[0]=0;
 	PhysDown(l, STR_DROPPED, NULL);
@@ -1387,7 +1389,7 @@ L2tpServerEvent(int type, void *arg)
 	int len;
 	u_int32_t	cap;
 	u_int16_t	win;
-	int	k;
+	Link	l2;
 
 	(void)type;
 	/* Allocate buffer */
@@ -1410,6 +1412,7 @@ L2tpServerEvent(int type, void *arg)
 
 	/* Create a new tun */
 	tun = Malloc(MB_PHYS, sizeof(*tun));
+	LIST_INIT(&tun->links);
 	sockaddrtou_addr(&peer_sas,&tun->peer_addr,&tun->peer_port);
 	u_addrcopy(&s->self_addr, &tun->self_addr);
 	tun->self_port = s->self_port;
@@ -1419,15 +1422,9 @@ L2tpServerEvent(int type, void *arg)
 		u_addrtoa(&tun->peer_addr, namebuf, sizeof(namebuf)), tun->peer_port));
 
 	/* Examine all L2TP links to get best possible fit tunnel parameters. */
-	for (k = 0; k < gNumLinks; k++) {
-		Link l2;
-	        L2tpInfo pi2;
-
-		if (!gLinks[k] || gLinks[k]->type != &gL2tpPhysType)
-			continue;
-
-		l2 = gLinks[k];
-		pi2 = (L2tpInfo)l2->info;
+	for (l2 = LinkPoolFirst(&gL2tpPhysType); l2 != NULL;
+	    l2 = LinkPoolNext(l2)) {
+		L2tpInfo pi2 = (L2tpInfo)l2->info;
 
 		/* Simplified comparation as it is not a final one. */
 		if ((!PhysIsBusy(l2)) &&
@@ -1718,6 +1715,54 @@ L2tpNodeUpdate(Link l)
     }
 }
 
+/*
+ * L2tpSetTun()
+ *
+ * Attach a link to a tunnel, or detach it with tun == NULL,
+ * keeping the tunnel's link list and session count.
+ */
+
+static void
+L2tpSetTun(Link l, struct l2tp_tun *tun)
+{
+    L2tpInfo const pi = (L2tpInfo) l->info;
+
+    if (pi->tun == tun)
+	return;
+    if (pi->tun) {
+	pi->tun->active_sessions--;
+	LIST_REMOVE(pi, tunlist);
+    }
+    pi->tun = tun;
+    pi->link = l;
+    if (tun) {
+	tun->active_sessions++;
+	LIST_INSERT_HEAD(&tun->links, pi, tunlist);
+    }
+}
+
+/*
+ * L2tpTunLinks()
+ *
+ * Get ids of the links attached to a tunnel into a Malloc'ed array.
+ * Callers look the links up again, as they may go away meanwhile.
+ */
+
+static int
+L2tpTunLinks(struct l2tp_tun *tun, int **ids)
+{
+    L2tpInfo	pi;
+    int		n = 0;
+
+    LIST_FOREACH(pi, &tun->links, tunlist)
+	n++;
+    *ids = Malloc(MB_PHYS, (n ? n : 1) * sizeof(**ids));
+    n = 0;
+    LIST_FOREACH(pi, &tun->links, tunlist)
+	(*ids)[n++] = pi->link->id;
+    return (n);
+}
+
 /*
  * L2tpSetCommand()
  */
@@ -62,12 +62,11 @@ ppp_l2tp_avp_create(int mandatory, u_int16_t vendor,
 {
 	struct ppp_l2tp_avp *avp;
 
-	avp = Malloc(AVP_MTYPE, sizeof(*avp));
+	avp = MallocRaw(AVP_MTYPE, sizeof(*avp));
 	avp->mandatory = !!mandatory;
 	avp->vendor = vendor;
 	avp->type = type;
-	if (vlen > 0)
-		avp->value = Mdup(AVP_MTYPE, value, vlen);
+	avp->value = (vlen > 0) ? Mdup(AVP_MTYPE, value, vlen) : NULL;
 	avp->vlen = vlen;
 	return (avp);
 }
@@ -118,17 +117,13 @@ ppp_l2tp_avp_list_insert(struct ppp_l2tp_avp_list *list,
 	struct ppp_l2tp_avp **avpp, unsigned index)
 {
 	struct ppp_l2tp_avp *const avp = *avpp;
-	void *mem;
 
 	if (avp == NULL || index < 0 || index > list->length) {
 		errno = EINVAL;
 		return (-1);
 	}
-	/* REALLOC */
-	mem = Malloc(AVP_LIST_MTYPE, (list->length + 1) * sizeof(*list->avps));
-	memcpy(mem, list->avps, list->length * sizeof(*list->avps));
-	Freee(list->avps);
-	list->avps = mem;
+	list->avps = Mrealloc(AVP_LIST_MTYPE, list->avps,
+	    (list->length + 1) * sizeof(*list->avps));
 	/* insert */
 	memmove(list->avps + index + 1, list->avps + index,
 	    (list->length++ - index) * sizeof(*list->avps));
@@ -342,8 +337,9 @@ ppp_l2tp_avp_pack(const struct ppp_l2tp_avp_info *info,
 				buf[len] = (avp->vlen >> 8);
 				buf[len + 1] = (avp->vlen & 0xff);
 
-				/* Add value */
+				/* Add value and padding */
 				memcpy(buf + len + 2, avp->value, avp->vlen);
+				memset(buf + len + 2 + avp->vlen, 0, pad);
 
 				/* Encrypt value */
 				MD5_Init(&md5ctx);
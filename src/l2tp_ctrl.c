@@ -1255,7 +1255,7 @@ ppp_l2tp_ctrl_send(struct ppp_l2tp_ctrl *ctrl, u_int16_t session_id,
 	if ((len = ppp_l2tp_avp_pack(ppp_l2tp_avp_info_list,
 	    avps, (ctrl->hide_avps?ctrl->secret:NULL), ctrl->seclen, NULL)) == -1)
 		goto fail;
-	data = Malloc(TYPED_MEM_TEMP, 2 + len);
+	data = MallocRaw(TYPED_MEM_TEMP, 2 + len);
 	session_id = htons(session_id);
 	memcpy(data, &session_id, 2);
 	(void)ppp_l2tp_avp_pack(ppp_l2tp_avp_info_list,
@@ -1328,7 +1328,7 @@ ppp_l2tp_ctrl_close(struct ppp_l2tp_ctrl *ctrl,
 		}
 
 		/* Add result code AVP */
-		rbuf = Malloc(TYPED_MEM_TEMP, 4 + elen);
+		rbuf = MallocRaw(TYPED_MEM_TEMP, 4 + elen);
 		value16 = htons(ctrl->result);
 		memcpy(rbuf, &value16, sizeof(value16));
 		value16 = htons(ctrl->error);
@@ -1452,16 +1452,7 @@ ppp_l2tp_idle_timeout(void *arg)
 {
 	struct ppp_l2tp_ctrl *const ctrl = arg;
 
-	/* Remove event */
-	pevent_unregister(&ctrl->idle_timer);
-
-	/* Restart idle timer */
-	if (pevent_register(ctrl->ctx, &ctrl->idle_timer, 0,
-	    ctrl->mutex, ppp_l2tp_idle_timeout, ctrl, PEVENT_TIME,
-	    L2TP_IDLE_TIMEOUT * 1000) == -1)
-		Perror("L2TP: error restarting idle timer");
-
-	/* Send a 'hello' packet */
+	/* Send a 'hello' packet (idle timer is recurring) */
 	ppp_l2tp_ctrl_send(ctrl, 0, HELLO, NULL);
 }
 
@@ -1630,7 +1621,7 @@ ppp_l2tp_sess_close(struct ppp_l2tp_sess *sess,
 		}
 
 		/* Add result code AVP */
-		rbuf = Malloc(TYPED_MEM_TEMP, 4 + elen);
+		rbuf = MallocRaw(TYPED_MEM_TEMP, 4 + elen);
 		value16 = htons(sess->result);
 		memcpy(rbuf, &value16, sizeof(value16));
 		value16 = htons(sess->error);
@@ -1754,13 +1745,16 @@ ppp_l2tp_data_event(void *arg)
 	int len;
 	unsigned i, j;
 
-	/* Restart idle timer */
-	pevent_unregister(&ctrl->idle_timer);
-	if (pevent_register(ctrl->ctx, &ctrl->idle_timer, 0,
-	    ctrl->mutex, ppp_l2tp_idle_timeout, ctrl, PEVENT_TIME,
+	/* Restart idle timer, in place if it is pending */
+	if (pevent_reschedule(ctrl->idle_timer,
 	    L2TP_IDLE_TIMEOUT * 1000) == -1) {
-		Perror("L2TP: error restarting idle timer");
-		goto fail_errno;
+		pevent_unregister(&ctrl->idle_timer);
+		if (pevent_register(ctrl->ctx, &ctrl->idle_timer,
+		    PEVENT_RECURRING, ctrl->mutex, ppp_l2tp_idle_timeout,
+		    ctrl, PEVENT_TIME, L2TP_IDLE_TIMEOUT * 1000) == -1) {
+			Perror("L2TP: error restarting idle timer");
+			goto fail_errno;
+		}
 	}
 
 	/* Read packet */
@@ -731,11 +731,11 @@ LcpRecvProtoRej(Fsm fp, int proto, Mbuf bp)
   switch (proto) {
     case PROTO_CCP:
     case PROTO_COMPD:
-      rej = l->bund ? &l->bund->ccp.fsm : NULL;
+      rej = l->bund && l->bund->ccp ? &l->bund->ccp->fsm : NULL;
       break;
     case PROTO_ECP:
     case PROTO_CRYPT:
-      rej = l->bund ? &l->bund->ecp.fsm : NULL;
+      rej = l->bund && l->bund->ecp ? &l->bund->ecp->fsm : NULL;
       break;
     case PROTO_IPCP:
       rej = l->bund ? &l->bund->ipcp.fsm : NULL;
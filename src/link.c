@@ -62,6 +62,7 @@
   static void	LinkMsg(int type, void *cookie);
   static void	LinkNgDataEvent(int type, void *cookie);
   static void	LinkReopenTimeout(void *arg);
+  static void	LinkPoolAdd(Link l);
 
 /*
  * GLOBAL VARIABLES
@@ -153,6 +154,17 @@
     int		gLinksDsock = -1;		/* Socket node data socket */
     static EventRef gLinksDataEvent;
 
+  /* Indexes of links by name and session id, and of auth names */
+  static struct keyindex	*gLinkNames;
+  static struct keyindex	*gLinkSessions;
+  static struct keyindex	*gLinkUsers;
+
+  /* Links created by command, which may take incoming calls */
+  static struct linkpool	**gLinkPools;
+  static int			gNumLinkPools;
+
+  static struct slotalloc	gLinkSlots = SLOTALLOC_INITIALIZER("links");
+
 int
 LinksInit(void)
 {
@@ -170,6 +182,10 @@ LinksInit(void)
     /* Listen for happenings on our node */
     EventRegister(&gLinksDataEvent, EVENT_READ,
 	gLinksDsock, EVENT_RECURRING, LinkNgDataEvent, NULL);
+
+    gLinkNames = StrIndexCreate(MB_LINK, 0);
+    gLinkSessions = StrIndexCreate(MB_LINK, 0);
+    gLinkUsers = StrIndexCreate(MB_LINK, 1);
 	
     return (0);
 }
@@ -469,14 +485,15 @@ LinkCreate(Context ctx, int ac, const char *const av[], const void *arg)
 	MsgRegister(&l->msgs, LinkMsg);
 
 	/* Find a free link pointer */
-        for (k = 0; k < gNumLinks && gLinks[k] != NULL; k++);
-        if (k == gNumLinks)			/* add a new link pointer */
-    	    LengthenArray(&gLinks, sizeof(*gLinks), &gNumLinks, MB_LINK);
+	k = SlotAlloc(&gLinkSlots, &gLinks, sizeof(*gLinks), &gNumLinks,
+	    MB_LINK);
 	    
 	l->id = k;
 	gLinks[k] = l;
+	StrIndexAdd(gLinkNames, l->name);
 	REF(l);
     }
+    LinkPoolAdd(l);
 
     RESETREF(ctx->lnk, l);
 
@@ -561,9 +578,7 @@ LinkInst(Link lt, const char *name, int tmpl, int stay)
     l->refs = 0;
 
     /* Find a free link pointer */
-    for (k = 0; k < gNumLinks && gLinks[k] != NULL; k++);
-    if (k == gNumLinks)			/* add a new link pointer */
-	LengthenArray(&gLinks, sizeof(*gLinks), &gNumLinks, MB_LINK);
+    k = SlotAlloc(&gLinkSlots, &gLinks, sizeof(*gLinks), &gNumLinks, MB_LINK);
 
     l->id = k;
 
@@ -572,6 +587,9 @@ LinkInst(Link lt, const char *name, int tmpl, int stay)
     else
 	snprintf(l->name, sizeof(l->name), "%s-%d", lt->name, k);
     gLinks[k] = l;
+    StrIndexAdd(gLinkNames, l->name);
+    l->user = NULL;
+    l->pool = NULL;
     REF(l);
 
     PhysInst(l, lt);
@@ -609,6 +627,11 @@ LinkShutdown(Link l)
 	l->bund = NULL;
     }
     gLinks[l->id] = NULL;
+    SlotFree(&gLinkSlots, l->id);
+    StrIndexDel(gLinkNames, l->name);
+    LinkUnindexAuth(l);
+    if (l->pool != NULL)
+	TAILQ_REMOVE(&l->pool->links, l, poollist);
     /* Our parent lost one children */
     if (l->parent >= 0) {
 	gChildren--;
@@ -997,19 +1020,149 @@ LinkFind(const char *name)
 {
     int		k;
 
-    k = gNumLinks;
-    if ((sscanf(name, "[%x]", &k) != 1) || (k < 0) || (k >= gNumLinks)) {
-        /* Find link */
-	for (k = 0;
-	    k < gNumLinks && (gLinks[k] == NULL ||
-		strcmp(gLinks[k]->name, name));
-	    k++);
-    };
-    if (k == gNumLinks) {
+    if ((sscanf(name, "[%x]", &k) == 1) && (k >= 0) && (k < gNumLinks))
+	return (gLinks[k]);
+    return (LinkFindName(name, 0));
+}
+
+/*
+ * LinkFindName()
+ * LinkFindSession()
+ *
+ * The n-th link with a name or session id, counting from zero in the
+ * order they got it, or NULL. Most have a single link.
+ */
+
+Link
+LinkFindName(const char *name, int n)
+{
+    char	*item;
+
+    if ((item = KeyIndexGet(gLinkNames, name, n)) == NULL)
+	return (NULL);
+    return (INDEX_ITEM(item, struct linkst, name));
+}
+
+Link
+LinkFindSession(const char *session_id, int n)
+{
+    char	*item;
+
+    if ((item = KeyIndexGet(gLinkSessions, session_id, n)) == NULL)
 	return (NULL);
+    return (INDEX_ITEM(item, struct linkst, session_id));
+}
+
+/*
+ * LinkFindUser()
+ *
+ * Find the links authenticated with a name, ignoring case
+ */
+
+struct linkuser *
+LinkFindUser(const char *authname)
+{
+    return (StrIndexGet(gLinkUsers, authname));
+}
+
+/*
+ * LinkIndexAuth()
+ * LinkUnindexAuth()
+ *
+ * Index a link by its session id and auth name, or remove it from
+ * the indexes. Both must be unindexed before they change.
+ */
+
+void
+LinkIndexAuth(Link l)
+{
+    const char	*authname = l->lcp.auth.params.authname;
+    struct linkuser	*u;
+
+    StrIndexAdd(gLinkSessions, l->session_id);
+    if (l->user != NULL || authname[0] == 0)
+	return;
+    if ((u = StrIndexGet(gLinkUsers, authname)) == NULL) {
+	u = Malloc(MB_LINK, sizeof(*u));
+	strlcpy(u->name, authname, sizeof(u->name));
+	LIST_INIT(&u->links);
+	StrIndexAdd(gLinkUsers, u->name);
+    }
+    LIST_INSERT_HEAD(&u->links, l, userlist);
+    u->n++;
+    l->user = u;
+}
+
+void
+LinkUnindexAuth(Link l)
+{
+    struct linkuser	*u = l->user;
+
+    StrIndexDel(gLinkSessions, l->session_id);
+    if (u == NULL)
+	return;
+    LIST_REMOVE(l, userlist);
+    l->user = NULL;
+    if (--u->n == 0) {
+	StrIndexDel(gLinkUsers, u->name);
+	Freee(u);
     }
+}
+
+/*
+ * LinkPoolAdd()
+ *
+ * Remember a link created by command as one that may answer incoming
+ * calls. Instances made to answer a call go away when it ends and are
+ * never looked for, so the pools stay as small as the config.
+ */
 
-    return (gLinks[k]);
+static void
+LinkPoolAdd(Link l)
+{
+    struct linkpool	*p;
+    int			k;
+
+    if (l->type == NULL)
+	return;
+    for (k = 0; k < gNumLinkPools && gLinkPools[k]->type != l->type; k++);
+    if (k == gNumLinkPools) {
+	LengthenArray(&gLinkPools, sizeof(*gLinkPools), &gNumLinkPools,
+	    MB_LINK);
+	p = Malloc(MB_LINK, sizeof(*p));
+	p->type = l->type;
+	TAILQ_INIT(&p->links);
+	gLinkPools[k] = p;
+    }
+    p = gLinkPools[k];
+    TAILQ_INSERT_TAIL(&p->links, l, poollist);
+    l->pool = p;
+}
+
+/*
+ * LinkPoolFirst()
+ * LinkPoolNext()
+ *
+ * Walk the links of a device type created by command, templates
+ * included, in creation order.
+ */
+
+Link
+LinkPoolFirst(const struct phystype *pt)
+{
+    int		k;
+
+    for (k = 0; k < gNumLinkPools; k++) {
+	if (gLinkPools[k]->type == pt)
+	    return (TAILQ_FIRST(&gLinkPools[k]->links));
+    }
+    return (NULL);
+}
+
+Link
+LinkPoolNext(Link l)
+{
+    return (TAILQ_NEXT(l, poollist));
 }
 
 /*
@@ -1066,6 +1219,7 @@ LinkCommand(Context ctx, int ac, const char *const av[], const void *arg)
 int
 SessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
+    Link	l;
     int		k;
 
     (void)arg;
@@ -1082,11 +1236,7 @@ SessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Find link */
-    for (k = 0;
-	k < gNumLinks && (gLinks[k] == NULL || 
-	    strcmp(gLinks[k]->session_id, av[0]));
-	k++);
-    if (k == gNumLinks) {
+    if ((l = LinkFindSession(av[0], 0)) == NULL) {
 	/* Change default link and bundle */
 	RESETREF(ctx->lnk, NULL);
 	RESETREF(ctx->bund, NULL);
@@ -1095,7 +1245,7 @@ SessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Change default link and bundle */
-    RESETREF(ctx->lnk, gLinks[k]);
+    RESETREF(ctx->lnk, l);
     RESETREF(ctx->bund, ctx->lnk->bund);
     RESETREF(ctx->rep, NULL);
 
@@ -1109,6 +1259,8 @@ SessionCommand(Context ctx, int ac, const char *const av[], const void *arg)
 int
 AuthnameCommand(Context ctx, int ac, const char *const av[], const void *arg)
 {
+    struct linkuser	*u;
+    Link	l;
     int		k;
 
     (void)arg;
@@ -1124,20 +1276,19 @@ AuthnameCommand(Context ctx, int ac, const char *const av[], const void *arg)
 	return (0);
     }
 
-    if (ac == 2 && strcasecmp(av[1], "ci") == 0) {
-	/* Find link */
-	for (k = 0;
-	    k < gNumLinks && (gLinks[k] == NULL || 
-		strcasecmp(gLinks[k]->lcp.auth.params.authname, av[0]));
-	    k++);
-    } else {
-	/* Find link */
-	for (k = 0;
-	    k < gNumLinks && (gLinks[k] == NULL || 
-		strcmp(gLinks[k]->lcp.auth.params.authname, av[0]));
-	    k++);
+    /* Find link */
+    l = NULL;
+    if ((u = LinkFindUser(av[0])) != NULL) {
+	if (ac == 2 && strcasecmp(av[1], "ci") == 0)
+	    l = LIST_FIRST(&u->links);
+	else {
+	    LIST_FOREACH(l, &u->links, userlist) {
+		if (strcmp(l->lcp.auth.params.authname, av[0]) == 0)
+		    break;
+	    }
+	}
     }
-    if (k == gNumLinks) {
+    if (l == NULL) {
 	/* Change default link and bundle */
 	RESETREF(ctx->lnk, NULL);
 	RESETREF(ctx->bund, NULL);
@@ -1146,7 +1297,7 @@ AuthnameCommand(Context ctx, int ac, const char *const av[], const void *arg)
     }
 
     /* Change default link and bundle */
-    RESETREF(ctx->lnk, gLinks[k]);
+    RESETREF(ctx->lnk, l);
     RESETREF(ctx->bund, ctx->lnk->bund);
     RESETREF(ctx->rep, NULL);
 
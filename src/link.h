@@ -109,6 +109,19 @@
   				 (o) == LINK_ORIGINATE_REMOTE ? "remote" :  \
 				 "unknown")
 
+  /* Links authenticated with one name, ignoring case */
+  struct linkuser {
+    char		name[AUTH_MAX_AUTHNAME];	/* must be first */
+    u_int		n;			/* Number of links */
+    LIST_HEAD(, linkst)	links;
+  };
+
+  /* Configured links of one device type, in creation order */
+  struct linkpool {
+    const struct phystype	*type;
+    TAILQ_HEAD(, linkst)	links;
+  };
+
   /* Total state of a link */
   struct linkst {
     char		name[LINK_MAX_NAME];	/* Human readable name */
@@ -152,6 +165,10 @@
     time_t		last_up;	/* Time this link last got up */
     char		msession_id[AUTH_MAX_SESSIONID]; /* a uniq msession-id */
     char		session_id[AUTH_MAX_SESSIONID];	/* a uniq session-id */
+    struct linkuser	*user;		/* Index entry of auth name */
+    LIST_ENTRY(linkst)	userlist;	/* Links with the same name */
+    struct linkpool	*pool;		/* Configured links of this type */
+    TAILQ_ENTRY(linkst)	poollist;
 
     const struct phystype *type;		/* Device type descriptor */
     void		*info;			/* Type specific info */
@@ -197,6 +214,13 @@
   extern void	LinkUpdateStats(Link l);
   extern void	LinkResetStats(Link l);
   extern Link	LinkFind(const char *name);
+  extern Link	LinkFindName(const char *name, int n);
+  extern Link	LinkFindSession(const char *session_id, int n);
+  extern struct linkuser	*LinkFindUser(const char *authname);
+  extern void	LinkIndexAuth(Link l);
+  extern void	LinkUnindexAuth(Link l);
+  extern Link	LinkPoolFirst(const struct phystype *pt);
+  extern Link	LinkPoolNext(Link l);
   extern int	LinkCommand(Context ctx, int ac, const char *const av[], const void *arg);
   extern int	SessionCommand(Context ctx, int ac, const char *const av[], const void *arg);
   extern int	AuthnameCommand(Context ctx, int ac, const char *const av[], const void *arg);
@@ -22,6 +22,7 @@
 #include "ngfunc.h"
 #include "util.h"
 #include "ippool.h"
+#include "admission.h"
 #ifdef CCP_MPPC
 #include "ccp_mppc.h"
 #endif
@@ -71,6 +72,10 @@
 #ifdef USE_PAM
     { 1, 'm',	"pam-service",	"service",
 				"PAM service name"	},
+#endif
+#ifdef NOLIBPDEL
+    { 0, 'M',	"mem-debug",	"",
+				"Track every memory block (slow)"	},
 #endif
     { 0, 'v',	"version",	"",
 				"Show version information"	},
@@ -100,7 +105,6 @@
   struct radsrv		gRadsrv;
   int			gBackground = FALSE;
   int			gShutdownInProgress = FALSE;
-  int			gOverload = 0;
   pid_t          	gPid;
   int			gRouteSeq = 0;
 
@@ -157,6 +161,9 @@
  */
 
   static int		gKillProc = FALSE;
+#ifdef NOLIBPDEL
+  static int		gMemDebug = FALSE;
+#endif
   static const char	*gPidFile = PID_FILE;
   static const char	*gPeerSystem = NULL;
   static EventRef	gSignalEvent;
@@ -178,9 +185,6 @@ main(int ac, char *av[])
 
     gPid = getpid();
 
-    /* enable libpdel typed_mem */
-    typed_mem_enable();
-
     /* init global-config */
     memset(&gGlobalConf, 0, sizeof(gGlobalConf));
 
@@ -190,6 +194,13 @@ main(int ac, char *av[])
     memcpy(args, av, ac * sizeof(*av));	/* Copy to preserve "ps" output */
     OptParse(ac - 1, args + 1);
 
+    /* enable libpdel typed_mem, it must be done before any allocation */
+#ifdef NOLIBPDEL
+    typed_mem_enable_mode(gMemDebug ? TYPED_MEM_FULL : TYPED_MEM_COUNT);
+#else
+    typed_mem_enable();
+#endif
+
     /* init console-stuff */
     ConsoleInit(&gConsole);
 
@@ -250,7 +261,8 @@ main(int ac, char *av[])
 #ifdef CCP_MPPC
     MppcTestCap();
 #endif
-    if ((LinksInit() != 0) || (CcpsInit() != 0) || (EcpsInit() != 0))
+    if ((LinksInit() != 0) || (BundsInit() != 0) || (CcpsInit() != 0) ||
+      (EcpsInit() != 0))
 	exit(EX_UNAVAILABLE);
     
     /* Init device types. */
@@ -266,6 +278,7 @@ main(int ac, char *av[])
 	Log(LG_ERR, ("Could not create giant mutex %d", ret));
 	exit(EX_UNAVAILABLE);
     }
+    AdmissionInit();
 
     /* Create signaling pipe */
     if (pipe(gSignalPipe) < 0) {
@@ -658,6 +671,11 @@ OptApply(Option opt, int ac, char *av[])
 	case 'k':
     	    gKillProc = TRUE;
     	    return(0);
+#ifdef NOLIBPDEL
+	case 'M':
+    	    gMemDebug = TRUE;
+    	    return(0);
+#endif
 #ifdef SYSLOG_FACILITY
 	case 's':
     	    strlcpy(gSysLogIdent, *av, sizeof(gSysLogIdent));
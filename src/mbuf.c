@@ -12,6 +12,118 @@
  */
 
 #include "ppp.h"
+#include "util.h"
+
+#include <stdatomic.h>
+
+/*
+ * DEFINITIONS
+ */
+
+/*
+ * Mbufs of up to MBUF_MAX_CLASS bytes are kept in per size class object
+ * caches, so that the event thread and auth threads mostly allocate and
+ * free them from their own magazines without locking. Larger ones come
+ * from MALLOC() directly.
+ */
+
+  #define MBUF_MAX_CLASS	4096
+  #define MBUF_CACHE_MAG	64
+  #define MBUF_CACHE_MAX	1024
+
+  struct mbpool {
+    const char		*name;
+    int			size;		/* data size, excluding header */
+#ifdef NOLIBPDEL
+    struct objcache	*cache;
+#endif
+    atomic_uint		inuse;
+    atomic_uint		hiwat;
+    atomic_uint_fast64_t allocs;	/* when not counted by the cache */
+  };
+
+  /* One chunk of a memory region, data follows the header */
+  struct arena {
+    const char		*type;
+    struct arena	*next;		/* chunks added when full */
+    size_t		size;
+    size_t		used;
+  };
+  #define ARENA_HDR	ARENA_SIZE(sizeof(struct arena))
+  #define ARENA_DATA(a)	((u_char *)(a) + ARENA_HDR)
+
+/*
+ * Memory budgets limit the bytes allocated with one memory type, or in
+ * total. They are checked ten times a second by admission control, see
+ * MemBudgetUpdate(). Over budget new sessions are refused and free
+ * objects kept in caches are released.
+ */
+
+  #define MEM_BUDGET_MAX	16
+  #define MEM_BUDGET_TOTAL	"total"
+  #define MEM_BUDGET_CALM	75	/* percent, logged as back within */
+
+  struct membudget {
+    char		type[TYPED_MEM_TYPELEN];
+    u_long		limit;		/* bytes */
+    u_long		bytes;		/* at last check */
+    u_int		over;		/* checks found over budget */
+  };
+
+  /* Object cache walk state for MemDumpJSON() */
+  struct memjson {
+    FILE		*f;
+    int			n;
+  };
+
+/*
+ * INTERNAL FUNCTIONS
+ */
+
+  static struct mbpool	*MbPool(int size);
+  static void	MbPoolInit(void);
+  static void	MbPoolAlloc(struct mbpool *p);
+  static void	MbCopied(int cnt);
+  static int	MemTypeKnown(const char *type);
+#ifdef NOLIBPDEL
+  static void	MemStatCache(const struct objcache_stats *st, void *arg);
+  static void	MemJSONCache(const struct objcache_stats *st, void *arg);
+#endif
+
+/*
+ * INTERNAL VARIABLES
+ */
+
+  static struct mbpool	gMbPools[] = {
+    { "mbuf-64",	64 },
+    { "mbuf-256",	256 },
+    { "mbuf-1536",	1536 },
+    { "mbuf-4096",	MBUF_MAX_CLASS },
+    { "mbuf-large",	0 },			/* must be last */
+  };
+  #define MBUF_NPOOLS	(sizeof(gMbPools) / sizeof(*gMbPools))
+  #define MBUF_LARGE	(&gMbPools[MBUF_NPOOLS - 1])
+
+  static pthread_once_t	gMbPoolOnce = PTHREAD_ONCE_INIT;
+
+  /* Memory types of our own, which may be budgeted before first use */
+  static const char	*gMemTypes[] = {
+    MB_AUTH, MB_CONS, MB_WEB, MB_IFACE, MB_BUND, MB_REP, MB_LINK,
+    MB_CHAT, MB_CMD, MB_CMDL, MB_COMP, MB_CRYPT, MB_ECHO, MB_EVENT,
+    MB_FSM, MB_LOG, MB_MP, MB_MBUF, MB_PHYS, MB_PPTP, MB_RADIUS,
+    MB_RADSRV, MB_ACL, MB_IPFW, MB_UTIL, MB_VJCOMP, MB_IPPOOL, MB_ADMIT,
+  };
+  #define MEM_NTYPES	(sizeof(gMemTypes) / sizeof(*gMemTypes))
+
+  static struct membudget	gMemBudgets[MEM_BUDGET_MAX];
+  static int		gNumMemBudgets;
+  static u_int		gMemPressure;		/* percent, tightest budget */
+  static u_char		gMemOver;		/* logged as used up */
+  static u_long		gMemReclaimed;		/* bytes released from caches */
+
+  /* Data moved because an mbuf had no room to grow in place */
+  static atomic_uint_fast64_t	gMbCopies;
+  static atomic_uint_fast64_t	gMbCopied;
 
 /*
  * Malloc()
@@ -34,6 +146,49 @@ Malloc(const char *type, size_t size)
     return (memory + 1);
 }
 
+/*
+ * MallocRaw()
+ *
+ * Malloc() for callers that fill in the whole block themselves
+ */
+
+void *
+MallocRaw(const char *type, size_t size)
+{
+    const char	**memory;
+
+    if ((memory = MALLOC(type, sizeof(char *) + size)) == NULL) {
+	Perror("MallocRaw: malloc");
+	DoExit(EX_ERRDEAD);
+    }
+
+    memory[0] = type;
+    return (memory + 1);
+}
+
+/*
+ * Mrealloc()
+ *
+ * Resize a block from Malloc() or MallocRaw(), in place when possible.
+ * Added room is not cleared. A NULL block is allocated like MallocRaw().
+ */
+
+void *
+Mrealloc(const char *type, void *ptr, size_t size)
+{
+    const char	**memory;
+
+    if (ptr == NULL)
+	return (MallocRaw(type, size));
+    memory = (const char **)ptr - 1;
+    assert(memory[0] == type || strcmp(memory[0], type) == 0);
+    if ((memory = REALLOC(memory[0], memory, sizeof(char *) + size)) == NULL) {
+	Perror("Mrealloc: realloc");
+	DoExit(EX_ERRDEAD);
+    }
+    return (memory + 1);
+}
+
 /*
  * Mdup()
  *
@@ -90,6 +245,115 @@ Freee(void *ptr)
     }
 }
 
+/*
+ * ArenaNew()
+ *
+ * Create a memory region with room for "size" bytes, see ARENA_SIZE()
+ */
+
+Arena
+ArenaNew(const char *type, size_t size)
+{
+    Arena	a;
+
+    a = MallocRaw(type, ARENA_HDR + size);
+    a->type = type;
+    a->next = NULL;
+    a->size = size;
+    a->used = 0;
+    return (a);
+}
+
+/*
+ * ArenaAlloc()
+ *
+ * Carve a block out of a region, adding a chunk if it is full
+ */
+
+void *
+ArenaAlloc(Arena a, size_t size)
+{
+    Arena	c;
+    void	*ptr;
+
+    size = ARENA_SIZE(size);
+    for (c = a; c != NULL && c->size - c->used < size; c = c->next)
+	;
+    if (c == NULL) {
+	c = ArenaNew(a->type, size > a->size ? size : a->size);
+	c->next = a->next;
+	a->next = c;
+    }
+    ptr = ARENA_DATA(c) + c->used;
+    c->used += size;
+    return (ptr);
+}
+
+void *
+ArenaDup(Arena a, const void *src, size_t size)
+{
+    void	*ptr;
+
+    ptr = ArenaAlloc(a, size);
+    memcpy(ptr, src, size);
+    return (ptr);
+}
+
+char *
+ArenaStrdup(Arena a, const char *src)
+{
+    return (ArenaDup(a, src, strlen(src) + 1));
+}
+
+/*
+ * ArenaOwns()
+ *
+ * Tell whether a block was carved out of a region
+ */
+
+int
+ArenaOwns(Arena a, const void *ptr)
+{
+    for ( ; a != NULL; a = a->next) {
+	if ((const u_char *)ptr >= ARENA_DATA(a) &&
+	    (const u_char *)ptr < ARENA_DATA(a) + a->size)
+	    return (1);
+    }
+    return (0);
+}
+
+/*
+ * ArenaFreee()
+ *
+ * Freee() a block that may have been carved out of a region instead.
+ * Those are only released with the region.
+ */
+
+void
+ArenaFreee(Arena a, void *ptr)
+{
+    if (!ArenaOwns(a, ptr))
+	Freee(ptr);
+}
+
+/*
+ * ArenaFree()
+ *
+ * Release a region and every block carved out of it
+ */
+
+void
+ArenaFree(Arena *ap)
+{
+    Arena	a, next;
+
+    for (a = *ap; a != NULL; a = next) {
+	next = a->next;
+	Freee(a);
+    }
+    *ap = NULL;
+}
+
 /*
  * mballoc()
  *
@@ -99,29 +363,52 @@ Freee(void *ptr)
 Mbuf
 mballoc(int size)
 {
-    u_char	*memory;
-    int		amount, osize;
-    Mbuf	bp;
+    return (mballoc2(0, size));
+}
 
-    assert(size >= 0);
+/*
+ * mballoc2()
+ *
+ * Allocate an mbuf with room for "head" bytes of headers in front of
+ * "size" bytes of data. Up to MB_HEADROOM more bytes of the spare room
+ * go in front too, the rest stays at the tail.
+ */
 
-    if (size == 0) {
-	osize = 64 - sizeof(*bp);
-    } else if (size < 512)
-	osize = ((size - 1) / 32 + 1) * 64 - sizeof(*bp);
-    else
-	osize = ((size - 1) / 64 + 1) * 64 + 512 - sizeof(*bp);
-    amount = sizeof(*bp) + osize;
+Mbuf
+mballoc2(int head, int size)
+{
+    struct mbpool	*p;
+    u_char		*memory;
+    int			osize, spare;
+    Mbuf		bp;
+
+    assert(head >= 0);
+    assert(size >= 0);
 
-    if ((memory = MALLOC(MB_MBUF, amount)) == NULL) {
+    pthread_once(&gMbPoolOnce, MbPoolInit);
+    p = MbPool(head + size);
+    if (p != MBUF_LARGE) {
+	osize = p->size;
+#ifdef NOLIBPDEL
+	memory = objcache_get(p->cache);
+#else
+	memory = MALLOC(MB_MBUF, sizeof(*bp) + osize);
+#endif
+    } else {
+	osize = ((head + size - 1) / 64 + 1) * 64 + 512 - sizeof(*bp);
+	memory = MALLOC(MB_MBUF, sizeof(*bp) + osize);
+    }
+    if (memory == NULL) {
 	Perror("mballoc: malloc");
 	DoExit(EX_ERRDEAD);
     }
+    MbPoolAlloc(p);
 
     /* Put mbuf at front of memory region */
     bp = (Mbuf)(void *)memory;
     bp->size = osize;
-    bp->offset = (osize - size) / 2;
+    spare = osize - head - size;
+    bp->offset = head + (spare < MB_HEADROOM ? spare : MB_HEADROOM);
     bp->cnt = 0;
 
     return (bp);
@@ -136,8 +423,162 @@ mballoc(int size)
 void
 mbfree(Mbuf bp)
 {
-    if (bp)
-	FREE(MB_MBUF, bp);
+    struct mbpool	*p;
+
+    if (bp == NULL)
+	return;
+    p = MbPool(bp->size);
+    atomic_fetch_sub_explicit(&p->inuse, 1, memory_order_relaxed);
+#ifdef NOLIBPDEL
+    if (p != MBUF_LARGE) {
+	objcache_put(p->cache, bp);
+	return;
+    }
+#endif
+    FREE(MB_MBUF, bp);
+}
+
+/*
+ * mbprepend()
+ *
+ * Put "cnt" bytes from buffer in front of the data. This is done in
+ * place if there is enough headroom, otherwise the data is moved to a
+ * new mbuf. Consumes the mbuf and returns the result.
+ *
+ * This should ALWAYS be called like this:
+ *	bp = mbprepend(bp, ... );
+ */
+
+Mbuf
+mbprepend(Mbuf bp, const void *buf, int cnt)
+{
+    Mbuf	nbp;
+
+    assert(cnt >= 0);
+
+    if (bp == NULL || bp->offset < cnt) {
+	nbp = mballoc2(cnt, MBLEN(bp));
+	if (bp) {
+	    memcpy(MBDATAU(nbp), MBDATAU(bp), bp->cnt);
+	    nbp->cnt = bp->cnt;
+	    MbCopied(bp->cnt);
+	    mbfree(bp);
+	}
+	bp = nbp;
+    }
+    bp->offset -= cnt;
+    bp->cnt += cnt;
+    memcpy(MBDATAU(bp), buf, cnt);
+    return (bp);
+}
+
+/*
+ * mbappend()
+ *
+ * Put "cnt" bytes from buffer after the data, in place if there is
+ * enough tailroom. Consumes the mbuf and returns the result.
+ *
+ * This should ALWAYS be called like this:
+ *	bp = mbappend(bp, ... );
+ */
+
+Mbuf
+mbappend(Mbuf bp, const void *buf, int cnt)
+{
+    Mbuf	nbp;
+
+    assert(cnt >= 0);
+
+    if (bp == NULL || MBTAIL(bp) < cnt) {
+	nbp = mballoc(MBLEN(bp) + cnt);
+	if (bp) {
+	    memcpy(MBDATAU(nbp), MBDATAU(bp), bp->cnt);
+	    nbp->cnt = bp->cnt;
+	    MbCopied(bp->cnt);
+	    mbfree(bp);
+	}
+	bp = nbp;
+    }
+    memcpy(MBDATAU(bp) + bp->cnt, buf, cnt);
+    bp->cnt += cnt;
+    return (bp);
+}
+
+/*
+ * MbPool()
+ *
+ * Find the pool for "size" bytes of data. Pooled mbufs always have
+ * exactly the size of their class, so mbfree() finds it the same way.
+ */
+
+static struct mbpool *
+MbPool(int size)
+{
+    u_int	k;
+
+    for (k = 0; k < MBUF_NPOOLS - 1; k++) {
+	if (size <= gMbPools[k].size)
+	    return (&gMbPools[k]);
+    }
+    return (MBUF_LARGE);
+}
+
+/*
+ * MbPoolInit()
+ */
+
+static void
+MbPoolInit(void)
+{
+#ifdef NOLIBPDEL
+    u_int	k;
+
+    for (k = 0; k < MBUF_NPOOLS - 1; k++) {
+	struct mbpool	*p = &gMbPools[k];
+
+	if ((p->cache = objcache_create(p->name, MB_MBUF,
+	  sizeof(struct mpdmbuf) + p->size, MBUF_CACHE_MAG,
+	  MBUF_CACHE_MAX)) == NULL) {
+	    Perror("mballoc: objcache_create");
+	    DoExit(EX_ERRDEAD);
+	}
+    }
+#endif
+}
+
+/*
+ * MbCopied()
+ *
+ * Account data that had to be moved to make room.
+ */
+
+static void
+MbCopied(int cnt)
+{
+    atomic_fetch_add_explicit(&gMbCopies, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&gMbCopied, cnt, memory_order_relaxed);
+}
+
+/*
+ * MbPoolAlloc()
+ *
+ * Account an allocation and track the high water mark.
+ */
+
+static void
+MbPoolAlloc(struct mbpool *p)
+{
+    u_int	inuse, hiwat;
+
+#ifdef NOLIBPDEL
+    if (p == MBUF_LARGE)
+#endif
+	atomic_fetch_add_explicit(&p->allocs, 1, memory_order_relaxed);
+    inuse = atomic_fetch_add_explicit(&p->inuse, 1, memory_order_relaxed) + 1;
+    hiwat = atomic_load_explicit(&p->hiwat, memory_order_relaxed);
+    while (inuse > hiwat && !atomic_compare_exchange_weak_explicit(&p->hiwat,
+      &hiwat, inuse, memory_order_relaxed, memory_order_relaxed))
+	;
 }
 
 /*
@@ -228,11 +669,13 @@ mbcopyback(Mbuf bp, int offset, const void *buf, int cnt)
 	Mbuf	nbp = mballoc(b + bp->cnt + e);
 	memcpy(MBDATAU(nbp) + b, MBDATAU(bp), bp->cnt);
 	nbp->cnt = bp->cnt;
+	MbCopied(bp->cnt);
 	mbfree(bp);
 	bp = nbp;
     } else if ((b > bp->offset) || (bp->offset + bp->cnt + e > bp->size)) {
 	int	noff = (bp->size - (b + bp->cnt + e)) / 2;
 	memmove(MBDATAU(bp) - bp->offset + noff + b, MBDATAU(bp), bp->cnt);
+	MbCopied(bp->cnt);
 	bp->offset = noff;
     } else {
 	bp->offset -= b;
@@ -336,10 +779,13 @@ MemStat(Context ctx, int ac, const char *const av[], const void *arg)
     u_int	total_allocs = 0;
     u_int	total_bytes = 0;
 
-    (void)ac;
-    (void)av;
     (void)arg;
 
+    if (ac == 1 && strcmp(av[0], "per-session") == 0)
+	return (BundMemStat(ctx));
+    if (ac != 0)
+	return (-1);
+
     if (typed_mem_usage(&stats))
 	Error("typed_mem_usage() error");
     
@@ -361,6 +807,301 @@ MemStat(Context ctx, int ac, const char *const av[], const void *arg)
         "Totals", total_allocs, total_bytes);
 
     structs_free(&typed_mem_stats_type, NULL, &stats);
+
+    Printf("\r\n   %-20s %6s %8s %8s %12s %12s %10s\r\n", "Mbuf pool",
+	"Size", "In use", "High", "Allocs", "Frees", "Misses");
+    for (i = 0; i < MBUF_NPOOLS; i++) {
+	struct mbpool	*p = &gMbPools[i];
+	uint64_t	allocs, misses;
+	u_int		inuse;
+
+	allocs = atomic_load_explicit(&p->allocs, memory_order_relaxed);
+	inuse = atomic_load_explicit(&p->inuse, memory_order_relaxed);
+	misses = allocs;
+#ifdef NOLIBPDEL
+	if (p->cache != NULL) {
+	    struct objcache_stats	st;
+
+	    objcache_get_stats(p->cache, &st);
+	    allocs = st.gets;
+	    misses = st.misses;
+	}
+#endif
+	Printf("   %-20s %6d %8u %8u %12ju %12ju %10ju\r\n",
+	    p->name, p->size, inuse,
+	    atomic_load_explicit(&p->hiwat, memory_order_relaxed),
+	    (uintmax_t)allocs, (uintmax_t)(allocs - inuse), (uintmax_t)misses);
+    }
+    Printf("   Data moved to grow mbufs: %ju bytes in %ju copies\r\n",
+	(uintmax_t)atomic_load_explicit(&gMbCopied, memory_order_relaxed),
+	(uintmax_t)atomic_load_explicit(&gMbCopies, memory_order_relaxed));
+
+    SlotStat(ctx);
+
+    if (gNumMemBudgets > 0) {
+	Printf("\r\n   %-28s %10s %10s %5s %8s\r\n", "Budget",
+	    "Total", "Limit", "Use%", "Over");
+	for (i = 0; i < (u_int)gNumMemBudgets; i++) {
+	    struct membudget	*mb = &gMemBudgets[i];
+
+	    Printf("   %-28s %10lu %10lu %5ju %8u\r\n", mb->type, mb->bytes,
+		mb->limit, (uintmax_t)mb->bytes * 100 / mb->limit, mb->over);
+	}
+	Printf("   Memory pressure: %u%%, %lu bytes released from caches\r\n",
+	    gMemPressure, gMemReclaimed);
+    }
+
+#ifdef NOLIBPDEL
+    Printf("\r\n   %-20s %6s %8s %8s %12s %5s %10s %10s\r\n", "Object cache",
+	"Size", "In use", "Cached", "Gets", "Hit%", "Allocated", "Released");
+    objcache_walk(MemStatCache, ctx);
+#endif
     return(0);
 }
 
+/*
+ * MemBudgetSet()
+ *
+ * Set the budget for a memory type in bytes, zero removes it. The type
+ * must be one of ours, one listed by "show mem", or "total". On error
+ * sets errno to ENOENT for an unknown type or ENOSPC when there are too
+ * many budgets.
+ */
+
+int
+MemBudgetSet(const char *type, u_long limit)
+{
+    int		k;
+
+    for (k = 0; k < gNumMemBudgets; k++) {
+	if (strcmp(gMemBudgets[k].type, type) == 0)
+	    break;
+    }
+    if (k == gNumMemBudgets && strcmp(type, MEM_BUDGET_TOTAL) != 0 &&
+      !MemTypeKnown(type)) {
+	errno = ENOENT;
+	return (-1);
+    }
+    if (limit == 0) {
+	if (k < gNumMemBudgets) {
+	    gMemBudgets[k] = gMemBudgets[--gNumMemBudgets];
+	    if (gNumMemBudgets == 0)
+		gMemPressure = gMemOver = 0;
+	}
+	return (0);
+    }
+    if (k == gNumMemBudgets) {
+	if (gNumMemBudgets == MEM_BUDGET_MAX) {
+	    errno = ENOSPC;
+	    return (-1);
+	}
+	memset(&gMemBudgets[k], 0, sizeof(gMemBudgets[k]));
+	strlcpy(gMemBudgets[k].type, type, sizeof(gMemBudgets[k].type));
+	gNumMemBudgets++;
+    }
+    gMemBudgets[k].limit = limit;
+    return (0);
+}
+
+/*
+ * MemTypeKnown()
+ *
+ * See if the type is one of ours, or typed memory reports a type of
+ * that exact name, e.g. one used inside libpdel.
+ */
+
+static int
+MemTypeKnown(const char *type)
+{
+    struct typed_mem_stats stats;
+    u_int	i;
+    int		found = FALSE;
+
+    for (i = 0; i < MEM_NTYPES; i++) {
+	if (strcmp(gMemTypes[i], type) == 0)
+	    return (TRUE);
+    }
+    if (typed_mem_usage(&stats) != 0)
+	return (FALSE);
+    for (i = 0; i < stats.length && !found; i++)
+	found = (strcmp(stats.elems[i].type, type) == 0);
+    structs_free(&typed_mem_stats_type, NULL, &stats);
+    return (found);
+}
+
+/*
+ * MemBudgetUpdate()
+ *
+ * Compare memory in use with the budgets and return the pressure, in
+ * percent of the tightest one. A budget is used up from 100% on, which
+ * is also where admission control starts refusing sessions. Cached free
+ * objects are then released at once, as the budget may be met without
+ * refusing anyone.
+ */
+
+u_int
+MemBudgetUpdate(void)
+{
+    struct typed_mem_stats stats;
+    struct membudget	*mb;
+    u_long	total = 0;
+    uint64_t	use;
+    u_int	pressure = 0, i;
+    int		k, over = 0;
+
+    if (gNumMemBudgets == 0 || typed_mem_usage(&stats) != 0)
+	return (gMemPressure = gMemOver = 0);
+    for (k = 0; k < gNumMemBudgets; k++)
+	gMemBudgets[k].bytes = 0;
+    for (i = 0; i < stats.length; i++) {
+	struct typed_mem_typestats *type = &stats.elems[i];
+
+	total += type->bytes;
+	for (k = 0; k < gNumMemBudgets; k++) {
+	    if (strcmp(gMemBudgets[k].type, type->type) == 0)
+		gMemBudgets[k].bytes = type->bytes;
+	}
+    }
+    structs_free(&typed_mem_stats_type, NULL, &stats);
+
+    for (k = 0; k < gNumMemBudgets; k++) {
+	mb = &gMemBudgets[k];
+	if (strcmp(mb->type, MEM_BUDGET_TOTAL) == 0)
+	    mb->bytes = total;
+	use = (uint64_t)mb->bytes * 100 / mb->limit;
+	if (use > pressure)
+	    pressure = use;
+	if (use >= 100) {
+	    mb->over++;
+	    over = 1;
+	}
+    }
+
+    if (over) {
+	if (!gMemOver)
+	    Log(LG_ERR, ("Memory budget used up, pressure %u%%", pressure));
+	gMemOver = TRUE;
+#ifdef NOLIBPDEL
+	gMemReclaimed += objcache_reclaim();
+#endif
+    } else if (gMemOver && pressure < MEM_BUDGET_CALM) {
+	Log(LG_ERR, ("Memory back within budget, pressure %u%%", pressure));
+	gMemOver = FALSE;
+    }
+    return (gMemPressure = pressure);
+}
+
+/*
+ * MemPressure()
+ *
+ * Pressure found by the last MemBudgetUpdate().
+ */
+
+u_int
+MemPressure(void)
+{
+    return (gMemPressure);
+}
+
+/*
+ * MemBudgetShow()
+ */
+
+void
+MemBudgetShow(Context ctx)
+{
+    int		k;
+
+    for (k = 0; k < gNumMemBudgets; k++) {
+	Printf("	mem-budget	: %s %lu KB\r\n", gMemBudgets[k].type,
+	    gMemBudgets[k].limit / 1024);
+    }
+}
+
+#ifdef NOLIBPDEL
+/*
+ * MemStatCache()
+ */
+
+static void
+MemStatCache(const struct objcache_stats *st, void *arg)
+{
+    Context	ctx = (Context)arg;
+
+    Printf("   %-20s %6zu %8u %8u %12ju %5ju %10ju %10ju\r\n",
+	st->name, st->size, st->inuse, st->cached, (uintmax_t)st->gets,
+	(uintmax_t)(st->gets ? (st->gets - st->misses) * 100 / st->gets : 0),
+	(uintmax_t)st->misses, (uintmax_t)st->releases);
+}
+#endif
+
+/*
+ * MemDumpJSON()
+ *
+ * Live blocks and bytes per memory type and mbuf pool usage for the
+ * web interface. Cheap enough to be polled unless mpdx runs with -M.
+ */
+
+void
+MemDumpJSON(FILE *f)
+{
+    struct typed_mem_stats stats;
+    uint64_t	total_allocs = 0;
+    uint64_t	total_bytes = 0;
+    u_int	i;
+
+    fprintf(f, "{\"types\":[\n");
+    if (typed_mem_usage(&stats) == 0) {
+	for (i = 0; i < stats.length; i++) {
+	    struct typed_mem_typestats *type = &stats.elems[i];
+
+	    fprintf(f, "%s{\"type\": \"%s\", \"count\": %u, \"bytes\": %ju}",
+		i ? ",\n" : "", type->type, type->allocs, (uintmax_t)type->bytes);
+	    total_allocs += type->allocs;
+	    total_bytes += type->bytes;
+	}
+	structs_free(&typed_mem_stats_type, NULL, &stats);
+    }
+    fprintf(f, "\n],\n");
+    fprintf(f, "\"count\": %ju,\n", (uintmax_t)total_allocs);
+    fprintf(f, "\"bytes\": %ju,\n", (uintmax_t)total_bytes);
+
+    fprintf(f, "\"mbuf_pools\":[\n");
+    for (i = 0; i < MBUF_NPOOLS; i++) {
+	struct mbpool	*p = &gMbPools[i];
+
+	fprintf(f, "%s{\"pool\": \"%s\", \"size\": %d, \"inuse\": %u, \"high\": %u}",
+	    i ? ",\n" : "", p->name, p->size,
+	    atomic_load_explicit(&p->inuse, memory_order_relaxed),
+	    atomic_load_explicit(&p->hiwat, memory_order_relaxed));
+    }
+    fprintf(f, "\n],\n");
+
+    fprintf(f, "\"object_caches\":[\n");
+#ifdef NOLIBPDEL
+    {
+	struct memjson	mj = { f, 0 };
+
+	objcache_walk(MemJSONCache, &mj);
+    }
+#endif
+    fprintf(f, "\n]}\n");
+}
+
+#ifdef NOLIBPDEL
+/*
+ * MemJSONCache()
+ */
+
+static void
+MemJSONCache(const struct objcache_stats *st, void *arg)
+{
+    struct memjson	*mj = (struct memjson *)arg;
+
+    fprintf(mj->f, "%s{\"cache\": \"%s\", \"size\": %zu, \"inuse\": %u, "
+	"\"cached\": %u, \"gets\": %ju, \"misses\": %ju}",
+	mj->n++ ? ",\n" : "", st->name, st->size, st->inuse, st->cached,
+	(uintmax_t)st->gets, (uintmax_t)st->misses);
+}
+#endif
+
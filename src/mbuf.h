@@ -31,6 +31,22 @@
   #define MBDATA(bp)	((bp) ? MBDATAU(bp) : NULL)
   #define MBLEN(bp)	((size_t)((bp) ? (bp)->cnt : 0))
   #define MBSPACE(bp)	((bp) ? (bp)->size - (bp)->offset : 0)
+  #define MBHEAD(bp)	((bp) ? (bp)->offset : 0)
+  #define MBTAIL(bp)	((bp) ? (bp)->size - (bp)->offset - (bp)->cnt : 0)
+
+  /* Spare room left in front of new data for headers, when available */
+  #define MB_HEADROOM	16
+
+  /*
+   * Memory region whose blocks are all released at once by ArenaFree().
+   * Blocks are aligned like Malloc() ones and ARENA_SIZE() gives the
+   * room one takes, so a caller can size the region up front.
+   */
+  struct arena;
+  typedef struct arena	*Arena;
+
+  #define ARENA_ALIGN		sizeof(void *)
+  #define ARENA_SIZE(size)	roundup((size_t)(size), ARENA_ALIGN)
 
   /* Types of allocated memory */
   #define MB_AUTH	"AUTH"
@@ -60,6 +76,7 @@
   #define MB_UTIL	"UTIL"
   #define MB_VJCOMP	"VJCOMP"
   #define MB_IPPOOL	"IPPOOL"
+  #define MB_ADMIT	"ADMIT"
 
 #ifndef __malloc_like
 #define __malloc_like
@@ -72,15 +89,30 @@
 /* Replacements for malloc() & free() */
 
   extern void	*Malloc(const char *type, size_t size) __malloc_like;
+  extern void	*MallocRaw(const char *type, size_t size) __malloc_like;
+  extern void	*Mrealloc(const char *type, void *ptr, size_t size);
   extern void	*Mdup(const char *type, const void *src, size_t size) __malloc_like;
   extern void	*Mdup2(const char *type, const void *src, size_t oldsize, size_t newsize) __malloc_like;
   extern void	*Mstrdup(const char *type, const void *src) __malloc_like;
   extern void	Freee(void *ptr);
 
+/* Memory regions */
+
+  extern Arena	ArenaNew(const char *type, size_t size);
+  extern void	*ArenaAlloc(Arena a, size_t size) __malloc_like;
+  extern void	*ArenaDup(Arena a, const void *src, size_t size) __malloc_like;
+  extern char	*ArenaStrdup(Arena a, const char *src) __malloc_like;
+  extern int	ArenaOwns(Arena a, const void *ptr);
+  extern void	ArenaFreee(Arena a, void *ptr);
+  extern void	ArenaFree(Arena *ap);
+
 /* Mbuf manipulation */
 
   extern Mbuf	mballoc(int size) __malloc_like;
+  extern Mbuf	mballoc2(int head, int size) __malloc_like;
   extern void	mbfree(Mbuf bp);
+  extern Mbuf	mbprepend(Mbuf bp, const void *buf, int cnt);
+  extern Mbuf	mbappend(Mbuf bp, const void *buf, int cnt);
   extern Mbuf	mbread(Mbuf bp, void *ptr, int cnt);
   extern int	mbcopy(Mbuf bp, int offset, void *buf, int cnt);
   extern Mbuf	mbcopyback(Mbuf bp, int offset, const void *buf, int cnt);
@@ -91,6 +123,11 @@
 /* Etc */
 
   extern int	MemStat(Context ctx, int ac, const char *const av[], const void *arg);
+  extern void	MemDumpJSON(FILE *f);
+  extern int	MemBudgetSet(const char *type, u_long limit);
+  extern u_int	MemBudgetUpdate(void);
+  extern u_int	MemPressure(void);
+  extern void	MemBudgetShow(Context ctx);
   extern void	DumpBp(Mbuf bp);
 
 #endif
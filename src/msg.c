@@ -9,34 +9,58 @@
 
 #include "ppp.h"
 #include "msg.h"
+#include "event.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
 
 /*
  * DEFINITIONS
  */
 
-/* Which pipe file descriptor is which */
+  #define MSG_CACHE_MAG		64
+  #define MSG_CACHE_MAX		1024
+  #define MSG_SPIN_MAX		16	/* yields before leaving a gap */
 
-  #define PIPE_READ		0
-  #define PIPE_WRITE		1
+/*
+ * Messages are kept on an intrusive multi-producer, single-consumer
+ * queue (D. Vyukov's algorithm). Senders only swap the head pointer,
+ * the event thread alone follows the next links from the tail. The
+ * stub node keeps the queue from ever becoming truly empty.
+ */
 
   struct mpmsg
   {
-    int		type;
-    void	(*func)(int type, void *arg);
-    void	*arg;
-    const char	*dbg;
+    int			type;
+    void		(*func)(int type, void *arg);
+    void		*arg;
+    const char		*dbg;
+    struct timespec	sent;
+    _Atomic(struct mpmsg *) next;
   };
   typedef struct mpmsg	*Msg;
 
-  static struct mpmsg	msgqueue[MSG_QUEUE_LEN];
-  static int		msgqueueh = 0;
-  static int		msgqueuet = 0;
-  #define	QUEUELEN()	((msgqueueh >= msgqueuet)?	\
-	(msgqueueh - msgqueuet):(msgqueueh + MSG_QUEUE_LEN - msgqueuet))
+  static struct mpmsg		msgstub;
+  static _Atomic(Msg)		msghead = &msgstub;
+  static Msg			msgtail = &msgstub;
+  static atomic_int		msgdepth;
+  static EventRef		msgevent;
+#ifdef NOLIBPDEL
+  static struct objcache	*msgcache;
+#endif
 
-  static int		msgpipe[2];
-  static int		msgpipesent = 0;
-  static EventRef	msgevent;
+  struct msgstat
+  {
+    atomic_uint		sent;
+    u_int		received;
+    u_int		wakeups;
+    atomic_uint		maxdepth;
+    u_int		maxbatch;
+    uint64_t		latsum;		/* usec */
+    u_int		latmax;		/* usec */
+  };
+  static struct msgstat	msgstat;
 
 /*
  * GLOBAL VARIABLES
@@ -51,6 +75,8 @@
  */
 
   static void	MsgEvent(int type, void *cookie);
+  static void	MsgPush(Msg msg);
+  static Msg	MsgPop(void);
 
 /*
  * MsgRegister()
@@ -59,22 +85,16 @@
 void
 MsgRegister2(MsgHandler *m, void (*func)(int type, void *arg), const char *dbg)
 {
-    if ((msgpipe[0]==0) || (msgpipe[1]==0)) {
-	if (pipe(msgpipe) < 0) {
-	    Perror("%s: Can't create message pipe", 
-		__FUNCTION__);
+    if (!EventIsRegistered(&msgevent)) {
+#ifdef NOLIBPDEL
+	if ((msgcache = objcache_create("msg", MB_EVENT,
+	    sizeof(struct mpmsg), MSG_CACHE_MAG, MSG_CACHE_MAX)) == NULL) {
+	    Perror("%s: Can't create message cache", __FUNCTION__);
 	    DoExit(EX_ERRDEAD);
 	}
-	fcntl(msgpipe[PIPE_READ], F_SETFD, 1);
-	fcntl(msgpipe[PIPE_WRITE], F_SETFD, 1);
-
-	if (fcntl(msgpipe[PIPE_READ], F_SETFL, O_NONBLOCK) < 0)
-    	    Perror("%s: fcntl", __FUNCTION__);
-	if (fcntl(msgpipe[PIPE_WRITE], F_SETFL, O_NONBLOCK) < 0)
-    	    Perror("%s: fcntl", __FUNCTION__);
-
-	if (EventRegister(&msgevent, EVENT_READ,
-		msgpipe[PIPE_READ], EVENT_RECURRING, MsgEvent, NULL) < 0) {
+#endif
+	if (EventRegister(&msgevent, EVENT_USER, 0,
+		EVENT_RECURRING, MsgEvent, NULL) < 0) {
 	    Perror("%s: Can't register event", __FUNCTION__);
 	    DoExit(EX_ERRDEAD);
         }
@@ -95,62 +115,189 @@ MsgUnRegister(MsgHandler *m)
     m->dbg = NULL;
 }
 
+/*
+ * MsgPush()
+ *
+ * Append a message. Safe to call from any thread.
+ */
+
+static void
+MsgPush(Msg msg)
+{
+    Msg	prev;
+
+    atomic_store_explicit(&msg->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&msghead, msg, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, msg, memory_order_release);
+}
+
+/*
+ * MsgPop()
+ *
+ * Remove the oldest message. Returns NULL if the queue is empty or
+ * a sender is half way through MsgPush(). Event thread only.
+ */
+
+static Msg
+MsgPop(void)
+{
+    Msg	tail = msgtail;
+    Msg	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &msgstub) {
+	if (next == NULL)
+	    return (NULL);
+	msgtail = tail = next;
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+	msgtail = next;
+	return (tail);
+    }
+    if (tail != atomic_load_explicit(&msghead, memory_order_acquire))
+	return (NULL);
+    MsgPush(&msgstub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+	msgtail = next;
+	return (tail);
+    }
+    return (NULL);
+}
+
 /*
  * MsgEvent()
+ *
+ * A sender that was preempted between the head swap and the link hides
+ * the messages behind it. Rather than spin with the giant lock held,
+ * give up after a few yields and come back on the next event loop pass.
  */
 
 static void
 MsgEvent(int type, void *cookie)
 {
-    char	buf[16];
+    struct timespec	now;
+    Msg			msg;
+    u_int		batch = 0, spin = 0, lat;
 
     (void)type;
     (void)cookie;
-    /* flush signaling pipe */
-    msgpipesent = 0;
-    while (read(msgpipe[PIPE_READ], buf, sizeof(buf)) == sizeof(buf));
 
-    while (msgqueuet != msgqueueh) {
+    msgstat.wakeups++;
+    while (atomic_load_explicit(&msgdepth, memory_order_acquire) > 0) {
+	if ((msg = MsgPop()) == NULL) {
+	    /* Sender is between the head swap and the link */
+	    if (++spin > MSG_SPIN_MAX) {
+		EventTrigger(&msgevent);
+		break;
+	    }
+	    sched_yield();
+	    continue;
+	}
+	spin = 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lat = (now.tv_sec - msg->sent.tv_sec) * 1000000 +
+	    (now.tv_nsec - msg->sent.tv_nsec) / 1000;
+	msgstat.latsum += lat;
+	if (lat > msgstat.latmax)
+	    msgstat.latmax = lat;
+
 	Log(LG_EVENTS, ("EVENT: Message %d to %s received",
-	    msgqueue[msgqueuet].type, msgqueue[msgqueuet].dbg));
-	(*(msgqueue[msgqueuet].func))(msgqueue[msgqueuet].type, msgqueue[msgqueuet].arg);
+	    msg->type, msg->dbg));
+	(*msg->func)(msg->type, msg->arg);
 	Log(LG_EVENTS, ("EVENT: Message %d to %s processed",
-	    msgqueue[msgqueuet].type, msgqueue[msgqueuet].dbg));
-
-	msgqueuet = (msgqueuet + 1) & MSG_QUEUE_MASK;
-	SETOVERLOAD(QUEUELEN());
+	    msg->type, msg->dbg));
+#ifdef NOLIBPDEL
+	objcache_put(msgcache, msg);
+#else
+	Freee(msg);
+#endif
+
+	batch++;
+	atomic_fetch_sub(&msgdepth, 1);
     }
+    msgstat.received += batch;
+    if (batch > msgstat.maxbatch)
+	msgstat.maxbatch = batch;
 }
 
 /*
  * MsgSend()
+ *
+ * May be called from any thread. Only the sender that finds the queue
+ * empty wakes up the event thread.
  */
 
 void
 MsgSend(MsgHandler *m, int type, void *arg)
 {
+    Msg		msg;
+    int		depth;
+    u_int	max;
+
     assert(m);
     assert(m->func);
 
-    msgqueue[msgqueueh].type = type;
-    msgqueue[msgqueueh].func = m->func;
-    msgqueue[msgqueueh].arg = arg;
-    msgqueue[msgqueueh].dbg = m->dbg;
-
-    msgqueueh = (msgqueueh + 1) & MSG_QUEUE_MASK;
-    if (msgqueuet == msgqueueh) {
-        Log(LG_ERR, ("%s: Fatal message queue overflow!", __FUNCTION__));
-        DoExit(EX_ERRDEAD);
+#ifdef NOLIBPDEL
+    if ((msg = objcache_get(msgcache)) == NULL) {
+	Perror("%s: Can't allocate message", __FUNCTION__);
+	DoExit(EX_ERRDEAD);
     }
+#else
+    msg = Malloc(MB_EVENT, sizeof(*msg));
+#endif
+    msg->type = type;
+    msg->func = m->func;
+    msg->arg = arg;
+    msg->dbg = m->dbg;
+    clock_gettime(CLOCK_MONOTONIC, &msg->sent);
+
+    depth = atomic_fetch_add(&msgdepth, 1) + 1;
+    MsgPush(msg);
+    atomic_fetch_add_explicit(&msgstat.sent, 1, memory_order_relaxed);
+    max = atomic_load_explicit(&msgstat.maxdepth, memory_order_relaxed);
+    while ((u_int)depth > max &&
+      !atomic_compare_exchange_weak_explicit(&msgstat.maxdepth, &max, depth,
+	memory_order_relaxed, memory_order_relaxed))
+	;
+
+    if (depth == 1)
+	EventTrigger(&msgevent);
+    Log(LG_EVENTS, ("EVENT: Message %d to %s sent", type, m->dbg));
+}
+
+/*
+ * MsgQueueLen()
+ *
+ * Number of messages waiting in the queue.
+ */
 
-    SETOVERLOAD(QUEUELEN());
+int
+MsgQueueLen(void)
+{
+    return (atomic_load_explicit(&msgdepth, memory_order_relaxed));
+}
 
-    if (!msgpipesent) {
-	char	buf[1] = { 0x2a };
-	if (write(msgpipe[PIPE_WRITE], buf, 1) > 0)
-	    msgpipesent = 1;
-    }
-    Log(LG_EVENTS, ("EVENT: Message %d to %s sent", type, m->dbg));
+/*
+ * MsgStat()
+ */
+
+void
+MsgStat(Context ctx)
+{
+    u_int	received = msgstat.received;
+
+    Printf("Message queue:\r\n");
+    Printf("\tDepth       : %d (max %u)\r\n",
+	atomic_load(&msgdepth), atomic_load(&msgstat.maxdepth));
+    Printf("\tSent        : %u\r\n", atomic_load(&msgstat.sent));
+    Printf("\tReceived    : %u in %u wakeups\r\n",
+	received, msgstat.wakeups);
+    Printf("\tBatch size  : %u avg, %u max\r\n",
+	msgstat.wakeups ? received / msgstat.wakeups : 0, msgstat.maxbatch);
+    Printf("\tLatency     : %ju us avg, %u us max\r\n",
+	received ? (uintmax_t)(msgstat.latsum / received) : (uintmax_t)0,
+	msgstat.latmax);
 }
 
 /*
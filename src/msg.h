@@ -10,6 +10,8 @@
 #ifndef _MSG_H_
 #define _MSG_H_
 
+#include "defs.h"
+
 /*
  * DEFINITIONS
  */
@@ -23,11 +25,9 @@
   #define MSG_SHUTDOWN		5	/* Object should disappear */
 
 #ifndef SMALL_SYSTEM
-  #define MSG_QUEUE_LEN		8192	/* Internal messages queue length */
-  #define MSG_QUEUE_MASK	0x1FFF	/* Mask for this length */
+  #define MSG_QUEUE_LEN		8192	/* Limit for queue thresholds */
 #else
   #define MSG_QUEUE_LEN		512
-  #define MSG_QUEUE_MASK	0x1FF
 #endif
 
 /*
@@ -56,6 +56,8 @@
   extern void		MsgUnRegister(MsgHandler *m);
   extern void		MsgSend(MsgHandler *m, int type, void *arg);
   extern const char	*MsgName(int msg);
+  extern int		MsgQueueLen(void);
+  extern void		MsgStat(Context ctx);
 
 #endif
 
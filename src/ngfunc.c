@@ -541,13 +541,12 @@ retry:
 int
 NgFuncWritePppFrame(Bund b, int linkNum, int proto, Mbuf bp)
 {
-    u_int16_t	temp;
+    u_int16_t	hdr[2];
 
     /* Prepend ppp node bypass header */
-    temp = htons(linkNum);
-    bp = mbcopyback(bp, -4, &temp, 2);
-    temp = htons(proto);
-    bp = mbcopyback(bp, 2, &temp, 2);
+    hdr[0] = htons(linkNum);
+    hdr[1] = htons(proto);
+    bp = mbprepend(bp, hdr, sizeof(hdr));
 
     /* Debugging */
     LogDumpBp(LG_FRAME, bp,
@@ -576,17 +575,16 @@ NgFuncWritePppFrame(Bund b, int linkNum, int proto, Mbuf bp)
 int
 NgFuncWritePppFrameLink(Link l, int proto, Mbuf bp)
 {
-    u_int16_t	temp;
+    u_int16_t	hdr[2];
 
     if (l->joined_bund) {
 	return (NgFuncWritePppFrame(l->bund, l->bundleIndex, proto, bp));
     }
 
     /* Prepend framing */
-    temp = htons(0xff03);
-    bp = mbcopyback(bp, -4, &temp, 2);
-    temp = htons(proto);
-    bp = mbcopyback(bp, 2, &temp, 2);
+    hdr[0] = htons(0xff03);
+    hdr[1] = htons(proto);
+    bp = mbprepend(bp, hdr, sizeof(hdr));
 
     /* Debugging */
     LogDumpBp(LG_FRAME, bp,
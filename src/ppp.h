@@ -46,6 +46,7 @@
 #include "contrib/libpdel/util/pevent.h"
 #include "contrib/libpdel/util/paction.h"
 #include "contrib/libpdel/util/ghash.h"
+#include "contrib/libpdel/util/objcache.h"
 #else
 #include <pdel/structs/structs.h>
 #include <pdel/structs/type/array.h>
@@ -96,20 +97,6 @@
   #define RWLOCK_WRLOCK(m)	assert(pthread_rwlock_wrlock(&m) == 0)
   #define RWLOCK_UNLOCK(m)	assert(pthread_rwlock_unlock(&m) == 0)
 
-  #define SETOVERLOAD(q)						\
-	do {								\
-		int t = (q);						\
-		if (t > gQThresMax) {					\
-			gOverload = 100;				\
-		} else if (t > gQThresMin) {				\
-			gOverload = (t - gQThresMin) * 100/gQThresDiff;	\
-		} else {						\
-			gOverload = 0;					\
-		}							\
-	} while (0)
-
-  #define OVERLOAD()		(gOverload > (random() % 100))
-  
   #define REF(p)		do {					\
 				    (p)->refs++;			\
 				} while (0)
@@ -211,7 +198,6 @@
   extern struct radsrv	gRadsrv;
   extern int		gBackground;
   extern int		gShutdownInProgress;
-  extern int		gOverload;
   extern pid_t		gPid;
   extern int		gRouteSeq;
 
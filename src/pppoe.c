@@ -12,6 +12,7 @@
 #include "ngfunc.h"
 #include "log.h"
 #include "util.h"
+#include "admission.h"
 
 #include <paths.h>
 #include <net/ethernet.h>
@@ -1232,7 +1233,7 @@ print_tags(const struct pppoe_hdr* ph)
 static void
 PppoeListenEvent(int type, void *arg)
 {
-	int			k, sz;
+	int			sz;
 	struct PppoeIf		*PIf = (struct PppoeIf *)(arg);
 	char			rhook[NG_HOOKSIZ];
 	unsigned char		response[1024];
@@ -1246,7 +1247,7 @@ PppoeListenEvent(int type, void *arg)
 	char			agent_rid[64];
 	struct ngm_connect      cn;
 	struct ngm_mkpeer 	mp;
-	Link 			l = NULL;
+	Link 			l = NULL, l2;
 	PppoeInfo		pi = NULL;
 	const struct pppoe_full_hdr	*wh;
 	const struct pppoe_hdr	*ph;
@@ -1328,21 +1329,15 @@ PppoeListenEvent(int type, void *arg)
 		return;
 	}
 
-	if (OVERLOAD()) {
+	if (AdmissionCheck(ADM_PPPOE, PIf->ifnodepath)) {
 		Log(LG_PHYS, ("Daemon overloaded, ignoring request."));
 		return;
 	}
 
 	/* Examine all PPPoE links. */
-	for (k = 0; k < gNumLinks; k++) {
-		Link l2;
-	        PppoeInfo pi2;
-
-		if (!gLinks[k] || gLinks[k]->type != &gPppoePhysType)
-			continue;
-
-		l2 = gLinks[k];
-		pi2 = (PppoeInfo)l2->info;
+	for (l2 = LinkPoolFirst(&gPppoePhysType); l2 != NULL;
+	    l2 = LinkPoolNext(l2)) {
+		PppoeInfo pi2 = (PppoeInfo)l2->info;
 
 		if ((!PhysIsBusy(l2)) &&
 		    (pi2->PIf == PIf) &&
@@ -15,6 +15,7 @@
 #include "pptp_ctrl.h"
 #include "log.h"
 #include "util.h"
+#include "admission.h"
 
 #include <net/ethernet.h>
 #include <netgraph/ng_message.h>
@@ -1024,9 +1025,9 @@ PptpPeerCall(struct pptpctrlinfo *cinfo,
 	const char *calledNum)
 {
     struct pptplinkinfo	linfo;
-    Link		l = NULL;
+    Link		l = NULL, l2;
     PptpInfo		pi = NULL;
-    int			k;
+    char		buf[48];
 
     memset(&linfo, 0, sizeof(linfo));
 
@@ -1040,21 +1041,15 @@ PptpPeerCall(struct pptpctrlinfo *cinfo,
 	return(linfo);
     }
 
-    if (OVERLOAD()) {
+    if (AdmissionCheck(ADM_PPTP, u_addrtoa(self, buf, sizeof(buf)))) {
 	Log(LG_PHYS, ("Daemon overloaded, ignoring request."));
 	return(linfo);
     }
 
     /* Find a suitable link; prefer the link best matching peer's IP address */
-    for (k = 0; k < gNumLinks; k++) {
-	Link l2;
-	PptpInfo pi2;
-
-	if (!gLinks[k] || gLinks[k]->type != &gPptpPhysType)
-		continue;
-
-	l2 = gLinks[k];
-	pi2 = (PptpInfo)l2->info;
+    for (l2 = LinkPoolFirst(&gPptpPhysType); l2 != NULL;
+        l2 = LinkPoolNext(l2)) {
+	PptpInfo pi2 = (PptpInfo)l2->info;
 
 	/* See if link is feasible */
 	if ((!PhysIsBusy(l2)) &&
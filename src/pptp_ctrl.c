@@ -96,6 +96,13 @@
 
   #define PPTP_CHAN_IS_PNS(ch)		(!(ch)->orig ^ !(ch)->incoming)
 
+  /* Control channels to one peer address */
+  struct pptppeer {
+    struct u_addr		addr;		/* peer address, must be first */
+    TAILQ_HEAD(, pptpctrl)	ctrls;		/* control channels */
+  };
+  typedef struct pptppeer	*PptpPeer;
+
   /* Control channel state */
   struct pptpctrl {
     u_int32_t		id;		/* channel index */
@@ -120,6 +127,8 @@
     PptpChan		*channels;	/* array of channels */
     int			numChannels;	/* length of channels array */
     u_int		active_sessions;	/* # non-dying sessns */
+    PptpPeer		peer;		/* peer index entry */
+    TAILQ_ENTRY(pptpctrl) peerlist;	/* other controls to this peer */
     char 		self_name[MAXHOSTNAMELEN]; /* local hostname */
     char		peer_name[MAXHOSTNAMELEN]; /* remote hostname */
   };
@@ -218,6 +227,16 @@
   static void	PptpCtrlNewCtrlState(PptpCtrl c, int new);
   static void	PptpCtrlNewChanState(PptpChan ch, int new);
 
+  static u_int32_t	PptpPeerHash(struct ghash *g, const void *item);
+  static int		PptpPeerEqual(struct ghash *g, const void *item1,
+			  const void *item2);
+  static u_int32_t	PptpCidHash(struct ghash *g, const void *item);
+  static int		PptpCidEqual(struct ghash *g, const void *item1,
+			  const void *item2);
+  static u_int32_t	PptpPeerCidHash(struct ghash *g, const void *item);
+  static int		PptpPeerCidEqual(struct ghash *g, const void *item1,
+			  const void *item2);
+
   static void		PptpCtrlOrigCall(int incoming, struct pptpctrlinfo *cinfo,
 			  struct pptplinkinfo *linfo, struct u_addr *locip,
 			  struct u_addr *ip, in_port_t port, int bearType,
@@ -234,6 +253,11 @@
 			  const char *calledNum, const char *subAddress);
   static PptpChan	PptpCtrlFindChan(PptpCtrl c, int type,
 			  void *msg, int incoming);
+  static PptpChan	PptpCtrlFindCid(PptpCtrl c, u_int16_t cid);
+  static PptpChan	PptpCtrlFindPeerCid(PptpCtrl c, u_int16_t cid, int n);
+  static void		PptpCtrlIndexCtrl(PptpCtrl c, int on);
+  static void		PptpCtrlIndexChan(PptpChan ch, int on);
+  static void		PptpCtrlSetPeerCid(PptpChan ch, u_int16_t cid);
   static void		PptpCtrlCheckConn(PptpCtrl c);
 
 /*
@@ -248,6 +272,12 @@
 
   static PptpCtrl		*gPptpCtrl;	/* array of control channels */
   static int			gNumPptpCtrl;	/* length of gPptpCtrl array */
+  static struct slotalloc	gPptpCtrlSlots
+				  = SLOTALLOC_INITIALIZER("pptp-ctrl");
+
+  static struct ghash		*gPptpPeers;	/* controls by peer address */
+  static struct ghash		*gPptpCids;	/* channels by my cid */
+  static struct keyindex	*gPptpPeerCids;	/* channels by peer cid */
 
   static PptpLis		*gPptpLis;	/* array of listeners */
   static int			gNumPptpLis;	/* length of gPptpLis array */
@@ -509,6 +539,16 @@ PptpCtrlInit(PptpGetInLink_t getInLink, PptpGetOutLink_t getOutLink)
 #endif
     bzero(gCallIds, sizeof(gCallIds));
 
+    /* Create control and channel indexes */
+    if ((gPptpPeers = ghash_create(NULL, 0, 0, MB_PPTP, PptpPeerHash,
+	  PptpPeerEqual, NULL, NULL)) == NULL
+	|| (gPptpCids = ghash_create(NULL, 0, 0, MB_PPTP, PptpCidHash,
+	  PptpCidEqual, NULL, NULL)) == NULL) {
+	Perror("PPTP: ghash_create");
+	return(-1);
+    }
+    gPptpPeerCids = KeyIndexCreate(MB_PPTP, PptpPeerCidHash, PptpPeerCidEqual);
+
     /* Sanity check structure lengths and valid state bits */
     for (type = 0; type < PPTP_MAX_CTRL_TYPE; type++) {
 	PptpMsgInfo	const mi = &gPptpMsgInfo[type];
@@ -1195,31 +1235,27 @@ PptpCtrlGetCtrl(int orig, struct u_addr *self_addr,
 	struct u_addr *peer_addr, in_port_t peer_port, char *buf, size_t bsiz)
 {
     PptpCtrl			c;
+    PptpPeer			p;
     int				k;
     struct sockaddr_storage	peer;
     char			buf1[48];
 
     /* For incoming any control is new! */
-    if (orig) {
+    if (orig && (p = ghash_get(gPptpPeers, peer_addr)) != NULL) {
 	/* See if we're already have a control block matching this address and port */
-	  for (k = 0; k < gNumPptpCtrl; k++) {
-		PptpCtrl	const d = gPptpCtrl[k];
-	
-		if (d != NULL
-		    && (d->active_sessions < gPPTPtunlimit)
-		    && (u_addrcompare(&d->peer_addr, peer_addr) == 0)
-		    && (d->peer_port == peer_port || d->orig != orig)
+	  TAILQ_FOREACH(c, &p->ctrls, peerlist) {
+		if ((c->active_sessions < gPPTPtunlimit)
+		    && (c->peer_port == peer_port || c->orig != orig)
 		    && (u_addrempty(self_addr) || 
-		      (u_addrcompare(&d->self_addr, self_addr) == 0))) {
-			return(d);
+		      (u_addrcompare(&c->self_addr, self_addr) == 0))) {
+			return(c);
 		}
 	  }
     }
 
     /* Find/create a free one */
-    for (k = 0; k < gNumPptpCtrl && gPptpCtrl[k] != NULL; k++);
-    if (k == gNumPptpCtrl)
-	LengthenArray(&gPptpCtrl, sizeof(*gPptpCtrl), &gNumPptpCtrl, MB_PPTP);
+    k = SlotAlloc(&gPptpCtrlSlots, &gPptpCtrl, sizeof(*gPptpCtrl),
+	&gNumPptpCtrl, MB_PPTP);
     c = Malloc(MB_PPTP, sizeof(*c));
     gPptpCtrl[k] = c;
 
@@ -1231,6 +1267,7 @@ PptpCtrlGetCtrl(int orig, struct u_addr *self_addr,
   c->peer_addr = *peer_addr;
   c->peer_port = peer_port;
   PptpCtrlNewCtrlState(c, PPTP_CTRL_ST_IDLE);
+  PptpCtrlIndexCtrl(c, TRUE);
 
   /* If not doing the connecting, return here */
   if (!orig)
@@ -1238,7 +1275,9 @@ PptpCtrlGetCtrl(int orig, struct u_addr *self_addr,
 
   /* Connect to peer */
   if ((c->csock = GetInetSocket(SOCK_STREAM, self_addr, 0, FALSE, buf, bsiz)) < 0) {
+    PptpCtrlIndexCtrl(c, FALSE);
     gPptpCtrl[k] = NULL;
+    SlotFree(&gPptpCtrlSlots, k);
     PptpCtrlFreeCtrl(c);
     return(NULL);
   }
@@ -1249,7 +1288,9 @@ PptpCtrlGetCtrl(int orig, struct u_addr *self_addr,
     c->csock = -1;
     snprintf(buf, bsiz, "pptp: connect to %s %u failed: %s",
       u_addrtoa(&c->peer_addr,buf1,sizeof(buf1)), c->peer_port, strerror(errno));
+    PptpCtrlIndexCtrl(c, FALSE);
     gPptpCtrl[k] = NULL;
+    SlotFree(&gPptpCtrlSlots, k);
     PptpCtrlFreeCtrl(c);
     return(NULL);
   }
@@ -1291,6 +1332,7 @@ PptpCtrlGetChan(PptpCtrl c, int chanState, int orig, int incoming,
     gCallIds[gLastCallId] = 1;
     ch->cid = gLastCallId;
     ch->ctrl = c;
+    PptpCtrlIndexChan(ch, TRUE);
     ch->orig = orig;
     ch->incoming = incoming;
     ch->minBps = minBps;
@@ -1443,7 +1485,9 @@ PptpCtrlKillCtrl(PptpCtrl c)
     if (ch != NULL)
       PptpCtrlKillChan(ch, "control channel shutdown");
   }
+  PptpCtrlIndexCtrl(c, FALSE);
   gPptpCtrl[c->id] = NULL;
+  SlotFree(&gPptpCtrlSlots, c->id);
   if (c->csock >= 0) {
     close(c->csock);
     c->csock = -1;
@@ -1595,6 +1639,7 @@ PptpCtrlKillChan(PptpChan ch, const char *errmsg)
   }
 
     /* Free channel */
+    PptpCtrlIndexChan(ch, FALSE);
     gCallIds[ch->cid] = 0;
     c->channels[ch->id] = NULL;
     c->active_sessions--;
@@ -1774,8 +1819,9 @@ PptpCtrlFindChan(PptpCtrl c, int type, void *msg, int incoming)
   PptpMsgInfo	const mi = &gPptpMsgInfo[type];
   const char	*fname = incoming ? mi->match.inField : mi->match.outField;
   const int	how = incoming ? mi->match.findIn : mi->match.findOut;
+  PptpChan	ch;
   u_int16_t	cid;
-  int		k;
+  int		n, pns;
   u_int		off = 0;
 
   /* Get the identifying CID field */
@@ -1784,31 +1830,33 @@ PptpCtrlFindChan(PptpCtrl c, int type, void *msg, int incoming)
   (void) PptpCtrlFindField(type, fname, &off);		/* we know len == 2 */
   cid = *((u_int16_t *)(void *)((u_char *) msg + off));
 
-  /* Match the CID against our list of active channels */
-  for (k = 0; k < c->numChannels; k++) {
-    PptpChan	const ch = c->channels[k];
-    u_int16_t	tryCid = 0;
-
-    if (ch == NULL)
-      continue;
-    switch (how) {
-      case PPTP_FIND_CHAN_MY_CID:
-	tryCid = ch->cid;
-	break;
-      case PPTP_FIND_CHAN_PEER_CID:
-	tryCid = ch->peerCid;
-	break;
-      case PPTP_FIND_CHAN_PNS_CID:
-	tryCid = PPTP_CHAN_IS_PNS(ch) ? ch->cid : ch->peerCid;
-	break;
-      case PPTP_FIND_CHAN_PAC_CID:
-	tryCid = !PPTP_CHAN_IS_PNS(ch) ? ch->cid : ch->peerCid;
-	break;
-      default:
-	assert(0);
-    }
-    if (cid == tryCid)
-      return(ch);
+  /*
+   * Look the CID up in the indexes. Every channel is indexed by its own
+   * CID, and by the peer's once received; until then no valid message
+   * can name it by the peer's CID.
+   */
+  switch (how) {
+    case PPTP_FIND_CHAN_MY_CID:
+      if ((ch = PptpCtrlFindCid(c, cid)) != NULL)
+	return(ch);
+      break;
+    case PPTP_FIND_CHAN_PEER_CID:
+      if ((ch = PptpCtrlFindPeerCid(c, cid, 0)) != NULL)
+	return(ch);
+      break;
+    case PPTP_FIND_CHAN_PNS_CID:
+    case PPTP_FIND_CHAN_PAC_CID:
+      pns = (how == PPTP_FIND_CHAN_PNS_CID);
+      if ((ch = PptpCtrlFindCid(c, cid)) != NULL
+	  && !PPTP_CHAN_IS_PNS(ch) == !pns)
+	return(ch);
+      for (n = 0; (ch = PptpCtrlFindPeerCid(c, cid, n)) != NULL; n++) {
+	if (!PPTP_CHAN_IS_PNS(ch) != !pns)
+	  return(ch);
+      }
+      break;
+    default:
+      assert(0);
   }
 
   /* Not found */
@@ -1816,6 +1864,155 @@ PptpCtrlFindChan(PptpCtrl c, int type, void *msg, int incoming)
   return(NULL);
 }
 
+/*
+ * PptpCtrlFindCid()
+ * PptpCtrlFindPeerCid()
+ *
+ * Find a channel of this control channel by my or the peer's CID.
+ * The peer may give the same CID to several of our channels, so
+ * PptpCtrlFindPeerCid() returns the n-th of them.
+ */
+
+static PptpChan
+PptpCtrlFindCid(PptpCtrl c, u_int16_t cid)
+{
+  struct pptpchan	key;
+  PptpChan		ch;
+
+  key.cid = cid;
+  if ((ch = ghash_get(gPptpCids, &key)) == NULL || ch->ctrl != c)
+    return(NULL);
+  return(ch);
+}
+
+static PptpChan
+PptpCtrlFindPeerCid(PptpCtrl c, u_int16_t cid, int n)
+{
+  struct pptpchan	key;
+
+  key.ctrl = c;
+  key.peerCid = cid;
+  return(KeyIndexGet(gPptpPeerCids, &key, n));
+}
+
+/*
+ * PptpCtrlIndexCtrl()
+ *
+ * Add a control channel to, or remove it from, the list of
+ * control channels to its peer address.
+ */
+
+static void
+PptpCtrlIndexCtrl(PptpCtrl c, int on)
+{
+  PptpPeer	p;
+
+  if (on) {
+    if ((p = ghash_get(gPptpPeers, &c->peer_addr)) == NULL) {
+      p = Malloc(MB_PPTP, sizeof(*p));
+      p->addr = c->peer_addr;
+      TAILQ_INIT(&p->ctrls);
+      if (ghash_put(gPptpPeers, p) == -1) {
+	Perror("PPTP: ghash_put");
+	DoExit(EX_ERRDEAD);
+      }
+    }
+    TAILQ_INSERT_TAIL(&p->ctrls, c, peerlist);
+    c->peer = p;
+  } else if ((p = c->peer) != NULL) {
+    TAILQ_REMOVE(&p->ctrls, c, peerlist);
+    c->peer = NULL;
+    if (TAILQ_EMPTY(&p->ctrls)) {
+      ghash_remove(gPptpPeers, p);
+      Freee(p);
+    }
+  }
+}
+
+/*
+ * PptpCtrlIndexChan()
+ *
+ * Add a channel to, or remove it from, the CID indexes. The peer's
+ * CID is indexed only once it is known, see PptpCtrlSetPeerCid().
+ */
+
+static void
+PptpCtrlIndexChan(PptpChan ch, int on)
+{
+  if (on) {
+    if (ghash_put(gPptpCids, ch) == -1) {
+      Perror("PPTP: ghash_put");
+      DoExit(EX_ERRDEAD);
+    }
+    return;
+  }
+  if (ghash_get(gPptpCids, ch) == ch)
+    ghash_remove(gPptpCids, ch);
+  KeyIndexDel(gPptpPeerCids, ch);
+}
+
+/*
+ * PptpCtrlSetPeerCid()
+ *
+ * Set the peer's CID of a channel and index it.
+ */
+
+static void
+PptpCtrlSetPeerCid(PptpChan ch, u_int16_t cid)
+{
+  KeyIndexDel(gPptpPeerCids, ch);
+  ch->peerCid = cid;
+  KeyIndexAdd(gPptpPeerCids, ch);
+}
+
+static u_int32_t
+PptpPeerHash(struct ghash *g, const void *item)
+{
+  (void)g;
+  return(u_addrtoid(item));
+}
+
+static int
+PptpPeerEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  (void)g;
+  return(u_addrcompare(item1, item2) == 0);
+}
+
+static u_int32_t
+PptpCidHash(struct ghash *g, const void *item)
+{
+  (void)g;
+  return(((const struct pptpchan *)item)->cid);
+}
+
+static int
+PptpCidEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  (void)g;
+  return(((const struct pptpchan *)item1)->cid
+    == ((const struct pptpchan *)item2)->cid);
+}
+
+static u_int32_t
+PptpPeerCidHash(struct ghash *g, const void *item)
+{
+  const struct pptpchan	*const ch = item;
+
+  (void)g;
+  return((ch->ctrl->id << 16) ^ ch->peerCid);
+}
+
+static int
+PptpPeerCidEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  const struct pptpchan	*const ch1 = item1;
+  const struct pptpchan	*const ch2 = item2;
+
+  (void)g;
+  return(ch1->ctrl == ch2->ctrl && ch1->peerCid == ch2->peerCid);
+}
+
 /*************************************************************************
 			  MISC FUNCTIONS
 *************************************************************************/
@@ -2185,7 +2382,7 @@ PptpOutCallRequest(PptpCtrl c, struct pptpOutCallRequest *req)
 
   /* Link layer says it's OK; wait for link layer to report back later */
   ch->serno = req->serno;
-  ch->peerCid = req->cid;
+  PptpCtrlSetPeerCid(ch, req->cid);
   ch->peerPpd = req->ppd;
   ch->recvWin = req->recvWin;
   ch->linfo = linfo;
@@ -2229,7 +2426,7 @@ PptpOutCallReply(PptpChan ch, struct pptpOutCallReply *reply)
   /* Call succeeded */
   ch->peerPpd = reply->ppd;
   ch->recvWin = reply->recvWin;
-  ch->peerCid = reply->cid;
+  PptpCtrlSetPeerCid(ch, reply->cid);
   Log(LG_PHYS2, ("pptp%d-%d: outgoing call connected at %d bps",
     c->id, ch->id, reply->speed));
   PptpCtrlNewChanState(ch, PPTP_CHAN_ST_ESTABLISHED);
@@ -2304,7 +2501,7 @@ PptpInCallRequest(PptpCtrl c, struct pptpInCallRequest *req)
     c->id, ch->id, calledNum, callingNum));
   reply.result = PPTP_ICR_RESL_OK;
   ch->serno = req->serno;
-  ch->peerCid = req->cid;
+  PptpCtrlSetPeerCid(ch, req->cid);
   ch->bearType = req->bearType;
   strncpy(ch->callingNum, req->dialing, sizeof(ch->callingNum));
   strncpy(ch->calledNum, req->dialed, sizeof(ch->calledNum));
@@ -2343,7 +2540,7 @@ PptpInCallReply(PptpChan ch, struct pptpInCallReply *reply)
 
   /* Call succeeded */
   Log(LG_PHYS2, ("pptp%d-%d: incoming call accepted by peer", c->id, ch->id));
-  ch->peerCid = reply->cid;
+  PptpCtrlSetPeerCid(ch, reply->cid);
   ch->peerPpd = reply->ppd;
   ch->recvWin = reply->recvWin;
   PptpCtrlNewChanState(ch, PPTP_CHAN_ST_ESTABLISHED);
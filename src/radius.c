@@ -28,6 +28,7 @@
 #include "ng.h"
 #endif
 #include "util.h"
+#include "admission.h"
 
 #include <sys/types.h>
 
@@ -125,7 +126,7 @@ rad_put_string_tag(struct rad_handle *h, int type, u_char tag, const char *str)
     if (tag == 0) {
 	res = rad_put_attr(h, type, str, len);
     } else if (tag <= 0x1F) {
-	tmp = Malloc(MB_RADIUS, len + 1);
+	tmp = MallocRaw(MB_RADIUS, len + 1);
 	tmp[0] = tag;
 	memcpy(tmp + 1, str, len);
 	res = rad_put_attr(h, type, tmp, len + 1);
@@ -1282,6 +1283,7 @@ RadiusPutAcct(AuthData auth)
 static int 
 RadiusSendRequest(AuthData auth)
 {
+    struct timeval	start;
     struct timeval	timelimit;
     struct timeval	tv;
     int 		fd, n;
@@ -1295,8 +1297,8 @@ RadiusSendRequest(AuthData auth)
 	return (RAD_NACK);
     }
 
-    gettimeofday(&timelimit, NULL);
-    timeradd(&tv, &timelimit, &timelimit);
+    gettimeofday(&start, NULL);
+    timeradd(&tv, &start, &timelimit);
 
     for ( ; ; ) {
 	struct pollfd fds[1];
@@ -1331,6 +1333,11 @@ RadiusSendRequest(AuthData auth)
 	timeradd(&tv, &timelimit, &timelimit);
     }
 
+    /* Replies and timeouts alike tell how busy the server is */
+    gettimeofday(&tv, NULL);
+    timersub(&tv, &start, &tv);
+    AdmissionRadiusLatency(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+
     switch (n) {
 
 	case RAD_ACCESS_ACCEPT:
@@ -1394,7 +1401,7 @@ RadiusGetParams(AuthData auth, int eap_proxy)
   size_t	tmpkey_len;
 #endif
 
-  Freee(auth->params.eapmsg);
+  ArenaFreee(auth->params.arena, auth->params.eapmsg);
   auth->params.eapmsg = NULL;
   
   while ((res = rad_get_attr(auth->radius.handle, &data, &len)) > 0) {
@@ -1406,7 +1413,7 @@ RadiusGetParams(AuthData auth, int eap_proxy)
 	Log(LG_RADIUS2, ("[%s] RADIUS: Get RAD_STATE: 0x%s", auth->info.lnkname, tmpval));
 	Freee(tmpval);
 	auth->params.state_len = len;
-	Freee(auth->params.state);
+	ArenaFreee(auth->params.arena, auth->params.state);
 	auth->params.state = Mdup(MB_AUTH, data, len);
 	continue;
 
@@ -1415,7 +1422,7 @@ RadiusGetParams(AuthData auth, int eap_proxy)
 	Log(LG_RADIUS2, ("[%s] RADIUS: Get RAD_CLASS: 0x%s", auth->info.lnkname, tmpval));
 	Freee(tmpval);
 	auth->params.class_len = len;
-	Freee(auth->params.class);
+	ArenaFreee(auth->params.arena, auth->params.class);
 	auth->params.class = Mdup(MB_AUTH, data, len);
 	continue;
 
@@ -1429,11 +1436,10 @@ RadiusGetParams(AuthData auth, int eap_proxy)
 	  char *tbuf;
 	  Log(LG_RADIUS2, ("[%s] RADIUS: Get RAD_EAP_MESSAGE: len %d of %d",
 	    auth->info.lnkname, (int)len, (int)(auth->params.eapmsg_len + len)));
-	  tbuf = Malloc(MB_AUTH, auth->params.eapmsg_len + len);
-	  memcpy(tbuf, auth->params.eapmsg, auth->params.eapmsg_len);
+	  tbuf = Mrealloc(MB_AUTH, auth->params.eapmsg,
+	    auth->params.eapmsg_len + len);
 	  memcpy(&tbuf[auth->params.eapmsg_len], data, len);
 	  auth->params.eapmsg_len += len;
-	  Freee(auth->params.eapmsg);
 	  auth->params.eapmsg = tbuf;
 	} else {
 	  Log(LG_RADIUS2, ("[%s] RADIUS: Get RAD_EAP_MESSAGE: len %d",
@@ -1602,7 +1608,7 @@ RadiusGetParams(AuthData auth, int eap_proxy)
         break;
 
       case RAD_FILTER_ID:
-	Freee(auth->params.filter_id);
+	ArenaFreee(auth->params.arena, auth->params.filter_id);
 	auth->params.filter_id = NULL;
 	if (len == 0)
 	    break;
@@ -1699,7 +1705,7 @@ RadiusGetParams(AuthData auth, int eap_proxy)
 		break;
 
 	      case RAD_MICROSOFT_MS_CHAP_DOMAIN:
-		Freee(auth->params.msdomain);
+		ArenaFreee(auth->params.arena, auth->params.msdomain);
 		auth->params.msdomain = NULL;
 		if (len == 0)
 		    break;
@@ -1838,7 +1844,7 @@ RadiusGetParams(AuthData auth, int eap_proxy)
 		tmpval = rad_cvt_string(data, len);
 	        Log(LG_RADIUS2, ("[%s] RADIUS: Get RAD_MPD_IFACE_DESCR: %s",
 	    	    auth->info.lnkname, tmpval));
-		Freee(auth->params.ifdescr);
+		ArenaFreee(auth->params.arena, auth->params.ifdescr);
 		auth->params.ifdescr = Mdup(MB_AUTH, tmpval, len + 1);
 		free(tmpval);
 		break;
@@ -21,6 +21,9 @@
  * DEFINITIONS
  */
 
+  /* Requests served per wakeup when a burst is queued */
+  #define RADSRV_MAX_BATCH	64
+
   /* Set menu options */
   enum {
     SET_OPEN,
@@ -37,6 +40,11 @@
  */
 
   static int	RadsrvSetCommand(Context ctx, int ac, const char *const av[], const void *arg);
+  static void	RadsrvRequest(Radsrv w);
+  static int	RadsrvCandidates(int nasport, const char *sesid,
+		    const char *link, const char *msesid, const char *bundle,
+		    const char *iface, struct in_addr ip, const char *username,
+		    int **idsp);
 
 /*
  * GLOBAL VARIABLES
@@ -91,10 +99,34 @@ RadsrvInit(Radsrv w)
 static void
 RadsrvEvent(int type, void *cookie)
 {
-    Radsrv	w = (Radsrv)cookie;
+    Radsrv		w = (Radsrv)cookie;
+    struct pollfd	pfd;
+    int			k;
+
+    (void)type;
+
+    /* Serve the requests already queued, a limited number per wakeup */
+    for (k = 0; k < RADSRV_MAX_BATCH; k++) {
+	RadsrvRequest(w);
+	pfd.fd = w->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) <= 0 || (pfd.revents & POLLIN) == 0)
+	    break;
+    }
+}
+
+/*
+ * RadsrvRequest()
+ */
+
+static void
+RadsrvRequest(Radsrv w)
+{
     const void	*data;
     size_t	len;
     int		res, result, found, err, anysesid, l;
+    int		*ids, nids, k;
     Bund	B;
     Link  	L;
     char        *tmpval;
@@ -126,7 +158,6 @@ RadsrvEvent(int type, void *cookie)
     struct acl		*acl_limits[ACL_DIRS];	/* traffic limits based on mpd's filters */
     char 		std_acct[ACL_DIRS][ACL_NAME_LEN]; /* Names of ACL returned in standard accounting */
 
-    (void)type;
     bzero(acl_filters, sizeof(acl_filters));
     bzero(acl_limits, sizeof(acl_limits));
     bzero(std_acct, sizeof(std_acct));
@@ -473,7 +504,10 @@ RadsrvEvent(int type, void *cookie)
     }
     found = 0;
     err = 503;
-    for (l = 0; l < gNumLinks; l++) {
+    nids = RadsrvCandidates(nasport, sesid, link, msesid, bundle, iface, ip,
+	username, &ids);
+    for (k = 0; k < (nids < 0 ? gNumLinks : nids); k++) {
+	l = (nids < 0) ? k : ids[k];
 	if ((L = gLinks[l]) != NULL) {
 	    B = L->bund;
 	    if (nasport != -1 && nasport != l)
@@ -522,35 +556,35 @@ RadsrvEvent(int type, void *cookie)
 		    IfaceDown(B);
 		}
 #ifdef USE_IPFW
-	        ACLDestroy(L->lcp.auth.params.acl_rule);
-	        ACLDestroy(L->lcp.auth.params.acl_pipe);
-	        ACLDestroy(L->lcp.auth.params.acl_queue);
-	        ACLDestroy(L->lcp.auth.params.acl_table);
+	        ACLDestroy(L->lcp.auth.params.acl_rule, L->lcp.auth.params.arena);
+	        ACLDestroy(L->lcp.auth.params.acl_pipe, L->lcp.auth.params.arena);
+	        ACLDestroy(L->lcp.auth.params.acl_queue, L->lcp.auth.params.arena);
+	        ACLDestroy(L->lcp.auth.params.acl_table, L->lcp.auth.params.arena);
 	        L->lcp.auth.params.acl_rule = NULL;
 	        L->lcp.auth.params.acl_pipe = NULL;
 	        L->lcp.auth.params.acl_queue = NULL;
 	        L->lcp.auth.params.acl_table = NULL;
-	        ACLCopy(acl_rule, &L->lcp.auth.params.acl_rule);
-	        ACLCopy(acl_pipe, &L->lcp.auth.params.acl_pipe);
-	        ACLCopy(acl_queue, &L->lcp.auth.params.acl_queue);
-	        ACLCopy(acl_table, &L->lcp.auth.params.acl_table);
+	        ACLCopy(acl_rule, &L->lcp.auth.params.acl_rule, NULL);
+	        ACLCopy(acl_pipe, &L->lcp.auth.params.acl_pipe, NULL);
+	        ACLCopy(acl_queue, &L->lcp.auth.params.acl_queue, NULL);
+	        ACLCopy(acl_table, &L->lcp.auth.params.acl_table, NULL);
 #endif /* USE_IPFW */
 		if (rad_class != NULL) {
 		    if (L->lcp.auth.params.class != NULL)
-			Freee(L->lcp.auth.params.class);
+			ArenaFreee(L->lcp.auth.params.arena, L->lcp.auth.params.class);
 		    L->lcp.auth.params.class = Mdup(MB_AUTH, rad_class, class_len);
 		    L->lcp.auth.params.class_len = class_len;
 		}
 #ifdef USE_NG_BPF
 	        for (i = 0; i < ACL_FILTERS; i++) {
-	    	    ACLDestroy(L->lcp.auth.params.acl_filters[i]);
+	    	    ACLDestroy(L->lcp.auth.params.acl_filters[i], L->lcp.auth.params.arena);
 	    	    L->lcp.auth.params.acl_filters[i] = NULL;
-	    	    ACLCopy(acl_filters[i], &L->lcp.auth.params.acl_filters[i]);
+	    	    ACLCopy(acl_filters[i], &L->lcp.auth.params.acl_filters[i], NULL);
 		}
 	        for (i = 0; i < ACL_DIRS; i++) {
-	    	    ACLDestroy(L->lcp.auth.params.acl_limits[i]);
+	    	    ACLDestroy(L->lcp.auth.params.acl_limits[i], L->lcp.auth.params.arena);
 	    	    L->lcp.auth.params.acl_limits[i] = NULL;
-	    	    ACLCopy(acl_limits[i], &L->lcp.auth.params.acl_limits[i]);
+	    	    ACLCopy(acl_limits[i], &L->lcp.auth.params.acl_limits[i], NULL);
 		}
 		strcpy(L->lcp.auth.params.std_acct[0], std_acct[0]);
 		strcpy(L->lcp.auth.params.std_acct[1], std_acct[1]);
@@ -580,6 +614,8 @@ RadsrvEvent(int type, void *cookie)
 		if (B && B->iface.up && !B->iface.dod) {
 		    authparamsDestroy(&B->params);
 		    authparamsCopy(&L->lcp.auth.params,&B->params);
+		    BundIndexUser(B);
+		    BundIndexMp(B);
 		    if (B->iface.ip_up)
 			IfaceIpIfaceUp(B, 1);
 		    if (B->iface.ipv6_up)
@@ -589,6 +625,7 @@ RadsrvEvent(int type, void *cookie)
 	    }
 	}
     }
+    Freee(ids);
     if (result == RAD_DISCONNECT_REQUEST) {
 	if (found) {
 	    rad_create_response(w->handle, RAD_DISCONNECT_ACK);
@@ -632,19 +669,90 @@ cleanup:
     if (state != NULL)
 	Freee(state);
 #ifdef USE_IPFW
-    ACLDestroy(acl_rule);
-    ACLDestroy(acl_pipe);
-    ACLDestroy(acl_queue);
-    ACLDestroy(acl_table);
+    ACLDestroy(acl_rule, NULL);
+    ACLDestroy(acl_pipe, NULL);
+    ACLDestroy(acl_queue, NULL);
+    ACLDestroy(acl_table, NULL);
 #endif /* USE_IPFW */
 #ifdef USE_NG_BPF
     for (i = 0; i < ACL_FILTERS; i++)
-	ACLDestroy(acl_filters[i]);
+	ACLDestroy(acl_filters[i], NULL);
     for (i = 0; i < ACL_DIRS; i++)
-	ACLDestroy(acl_limits[i]);
+	ACLDestroy(acl_limits[i], NULL);
 #endif /* USE_NG_BPF */
 }
 
+/*
+ * RadsrvCandidates()
+ *
+ * Use the session indexes to find the ids of the links a request may
+ * refer to, from its most selective attribute. Returns their number,
+ * or -1 if every link must be checked. The caller checks all the
+ * attributes on each candidate and frees the ids.
+ */
+
+static int
+RadsrvCandidates(int nasport, const char *sesid, const char *link,
+    const char *msesid, const char *bundle, const char *iface,
+    struct in_addr ip, const char *username, int **idsp)
+{
+    struct linkuser	*u;
+    struct u_addr	addr;
+    Link		L;
+    Bund		B;
+    int			n = 0, i, k;
+
+    *idsp = NULL;
+    if (nasport == -1 && !sesid && !link && !msesid && !bundle && !iface
+      && ip.s_addr == INADDR_BROADCAST) {
+	if (!username)
+	    return (-1);
+	if ((u = LinkFindUser(username)) == NULL)
+	    return (0);
+	*idsp = Malloc(MB_RADSRV, u->n * sizeof(**idsp));
+	LIST_FOREACH(L, &u->links, userlist)
+	    (*idsp)[n++] = L->id;
+	return (n);
+    }
+    if (ip.s_addr != INADDR_BROADCAST)
+	in_addrtou_addr(&ip, &addr);
+
+    /* Every link or bundle with the key, there may be more than one */
+    for (i = 0; ; i++) {
+	L = NULL;
+	B = NULL;
+	if (nasport != -1) {
+	    if (i == 0 && nasport >= 0 && nasport < gNumLinks)
+		L = gLinks[nasport];
+	} else if (sesid)
+	    L = LinkFindSession(sesid, i);
+	else if (link)
+	    L = LinkFindName(link, i);
+	else if (msesid)
+	    B = BundFindMSession(msesid, i);
+	else if (bundle)
+	    B = BundFindName(bundle, i);
+	else if (iface)
+	    B = BundFindIface(iface, i);
+	else
+	    B = BundFindPeer(&addr, i);
+
+	if (L != NULL) {
+	    *idsp = Mrealloc(MB_RADSRV, *idsp, (n + 1) * sizeof(**idsp));
+	    (*idsp)[n++] = L->id;
+	} else if (B != NULL) {
+	    *idsp = Mrealloc(MB_RADSRV, *idsp,
+		(n + NG_PPP_MAX_LINKS) * sizeof(**idsp));
+	    for (k = 0; k < NG_PPP_MAX_LINKS; k++) {
+		if (B->links[k] != NULL)
+		    (*idsp)[n++] = B->links[k]->id;
+	    }
+	} else
+	    break;
+    }
+    return (n);
+}
+
 /*
  * RadsrvOpen()
  */
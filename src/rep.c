@@ -23,6 +23,12 @@
 
   static void	RepShowLinks(Context ctx, Rep r);
 
+/*
+ * INTERNAL VARIABLES
+ */
+
+  static struct slotalloc	gRepSlots = SLOTALLOC_INITIALIZER("repeaters");
+
 /*
  * RepIncoming()
  */
@@ -273,9 +279,7 @@ RepCreate(Link in, const char *out)
     r->csock = -1;
 
     /* Add repeater to the list of repeaters and make it the current active repeater */
-    for (k = 0; k < gNumReps && gReps[k] != NULL; k++);
-    if (k == gNumReps)			/* add a new repeater pointer */
-        LengthenArray(&gReps, sizeof(*gReps), &gNumReps, MB_REP);
+    k = SlotAlloc(&gRepSlots, &gReps, sizeof(*gReps), &gNumReps, MB_REP);
     r->id = k;
     gReps[k] = r;
     REF(r);
@@ -300,6 +304,7 @@ RepShutdown(Rep r)
     int k;
 
     gReps[r->id] = NULL;
+    SlotFree(&gRepSlots, r->id);
 
     Log(LG_REP, ("[%s] Rep: Shutdown", r->name));
     for (k = 0; k < 2; k++) {
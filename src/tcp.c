@@ -11,6 +11,7 @@
 #include "ngfunc.h"
 #include "tcp.h"
 #include "log.h"
+#include "admission.h"
 
 #include <netgraph/ng_message.h>
 #include <netgraph/ng_socket.h>
@@ -429,9 +430,8 @@ TcpAcceptEvent(int type, void *cookie)
 	struct u_addr	addr;
 	in_port_t	port;
 	char		buf[48];
-	int 		k;
 	struct TcpIf 	*If=(struct TcpIf *)(cookie);
-	Link		l = NULL;
+	Link		l = NULL, l2;
 	TcpInfo		pi = NULL;
 
 	assert(type == EVENT_READ);
@@ -451,21 +451,16 @@ TcpAcceptEvent(int type, void *cookie)
 		return;
 	}
 
-	if (OVERLOAD()) {
+	if (AdmissionCheck(ADM_TCP,
+	    u_addrtoa(&If->self_addr, buf, sizeof(buf)))) {
 		Log(LG_PHYS, ("Daemon overloaded, ignoring request."));
 		return;
 	}
 
 	/* Examine all TCP links. */
-	for (k = 0; k < gNumLinks; k++) {
-		Link l2;
-	        TcpInfo pi2;
-
-		if (!gLinks[k] || gLinks[k]->type != &gTcpPhysType)
-			continue;
-
-		l2 = gLinks[k];
-		pi2 = (TcpInfo)l2->info;
+	for (l2 = LinkPoolFirst(&gTcpPhysType); l2 != NULL;
+	    l2 = LinkPoolNext(l2)) {
+		TcpInfo pi2 = (TcpInfo)l2->info;
 
 		if ((!PhysIsBusy(l2)) &&
 		    Enabled(&l2->conf.options, LINK_CONF_INCOMING) &&
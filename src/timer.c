@@ -9,6 +9,12 @@
 
 #include "ppp.h"
 
+/*
+ * GLOBAL VARIABLES
+ */
+
+  int	gTimerSlack = 1000;	/* ms, for periodic per-session timers */
+
 /*
  * INTERNAL FUNCTIONS
  */
@@ -38,16 +44,23 @@ TimerInit2(PppTimer timer, const char *desc,
 void
 TimerStart2(PppTimer timer, const char *file, int line)
 {
-    /* Stop timer if running */
     assert(timer->func);
-    if (EventIsRegistered(&timer->event))
-	EventUnRegister(&timer->event);
-
     Log(LG_EVENTS, ("EVENT: Starting timer \"%s\" %s() for %d ms at %s:%d",
 	timer->desc, timer->dbg, timer->load, file, line));
+
+    /* Re-arm in place if already running, otherwise stop it */
+    if (EventIsRegistered(&timer->event)) {
+	if ((timer->event.flags & EVENT_RECURRING) == 0
+	    && EventReschedule(&timer->event, timer->load) == 0)
+	    return;
+	EventUnRegister(&timer->event);
+    }
+
     /* Register timeout event */
     EventRegister(&timer->event, EVENT_TIMEOUT,
 	timer->load, 0, TimerExpires, timer);
+    if (timer->slack > 0)
+	EventSetSlack(&timer->event, timer->slack);
 }
 
 /*
@@ -57,16 +70,23 @@ TimerStart2(PppTimer timer, const char *file, int line)
 void
 TimerStartRecurring2(PppTimer timer, const char *file, int line)
 {
-    /* Stop timer if running */
     assert(timer->func);
     Log(LG_EVENTS, ("EVENT: Starting recurring timer \"%s\" %s() for %d ms at %s:%d",
 	timer->desc, timer->dbg, timer->load, file, line));
-    if (EventIsRegistered(&timer->event))
+
+    /* Re-arm in place if already running, otherwise stop it */
+    if (EventIsRegistered(&timer->event)) {
+	if ((timer->event.flags & EVENT_RECURRING) != 0
+	    && EventReschedule(&timer->event, timer->load) == 0)
+	    return;
 	EventUnRegister(&timer->event);
+    }
 
     /* Register timeout event */
     EventRegister(&timer->event, EVENT_TIMEOUT,
 	timer->load, EVENT_RECURRING, TimerExpires, timer);
+    if (timer->slack > 0)
+	EventSetSlack(&timer->event, timer->slack);
 }
 
 /*
@@ -101,6 +121,24 @@ TimerExpires(int type, void *cookie)
     Log(LG_EVENTS, ("EVENT: Processing timer \"%s\" %s() done", desc, dbg));
 }
 
+/*
+ * TimerSetSlack()
+ *
+ * Allow the timer to expire up to slack ms late, so that timers of
+ * many sessions can share one wakeup. The slack is limited to a
+ * quarter of the timer's load. Call after TimerInit().
+ */
+
+void
+TimerSetSlack(PppTimer timer, int slack)
+{
+  if (slack > (int)timer->load / 4)
+    slack = timer->load / 4;
+  timer->slack = (slack > 0) ? slack : 0;
+  if (EventIsRegistered(&timer->event))
+    EventSetSlack(&timer->event, timer->slack);
+}
+
 /*
  * TimerRemain()
  *
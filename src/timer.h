@@ -28,10 +28,17 @@ struct pppTimer {
 	u_int	load;			/* Initial load value */
 	void (*func) (void *arg);	/* Called when timer expires */
 	void *arg;			/* Arg passed to timeout function */
+	int	slack;			/* Allowed lateness, see TimerSetSlack */
 	const char *desc;
 	const char *dbg;
 };
 
+/*
+ * VARIABLES
+ */
+
+extern int	gTimerSlack;
+
 /*
  * FUNCTIONS
  */
@@ -53,6 +60,7 @@ TimerInit2(PppTimer timer, const char *desc,
 #define	TimerStop(t)	\
 	    TimerStop2(t, __FILE__, __LINE__)
 	extern void TimerStop2(PppTimer t, const char *file, int line);
+	extern void TimerSetSlack(PppTimer t, int slack);
 	extern int TimerRemain(PppTimer t);
 	extern int TimerStarted(PppTimer t);
 
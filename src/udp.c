@@ -12,6 +12,7 @@
 #include "ngfunc.h"
 #include "util.h"
 #include "log.h"
+#include "admission.h"
 
 #include <netgraph/ng_message.h>
 #include <netgraph/ng_socket.h>
@@ -529,9 +530,8 @@ UdpAcceptEvent(int type, void *cookie)
 	in_port_t	port;
 	char		buf[48];
 	char		buf1[48];
-	int 		k;
 	struct UdpIf 	*If=(struct UdpIf *)(cookie);
-	Link		l = NULL;
+	Link		l = NULL, l2;
 	UdpInfo		pi = NULL;
 
 	char		pktbuf[UDP_MRU+100];
@@ -555,21 +555,15 @@ UdpAcceptEvent(int type, void *cookie)
 		goto failed;
 	}
 
-	if (OVERLOAD()) {
+	if (AdmissionCheck(ADM_UDP, buf1)) {
 		Log(LG_PHYS, ("Daemon overloaded, ignoring request."));
 		goto failed;
 	}
 
 	/* Examine all UDP links. */
-	for (k = 0; k < gNumLinks; k++) {
-		Link l2;
-	        UdpInfo pi2;
-
-		if (!gLinks[k] || gLinks[k]->type != &gUdpPhysType)
-			continue;
-
-		l2 = gLinks[k];
-		pi2 = (UdpInfo)l2->info;
+	for (l2 = LinkPoolFirst(&gUdpPhysType); l2 != NULL;
+	    l2 = LinkPoolNext(l2)) {
+		UdpInfo pi2 = (UdpInfo)l2->info;
 
 		if ((!PhysIsBusy(l2)) &&
 		    Enabled(&l2->conf.options, LINK_CONF_INCOMING) &&
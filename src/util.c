@@ -33,6 +33,12 @@
   #define MAX_OPEN_DELAY	2
   #define MAX_LOCK_ATTEMPTS	30
 
+  /* Items of a key index behind the first one with their key */
+  struct keyindexdup {
+    void	**items;		/* in the order indexed */
+    int		n;
+  };
+
 /*
  * INTERNAL VARIABLES
  */
@@ -86,8 +92,17 @@ static const u_int16_t Crc16Table[256] = {
   static char		HexVal(char c);
 
   static void           IndexConfFile(FILE *fp, struct configfile **cf);
+
+  static struct keyindexdup	*KeyIndexDups(struct keyindex *x, const void *key);
+  static u_int32_t	KeyIndexDupHash(struct ghash *g, const void *item);
+  static int		KeyIndexDupEqual(struct ghash *g, const void *item1, const void *item2);
+  static u_int32_t	StrIndexHash(struct ghash *g, const void *item);
+  static int		StrIndexEqual(struct ghash *g, const void *item1, const void *item2);
+  static u_int32_t	StrIndexHashCI(struct ghash *g, const void *item);
+  static int		StrIndexEqualCI(struct ghash *g, const void *item1, const void *item2);
   
   static struct configfiles	*ConfigFilesIndex=NULL;
+  static struct slotalloc	*gSlotAllocs = NULL;
 
 #undef isspace
 #define isspace(c) (((c)==' '||(c)=='\t'||(c)=='\n'||(c)=='\r')?1:0)
@@ -100,17 +115,316 @@ void
 LengthenArray(void *array, size_t esize, int *alenp, const char *type)
 {
   void **const arrayp = (void **)array;
-  void *newa;
 
-  newa = Malloc(type, (*alenp + 1) * esize);
-  if (*arrayp != NULL) {
-    memcpy(newa, *arrayp, *alenp * esize);
-    Freee(*arrayp);
-  }
-  *arrayp = newa;
+  *arrayp = Mrealloc(type, *arrayp, (*alenp + 1) * esize);
+  memset((char *)*arrayp + *alenp * esize, 0, esize);
   (*alenp)++;
 }
 
+/*
+ * SlotAlloc()
+ *
+ * Get a free index in an array of object pointers, lengthening the
+ * array by one if there is none. The array is reallocated in growing
+ * steps, so it must only be lengthened through here.
+ */
+
+int
+SlotAlloc(struct slotalloc *sa, void *array, size_t esize, int *alenp,
+  const char *type)
+{
+  void **const arrayp = (void **)array;
+
+  if (sa->lenp == NULL) {
+    sa->lenp = alenp;
+    sa->cap = *alenp;
+    sa->next = gSlotAllocs;
+    gSlotAllocs = sa;
+  }
+  if (sa->nfree > 0)
+    return (sa->free[--sa->nfree]);
+  if (*alenp == sa->cap) {
+    sa->cap = sa->cap ? sa->cap * 2 : 16;
+    *arrayp = Mrealloc(type, *arrayp, sa->cap * esize);
+  }
+  memset((char *)*arrayp + *alenp * esize, 0, esize);
+  return ((*alenp)++);
+}
+
+/*
+ * SlotFree()
+ *
+ * Give back an index whose array entry has been cleared
+ */
+
+void
+SlotFree(struct slotalloc *sa, int id)
+{
+  if (sa->nfree == sa->freecap) {
+    sa->freecap = sa->freecap ? sa->freecap * 2 : 16;
+    sa->free = Mrealloc(MB_UTIL, sa->free, sa->freecap * sizeof(*sa->free));
+  }
+  sa->free[sa->nfree++] = id;
+}
+
+/*
+ * SlotStat()
+ */
+
+void
+SlotStat(Context ctx)
+{
+  struct slotalloc	*sa;
+
+  if (gSlotAllocs == NULL)
+    return;
+  Printf("\r\n   %-20s %8s %8s %8s %8s %5s\r\n", "Registry",
+    "Length", "Alloc", "In use", "Free", "Frag%");
+  for (sa = gSlotAllocs; sa != NULL; sa = sa->next) {
+    Printf("   %-20s %8d %8d %8d %8d %5d\r\n", sa->name, *sa->lenp,
+      sa->cap, *sa->lenp - sa->nfree, sa->nfree,
+      *sa->lenp ? sa->nfree * 100 / *sa->lenp : 0);
+  }
+}
+
+/*
+ * KeyIndexCreate()
+ *
+ * The hash and equal functions get the indexed items, or the key
+ * looked for.
+ */
+
+struct keyindex *
+KeyIndexCreate(const char *mtype, ghash_hash_t *hash, ghash_equal_t *equal)
+{
+  struct keyindex	*x;
+
+  x = Malloc(mtype, sizeof(*x));
+  x->mtype = mtype;
+  x->hash = hash;
+  x->equal = equal;
+  if ((x->items = ghash_create(x, 0, 0, mtype, hash, equal,
+      NULL, NULL)) == NULL
+    || (x->dups = ghash_create(x, 0, 0, mtype, KeyIndexDupHash,
+      KeyIndexDupEqual, NULL, NULL)) == NULL) {
+    Perror("KeyIndexCreate: ghash_create");
+    DoExit(EX_ERRDEAD);
+  }
+  return (x);
+}
+
+/*
+ * KeyIndexAdd()
+ *
+ * Index an item. Another one with the same key stays first.
+ */
+
+void
+KeyIndexAdd(struct keyindex *x, void *item)
+{
+  struct keyindexdup	*d;
+  void			*first;
+  int			k;
+
+  if ((first = ghash_get(x->items, item)) == NULL) {
+    if (ghash_put(x->items, item) == -1) {
+      Perror("KeyIndexAdd: ghash_put");
+      DoExit(EX_ERRDEAD);
+    }
+    return;
+  }
+  if (first == item)
+    return;
+  if ((d = KeyIndexDups(x, item)) == NULL) {
+    d = Malloc(x->mtype, sizeof(*d));
+    d->items = Malloc(x->mtype, sizeof(*d->items));
+    d->items[d->n++] = item;
+    if (ghash_put(x->dups, d) == -1) {
+      Perror("KeyIndexAdd: ghash_put");
+      DoExit(EX_ERRDEAD);
+    }
+    return;
+  }
+  for (k = 0; k < d->n; k++) {
+    if (d->items[k] == item)
+      return;
+  }
+  d->items = Mrealloc(x->mtype, d->items, (d->n + 1) * sizeof(*d->items));
+  d->items[d->n++] = item;
+}
+
+/*
+ * KeyIndexDel()
+ *
+ * Remove an item. If it was first with its key, the next one indexed
+ * with that key takes its place.
+ */
+
+void
+KeyIndexDel(struct keyindex *x, void *item)
+{
+  struct keyindexdup	*d;
+  void			*first;
+  int			k;
+
+  if ((first = ghash_get(x->items, item)) == NULL)
+    return;
+  d = KeyIndexDups(x, item);
+  if (first == item) {
+    if (d == NULL) {
+      ghash_remove(x->items, item);
+      return;
+    }
+    ghash_put(x->items, d->items[0]);	/* replaces the item */
+    k = 0;
+  } else {
+    if (d == NULL)
+      return;
+    for (k = 0; k < d->n && d->items[k] != item; k++);
+    if (k == d->n)
+      return;
+  }
+  if (d->n == 1) {
+    ghash_remove(x->dups, d);
+    Freee(d->items);
+    Freee(d);
+    return;
+  }
+  memmove(&d->items[k], &d->items[k + 1], (d->n - k - 1) * sizeof(*d->items));
+  d->n--;
+}
+
+/*
+ * KeyIndexGet()
+ *
+ * The n-th item indexed with a key, counting from zero, or NULL.
+ */
+
+void *
+KeyIndexGet(struct keyindex *x, const void *key, int n)
+{
+  struct keyindexdup	*d;
+
+  if (n == 0)
+    return (ghash_get(x->items, (void *)(uintptr_t)key));
+  if ((d = KeyIndexDups(x, key)) == NULL || n > d->n)
+    return (NULL);
+  return (d->items[n - 1]);
+}
+
+/*
+ * KeyIndexDups()
+ *
+ * Items waiting behind the first one with a key, if any.
+ */
+
+static struct keyindexdup *
+KeyIndexDups(struct keyindex *x, const void *key)
+{
+  struct keyindexdup	d;
+  void			*item = (void *)(uintptr_t)key;
+
+  if (ghash_size(x->dups) == 0)
+    return (NULL);
+  d.items = &item;
+  d.n = 1;
+  return (ghash_get(x->dups, &d));
+}
+
+static u_int32_t
+KeyIndexDupHash(struct ghash *g, const void *item)
+{
+  const struct keyindex		*x = ghash_arg(g);
+  const struct keyindexdup	*d = item;
+
+  return ((*x->hash)(g, d->items[0]));
+}
+
+static int
+KeyIndexDupEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  const struct keyindex		*x = ghash_arg(g);
+  const struct keyindexdup	*d1 = item1;
+  const struct keyindexdup	*d2 = item2;
+
+  return ((*x->equal)(g, d1->items[0], d2->items[0]));
+}
+
+/*
+ * StrIndexCreate()
+ * StrIndexAdd()
+ * StrIndexDel()
+ * StrIndexGet()
+ *
+ * Key index of a string member, ignoring case if asked. Empty keys
+ * are not indexed. StrIndexGet() returns the first item with a key.
+ */
+
+struct keyindex *
+StrIndexCreate(const char *mtype, int nocase)
+{
+  return (KeyIndexCreate(mtype, nocase ? StrIndexHashCI : StrIndexHash,
+      nocase ? StrIndexEqualCI : StrIndexEqual));
+}
+
+void
+StrIndexAdd(struct keyindex *x, char *item)
+{
+  if (item[0] != 0)
+    KeyIndexAdd(x, item);
+}
+
+void
+StrIndexDel(struct keyindex *x, char *item)
+{
+  if (item[0] != 0)
+    KeyIndexDel(x, item);
+}
+
+void *
+StrIndexGet(struct keyindex *x, const char *key)
+{
+  return (KeyIndexGet(x, key, 0));
+}
+
+static u_int32_t
+StrIndexHash(struct ghash *g, const void *item)
+{
+  const u_char	*p;
+  u_int32_t	h = 0;
+
+  (void)g;
+  for (p = item; *p; p++)
+    h = h * 31 + *p;
+  return (h);
+}
+
+static int
+StrIndexEqual(struct ghash *g, const void *item1, const void *item2)
+{
+  (void)g;
+  return (strcmp(item1, item2) == 0);
+}
+
+static u_int32_t
+StrIndexHashCI(struct ghash *g, const void *item)
+{
+  const u_char	*p;
+  u_int32_t	h = 0;
+
+  (void)g;
+  for (p = item; *p; p++)
+    h = h * 31 + tolower(*p);
+  return (h);
+}
+
+static int
+StrIndexEqualCI(struct ghash *g, const void *item1, const void *item2)
+{
+  (void)g;
+  return (strcasecmp(item1, item2) == 0);
+}
+
 /*
  * ExecCmd()
  */
@@ -1073,14 +1387,14 @@ Bin2Hex(const unsigned char *bin, size_t len)
   char		*buf;
   
   if (len > 0) {
-    buf = Malloc(MB_UTIL, len * 2 + 1);
+    buf = MallocRaw(MB_UTIL, len * 2 + 1);
     for (i = j = 0; i < len; i++) {
       buf[j++] = hexconvtab[bin[i] >> 4];
       buf[j++] = hexconvtab[bin[i] & 15];
     }
     buf[j] = 0;
   } else {
-    buf = Malloc(MB_UTIL, 3);
+    buf = MallocRaw(MB_UTIL, 3);
     buf[0] = '0';
     buf[1] = '0';
     buf[2] = 0;
@@ -55,6 +55,37 @@ struct configfiles {
 	struct configfiles *next;
 };
 
+/*
+ * Allocator of indexes in an array of object pointers, like gLinks.
+ * Freed indexes are reused last freed first, the array grows only
+ * when none is free.
+ */
+struct slotalloc {
+	const char	*name;		/* for show mem */
+	int		*lenp;		/* length of the array */
+	int		cap;		/* allocated length of the array */
+	int		*free;		/* free indexes, last freed on top */
+	int		nfree;
+	int		freecap;	/* allocated length of 'free' */
+	struct slotalloc *next;		/* next allocator in use */
+};
+
+#define SLOTALLOC_INITIALIZER(name)	{ (name), NULL, 0, NULL, 0, 0, NULL }
+
+/*
+ * Index of structures by a key member, see INDEX_ITEM(). Every item is
+ * kept: the first one indexed with a key is in 'items', later ones with
+ * the same key wait in 'dups' and take its place when it goes. Walking
+ * 'items' visits one item per key.
+ */
+struct keyindex {
+	struct ghash	*items;		/* first item with each key */
+	struct ghash	*dups;		/* the others, per key */
+	const char	*mtype;
+	ghash_hash_t	*hash;		/* of the key an item points to */
+	ghash_equal_t	*equal;
+};
+
 /*
  * FUNCTIONS
  */
@@ -80,6 +111,26 @@ extern void ExclusiveCloseDevice(const char *label, int fd, const char *path);
 extern int PIDCheck(const char *lockfile, int killem);
 
 extern void LengthenArray(void *arrayp, size_t esize, int *alenp, const char *type);
+extern int SlotAlloc(struct slotalloc *sa, void *arrayp, size_t esize, int *alenp, const char *type);
+extern void SlotFree(struct slotalloc *sa, int id);
+extern void SlotStat(Context ctx);
+
+/*
+ * Index of structures by a member. The indexed items are the addresses
+ * of the member, INDEX_ITEM() turns one back into a pointer to the
+ * structure. The member must not change while indexed.
+ */
+#define INDEX_ITEM(item, type, member)	\
+	((type *)(void *)((char *)(item) - offsetof(type, member)))
+
+extern struct keyindex *KeyIndexCreate(const char *mtype, ghash_hash_t *hash, ghash_equal_t *equal);
+extern void KeyIndexAdd(struct keyindex *x, void *item);
+extern void KeyIndexDel(struct keyindex *x, void *item);
+extern void *KeyIndexGet(struct keyindex *x, const void *key, int n);
+extern struct keyindex *StrIndexCreate(const char *mtype, int nocase);
+extern void StrIndexAdd(struct keyindex *x, char *item);
+extern void StrIndexDel(struct keyindex *x, char *item);
+extern void *StrIndexGet(struct keyindex *x, const char *key);
 
 extern int ExecCmd(int log, const char *label, const char *fmt,...)__printflike(3, 4);
 extern int ExecCmdNosh(int log, const char *label, const char *fmt,...)__printflike(3, 4);
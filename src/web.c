@@ -319,9 +319,9 @@ WebShowHTMLSummary(FILE *f, int priv)
 	fprintf(f, "<td rowspan=\"%d\" class=\"%s\"><a href=\"/cmd?bund%%20%s&#38;show%%20ipv6cp\">%s</a></td>\n", 
 	    rows, B->tmpl?"d":FSM_COLOR(B->ipv6cp.fsm.state), B->name,FsmStateName(B->ipv6cp.fsm.state));
 	fprintf(f, "<td rowspan=\"%d\" class=\"%s\"><a href=\"/cmd?bund%%20%s&#38;show%%20ccp\">%s</a></td>\n", 
-	    rows, B->tmpl?"d":FSM_COLOR(B->ccp.fsm.state), B->name,FsmStateName(B->ccp.fsm.state));
+	    rows, B->tmpl?"d":FSM_COLOR(BUND_CCP_STATE(B)), B->name,FsmStateName(BUND_CCP_STATE(B)));
 	fprintf(f, "<td rowspan=\"%d\" class=\"%s\"><a href=\"/cmd?bund%%20%s&#38;show%%20ecp\">%s</a></td>\n", 
-	    rows, B->tmpl?"d":FSM_COLOR(B->ecp.fsm.state), B->name,FsmStateName(B->ecp.fsm.state));
+	    rows, B->tmpl?"d":FSM_COLOR(BUND_ECP_STATE(B)), B->name,FsmStateName(BUND_ECP_STATE(B)));
 	if (B->n_links == 0) {
 	    fprintf(f, "<td colspan=\"11\">&#160;</td>\n</tr>\n");
 	}
@@ -504,8 +504,8 @@ WebShowJSONSummary(FILE *f, int priv)
 	fprintf(f, "\"state\": \"%s\",\n", (B->iface.up?"Up":"Down"));
 	fprintf(f, "\"ipcp\": \"%s\",\n", FsmStateName(B->ipcp.fsm.state));
 	fprintf(f, "\"ipv6cp\": \"%s\",\n", FsmStateName(B->ipv6cp.fsm.state));
-	fprintf(f, "\"ccp\": \"%s\",\n", FsmStateName(B->ccp.fsm.state));
-	fprintf(f, "\"ecp\": \"%s\",\n", FsmStateName(B->ecp.fsm.state));
+	fprintf(f, "\"ccp\": \"%s\",\n", FsmStateName(BUND_CCP_STATE(B)));
+	fprintf(f, "\"ecp\": \"%s\",\n", FsmStateName(BUND_ECP_STATE(B)));
 
 	first_l = 1;
 	fprintf(f, "\"links\":[\n");
@@ -783,7 +783,9 @@ WebServletRun(struct http_servlet *servlet,
     if (!strcmp(path,"/mpd.css")) {
 	http_response_set_header(resp, 0, "Content-Type", "text/css");
 	WebShowCSS(f);
-    } else if (!strcmp(path,"/bincmd") || !strcmp(path,"/json")) {
+    } else if (!strcmp(path,"/bincmd") || !strcmp(path,"/json") ||
+	    !strcmp(path,"/json/events") || !strcmp(path,"/json/mem") ||
+	    !strcmp(path,"/json/logins")) {
 	http_response_set_header(resp, 0, "Content-Type", "text/plain");
 	http_response_set_header(resp, 1, "Pragma", "no-cache");
 	http_response_set_header(resp, 1, "Cache-Control", "no-cache, must-revalidate");
@@ -795,6 +797,12 @@ WebServletRun(struct http_servlet *servlet,
 	    WebRunBinCmd(f, query, priv);
 	else if (!strcmp(path,"/json"))
 	    WebShowJSONSummary(f, priv);
+	else if (!strcmp(path,"/json/events"))
+	    EventDumpJSON(f);
+	else if (!strcmp(path,"/json/mem"))
+	    MemDumpJSON(f);
+	else if (!strcmp(path,"/json/logins"))
+	    BundLoginsJSON(f);
 
 	GIANT_MUTEX_UNLOCK();
 	pthread_cleanup_pop(0);